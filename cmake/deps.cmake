@@ -69,6 +69,36 @@ add_subdirectory(${portable_file_dialogs_DIR} ${CMAKE_BINARY_DIR}/portable_file_
 find_package(OpenGL REQUIRED)
 
 
+#----------------------------------------------------------------------
+# Threads
+#----------------------------------------------------------------------
+# using the system bundled
+#----------------------------------------------------------------------
+find_package(Threads REQUIRED)
+
+
+#----------------------------------------------------------------------
+# libjpeg
+#----------------------------------------------------------------------
+# using the system bundled, e.g. libjpeg-turbo
+#   sudo apt install libjpeg-dev # ubuntu
+#   brew install jpeg-turbo # mac
+#----------------------------------------------------------------------
+if(IMCMP_USE_LIBJPEG)
+  find_package(JPEG REQUIRED)
+endif()
+
+
+#----------------------------------------------------------------------
+# zlib
+#----------------------------------------------------------------------
+# using the system bundled
+#----------------------------------------------------------------------
+if(IMCMP_USE_ZLIB)
+  find_package(ZLIB REQUIRED)
+endif()
+
+
 #----------------------------------------------------------------------
 # Googletest
 #----------------------------------------------------------------------
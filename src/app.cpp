@@ -3,6 +3,8 @@
 
 //#include <string>
 #include <vector>
+#include <future>
+#include <cmath>
 
 #include "image_io.hpp"
 #include "imgui.h"
@@ -15,7 +17,17 @@
 #include "portable-file-dialogs.h"
 
 #include "image_compare.hpp"
+#include "ssim.hpp"
+#include "row_diff.hpp"
+#include "noise_model.hpp"
+#include "compare_mask.hpp"
+#include "diff_blobs.hpp"
+#include "diff_pyramid.hpp"
+#include "delta_e.hpp"
+#include "jpeg_io.hpp"
 #include "image_render.hpp"
+#include "file_watcher.hpp"
+#include "sequence_compare.hpp"
 #include "imgInspect.h"
 
 #define STR_IMPLEMENTATION
@@ -85,6 +97,16 @@ public:
 
         myUpdateMouseWheel(); // not working now.
 
+        if (auto_reload)
+        {
+            ReloadChangedImages();
+        }
+        else
+        {
+            // drain the events, so changes made while it is off aren't all replayed once it is turned back on
+            file_watcher.poll();
+        }
+
         static bool use_work_area = true;
         static ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoScrollWithMouse;
 
@@ -106,6 +128,7 @@ public:
             if (ImGui::Button("Load##1"))
             {
                 LoadImage(imageLeft);
+                WatchImage(imageLeft, left_watch_id);
                 compare_condition_updated = true;
             }
             if (!imageLeft.mat.empty())
@@ -116,7 +139,9 @@ public:
                 //ImGui::Text("%s", text.c_str());
                 showText(imageLeft.get_name(), "1");
                 Str256 meta_info;
-                meta_info.setf("W=%d,H=%d; %d bytes", imageLeft.mat.size().width, imageLeft.mat.size().height, imageLeft.filesize);
+                meta_info.setf("W=%d,H=%d; %lld bytes; frame %lld/%lld", imageLeft.mat.size().width, imageLeft.mat.size().height, (long long)imageLeft.filesize, (long long)imageLeft.frame_index, (long long)imageLeft.frame_count);
+                if (imageLeft.reduction > 1)
+                    meta_info.appendf("; preview 1/%d", imageLeft.reduction);
                 showText(meta_info.c_str(), "2");
             }
             ImGui::EndChild();
@@ -129,19 +154,20 @@ public:
             if (ImGui::Button("Load##2"))
             {
                 LoadImage(imageRight);
+                WatchImage(imageRight, right_watch_id);
                 compare_condition_updated = true;
             }
             if (!imageRight.mat.empty())
             {
-                Str256 text;
-                text.setf("%s\nW=%d,H=%d; %d bytes", imageRight.get_name(), imageRight.mat.size().width, imageRight.mat.size().height, imageRight.filesize);
                 ImGui::SameLine();
                 //ImGui::SetCursorPosX(x); // align back to the left
 
                 //ImGui::Text("%s", text.c_str());
                 showText(imageRight.get_name(), "3");
                 Str256 meta_info;
-                meta_info.setf("W=%d,H=%d; %d bytes", imageRight.mat.size().width, imageRight.mat.size().height, imageRight.filesize);
+                meta_info.setf("W=%d,H=%d; %lld bytes; frame %lld/%lld", imageRight.mat.size().width, imageRight.mat.size().height, (long long)imageRight.filesize, (long long)imageRight.frame_index, (long long)imageRight.frame_count);
+                if (imageRight.reduction > 1)
+                    meta_info.appendf("; preview 1/%d", imageRight.reduction);
                 showText(meta_info.c_str(), "4");
             }
             ImGui::EndChild();
@@ -199,22 +225,126 @@ public:
                     sprintf(text, "Zoom: %d%%", zoom_percent);
                     ImGui::Text("%s", text);
                     ImGuiSliderFlags zoom_slider_flags = ImGuiSliderFlags_NoInput;
-                    ImGui::SliderInt("##Zoom", &zoom_percent, zoom_percent_min, zoom_percent_max, "", zoom_slider_flags);
+                    if (ImGui::SliderInt("##Zoom", &zoom_percent, zoom_percent_min, zoom_percent_max, "", zoom_slider_flags))
+                    {
+                        LoadFullResolutionIfZoomed();
+                    }
+                }
+                // compare mode
+                {
+                    ImGui::PushItemWidth(200);
+                    int mode = static_cast<int>(compare_mode);
+                    if (ImGui::Combo("Mode", &mode, "Tolerance\0SSIM\0deltaE 76\0deltaE 94\0CIEDE2000\0Neighborhood\0Aligned\0Structural\0Resampled\0Noise Model\0"))
+                    {
+                        compare_mode = static_cast<CompareMode>(mode);
+                        compare_condition_updated = true;
+                    }
+                    if (compare_mode == CompareMode::Neighborhood)
+                    {
+                        ImGui::Text("Radius: %d", neighborhood_radius);
+                        compare_condition_updated |= ImGui::SliderInt("##Radius", &neighborhood_radius, 1, 8, "", ImGuiSliderFlags_NoInput);
+                    }
+                    if (compare_mode == CompareMode::Structural)
+                    {
+                        compare_condition_updated |= ImGui::Checkbox("Columns", &structural_columns);
+                    }
+                    if (compare_mode == CompareMode::Resampled)
+                    {
+                        int filter = static_cast<int>(resample_filter);
+                        if (ImGui::Combo("Filter", &filter, "Area\0Bilinear\0Lanczos\0"))
+                        {
+                            resample_filter = static_cast<ResampleFilter>(filter);
+                            compare_condition_updated = true;
+                        }
+                    }
+                    if (compare_mode == CompareMode::NoiseModel)
+                    {
+                        NoiseModelUI();
+                    }
+                    if (compare_mode == CompareMode::Tolerance)
+                    {
+                        MaskUI();
+                    }
                 }
                 // tolerance
+                if (UseDeltaECompare())
                 {
+                    // re-thresholds the kept deltaE map, so dragging is cheap
                     ImGui::PushItemWidth(256);
-                    char text[20] = {0};
-                    sprintf(text, "Tolerance: %d", diff_thresh);
+                    ImGui::Text("Tolerance: %.1f deltaE", delta_e_thresh);
+                    compare_condition_updated |= ImGui::SliderFloat("##ToleranceDeltaE", &delta_e_thresh, 0.0f, 20.0f, "", ImGuiSliderFlags_NoInput);
+                }
+                else
+                {
+                    // high bit depth inputs are compared in native units
+                    const bool native_compare = UseNativeCompare();
+                    const int tolerance_max = native_compare ? (1 << imageLeft.bit_depth) - 1 : 255;
+                    if (diff_thresh > tolerance_max)
+                    {
+                        diff_thresh = tolerance_max;
+                        compare_condition_updated = true;
+                    }
+                    ImGui::PushItemWidth(256);
+                    char text[40] = {0};
+                    if (native_compare)
+                        sprintf(text, "Tolerance: %d (%d-bit)", diff_thresh, imageLeft.bit_depth);
+                    else
+                        sprintf(text, "Tolerance: %d", diff_thresh);
                     ImGui::Text("%s", text);
                     ImGuiSliderFlags tolerance_slider_flags = ImGuiSliderFlags_NoInput;
-                    compare_condition_updated |= ImGui::SliderInt("##Tolerance", &diff_thresh, 0, 255, "", tolerance_slider_flags);
+                    compare_condition_updated |= ImGui::SliderInt("##Tolerance", &diff_thresh, 0, tolerance_max, "", tolerance_slider_flags);
                 }
                 {
                     if (is_exactly_same)
                         ImGui::Text("Exactly Same: Yes");
                     else
                         ImGui::Text("Exactly Same: No");
+                    if (mosaic_compared && !is_exactly_same)
+                    {
+                        CfaStatsUI();
+                    }
+                    if (delta_e_compared)
+                    {
+                        ImGui::Text("deltaE: max %.2f, mean %.3f, %lld px above", delta_e_stats.max_delta_e, delta_e_stats.mean_delta_e, (long long)delta_e_stats.diff_pixels);
+                    }
+                    if (aligned_compared)
+                    {
+                        ImGui::Text("Offset: (%d, %d)", aligned_offset.x, aligned_offset.y);
+                    }
+                    if (structural_compared)
+                    {
+                        const char* unit = structure.columns ? "Columns" : "Rows";
+                        ImGui::Text("%s: %d removed, %d inserted, %d changed", unit, structure.removed, structure.inserted, structure.changed);
+                    }
+                    if (noise_outside_pixels >= 0)
+                    {
+                        ImGui::Text("Outside the noise floor: %lld px", (long long)noise_outside_pixels);
+                    }
+                    if (neighborhood_diff_pixels >= 0)
+                    {
+                        ImGui::Text("Unmatched within radius %d: %lld px", neighborhood_radius, (long long)neighborhood_diff_pixels);
+                    }
+                    if (ssim_compared)
+                    {
+                        ImGui::Text("SSIM: %.4f, MS-SSIM: %.4f", ssim_scores.ssim, ssim_scores.ms_ssim);
+                    }
+                    DiffStatsUI();
+                    DiffBlobsUI();
+                    MinimapUI();
+                }
+                // frame K of both raw sequences
+                if (imageLeft.frame_count > 1 || imageRight.frame_count > 1)
+                {
+                    const int frame_max = static_cast<int>(std::max(imageLeft.frame_count, imageRight.frame_count)) - 1;
+                    ImGui::Text("Frame: %d / %d", frame_index, frame_max);
+                    bool frame_changed = ImGui::SliderInt("##Frame", &frame_index, 0, frame_max, "", ImGuiSliderFlags_NoInput);
+                    frame_changed |= SequenceTimelineUI();
+                    if (frame_changed)
+                    {
+                        imageLeft.load_frame(std::min<int64_t>(frame_index, imageLeft.frame_count - 1));
+                        imageRight.load_frame(std::min<int64_t>(frame_index, imageRight.frame_count - 1));
+                        compare_condition_updated = true;
+                    }
                 }
                 {
                     ImGui::Checkbox("Inspect Pixels", &inspect_pixels);
@@ -233,6 +363,8 @@ public:
                             compare_condition_updated = true;
                         }
                     }
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Auto Reload", &auto_reload);
                 }
             }
             ImGui::EndChild();
@@ -244,6 +376,7 @@ public:
             ImGui::SameLine();
 
             ImGui::BeginChild("###RightImage", ImVec2(0, ImGui::GetWindowHeight() - 20), false);
+            diff_view_size = ImGui::GetWindowSize();
             if (show_diff_image)
             {
                 ShowImage("Diff Image", &show_diff_image, diff_image, 0.3f);
@@ -279,9 +412,38 @@ public:
                         ImVec2 displayedTextureSize(8, 8);
                         ImageInspect::inspect(width, height, diff_image.mat.data, mouseUVCoord, displayedTextureSize);
                     }
+
+                    // drag a rectangle on the diff image to ignore it
+                    if (draw_mask && ImGui::IsItemHovered())
+                    {
+                        // the mask is in full image pixels, and the diff image may be of previews
+                        const ImVec2 uv = (io.MousePos - rc.Min) / rc.GetSize();
+                        const cv::Point pixel(static_cast<int>(uv.x * imageLeft.mat.cols), static_cast<int>(uv.y * imageLeft.mat.rows));
+                        if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && LeftFullForMask())
+                        {
+                            mask_drag_start = pixel;
+                        }
+                        if (ImGui::IsMouseReleased(ImGuiMouseButton_Left) && mask_drag_start.x >= 0 && imageLeft.reduction <= 1 && !imageLeft.mat.empty())
+                        {
+                            if (ignore_mask.size() != imageLeft.mat.size())
+                            {
+                                ignore_mask = CompareMask(imageLeft.mat.size());
+                            }
+                            // inclusive of both corners, whichever way it was dragged
+                            const cv::Point tl(std::min(mask_drag_start.x, pixel.x), std::min(mask_drag_start.y, pixel.y));
+                            const cv::Point br(std::max(mask_drag_start.x, pixel.x) + 1, std::max(mask_drag_start.y, pixel.y) + 1);
+                            ignore_mask.ignore_rect(cv::Rect(tl, br));
+                            mask_drag_start = cv::Point(-1, -1);
+                            compare_condition_updated = true;
+                        }
+                    }
                 }
             }
             ImGui::EndChild();
+            if (scroll_frames > 0)
+            {
+                scroll_frames--;
+            }
         }
         ImGui::EndChild();
 
@@ -300,7 +462,23 @@ public:
 private:
     int UI_ChooseImageFile();
     void LoadImage(RichImage& image);
+    void WatchImage(const RichImage& image, int& watch_id);
+    void ReloadChangedImages();
     void ComputeDiffImage();
+    int PreviewReduction() const;
+    void LoadFullResolutionIfZoomed();
+    bool UseNativeCompare() const;
+    bool UseDeltaECompare() const;
+    void CfaStatsUI();
+    void DiffStatsUI();
+    void DiffBlobsUI();
+    void MinimapUI();
+    void FocusOn(const cv::Rect& region);
+    void CenterOn(const cv::Point2f& pixel);
+    void NoiseModelUI();
+    void MaskUI();
+    bool LeftFullForMask();
+    bool SequenceTimelineUI();
     void ShowImage(const char* windowName, bool* open, const RichImage& image, float align_to_right_ratio = 0.f);
 
     void StatusbarUI();
@@ -316,11 +494,89 @@ private:
     bool compare_condition_updated = false;
     bool show_diff_image = false;
     int diff_thresh = 1;
+    CompareMode compare_mode = CompareMode::Tolerance;
+    float delta_e_thresh = 2.3f; // about one just noticeable difference
+    int neighborhood_radius = 1;
+    int64_t neighborhood_diff_pixels = -1; // of the last neighborhood compare, -1 otherwise
+    bool aligned_compared = false;
+    cv::Point aligned_offset;
+    bool structural_columns = false;
+    bool structural_compared = false;
+    StructuralDiff structure;
+    ResampleFilter resample_filter = ResampleFilter::Area;
+    NoiseModel noise_model; // of the reference captures; the right image is the candidate
+    float noise_sigmas = 3.0f;
+    bool noise_envelope = false;
+    int64_t noise_outside_pixels = -1; // of the last noise model compare, -1 otherwise
+    CompareMask ignore_mask; // in full left image pixels, empty if none
+    bool draw_mask = false;
+    cv::Point mask_drag_start = cv::Point(-1, -1);
     int zoom_percent = 46;
     int zoom_percent_min = 10;
     int zoom_percent_max = 1000;
+    ImVec2 diff_view_size;
+    cv::Point2f scroll_target; // in full image pixels, centered in the image views while scroll_frames > 0
+    int scroll_frames = 0;
     bool inspect_pixels = false;
     bool is_exactly_same = false;
+    bool mosaic_compared = false;
+    CfaDiffStats cfa_stats;
+    DiffStats diff_stats; // of 8-bit compares, channels is 0 otherwise
+    bool ssim_compared = false;
+    bool delta_e_compared = false;
+    DeltaEStats delta_e_stats;
+    SsimScores ssim_scores;
+    std::vector<float> delta_plot;
+    std::vector<DiffBlob> diff_blobs; // of the last tolerance compare
+    int selected_blob = -1;
+    DiffPyramid diff_pyramid; // of the last tolerance compare
+    cv::Point difference_cell = cv::Point(-1, -1); // level 0 cell of the last "Next Difference"
+    bool minimap_counts = false; // shade by differing pixel count rather than max delta
+    int frame_index = 0;
+
+    // auto reload when input files change on disk
+    bool auto_reload = false;
+    FileWatcher file_watcher;
+    int left_watch_id = -1;
+    int right_watch_id = -1;
+
+    // diff image is computed in background, and only re-diffs the changed tiles
+    class DiffResult
+    {
+    public:
+        cv::Mat mat;
+        bool is_exactly_same = false;
+        bool mosaic = false; // compared per CFA site
+        CfaDiffStats cfa_stats;
+        DiffStats stats;
+        bool ssim = false; // mat is the SSIM heatmap
+        SsimScores ssim_scores;
+        bool delta_e = false;
+        DeltaEStats delta_e_stats;
+        int64_t neighborhood_diff_pixels = -1;
+        bool aligned = false;
+        cv::Point offset; // of right relative to left
+        bool structural = false;
+        StructuralDiff structure;
+        int64_t noise_outside_pixels = -1;
+        std::vector<DiffBlob> blobs;
+        DiffPyramid pyramid;
+    };
+    IncrementalComparer comparer;
+    DeltaEComparer delta_e_comparer;
+    ResampledComparer resampled_comparer; // keeps the resized right image buffer
+    std::future<DiffResult> diff_future;
+    // full images of previews, decoded off the UI thread before they are compared
+    std::future<DecodedImage> full_left_future;
+    std::future<DecodedImage> full_right_future;
+    bool full_load_pending = false;
+    std::string status_message; // e.g. why the images were not compared
+
+    // frame by frame compare of two raw sequences
+    SequenceComparer sequence_comparer;
+    std::vector<FrameMetrics> timeline;
+    std::vector<float> timeline_plot;
+    bool timeline_stale = false;
 
     const float statusbarSize = 50;
 
@@ -411,7 +667,7 @@ void MyApp::StatusbarUI()
     ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.3f, 0.3f, 0.3f, 1.0f));
     ImGui::Begin("STATUSBAR", NULL, window_flags);
     ImGui::PopStyleVar();
-    ImGui::Text("Status bar message.");
+    ImGui::TextUnformatted(status_message.c_str());
     ImGui::End();
     ImGui::PopStyleColor();
 }
@@ -453,7 +709,8 @@ void MyApp::ShowImage(const char* windowName, bool* open, const RichImage& image
         //ImGui::EndChild();
         //ImGui::End();
         //
-        ImVec2 actual_image_size(image.mat.size().width, image.mat.size().height);
+        // a preview is drawn at the size of the full image
+        ImVec2 actual_image_size(image.mat.size().width * image.reduction, image.mat.size().height * image.reduction);
         ImVec2 rendered_texture_size = actual_image_size * (zoom_percent * 1.0 / 100);
 
         bool clamped_x_by_window = false;
@@ -502,6 +759,12 @@ void MyApp::ShowImage(const char* windowName, bool* open, const RichImage& image
         label.setf("image##%d", texture);
         ImGui::BeginChild(label.c_str(), image_window_size, clamped_by_window, ImGuiWindowFlags_HorizontalScrollbar);
         {
+            if (scroll_frames > 0)
+            {
+                // the scroll range only follows a zoom change on the next frame, so this is repeated for a few
+                ImGui::SetScrollX(scroll_target.x * zoom_percent / 100.0f - image_window_size.x / 2);
+                ImGui::SetScrollY(scroll_target.y * zoom_percent / 100.0f - image_window_size.y / 2);
+            }
             ImGui::Image((void*)(uintptr_t)texture, rendered_texture_size);
         }
         ImGui::EndChild();
@@ -510,26 +773,590 @@ void MyApp::ShowImage(const char* windowName, bool* open, const RichImage& image
 
 void MyApp::ComputeDiffImage()
 {
-    if ((!imageLeft.mat.empty() && !imageRight.mat.empty() && compare_condition_updated))
+    // pick up the finished job first, so a new request below starts from its cached tiles
+    if (diff_future.valid() && diff_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
     {
-        cv::Mat diff_mat;
-        if (!imageLeft.mat.empty() && !imageRight.mat.empty())
+        DiffResult result = diff_future.get();
+        is_exactly_same = result.is_exactly_same;
+        mosaic_compared = result.mosaic;
+        cfa_stats = result.cfa_stats;
+        diff_stats = result.stats;
+        ssim_compared = result.ssim;
+        ssim_scores = result.ssim_scores;
+        delta_e_compared = result.delta_e;
+        delta_e_stats = result.delta_e_stats;
+        neighborhood_diff_pixels = result.neighborhood_diff_pixels;
+        aligned_compared = result.aligned;
+        aligned_offset = result.offset;
+        structural_compared = result.structural;
+        structure = result.structure;
+        noise_outside_pixels = result.noise_outside_pixels;
+        diff_blobs.swap(result.blobs);
+        selected_blob = -1;
+        diff_pyramid = std::move(result.pyramid);
+        difference_cell = cv::Point(-1, -1);
+        if (diff_image.mat.empty())
         {
-            diff_mat = compare_two_mat(imageLeft.mat, imageRight.mat, diff_thresh, is_exactly_same);
+            diff_image.clear(); // free texture memory
         }
-        else
+        diff_image.load_mat(result.mat);
+        show_diff_image = true;
+    }
+
+    // previews are only for display; decode the full images in the background, and compare once both are shown
+    const auto is_ready = [](std::future<DecodedImage>& future) {
+        return !future.valid() || future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    if (full_load_pending && is_ready(full_left_future) && is_ready(full_right_future))
+    {
+        // an image replaced meanwhile is a preview again, so it is decoded again below; a preview is never compared
+        for (auto side : {std::make_pair(&full_left_future, &imageLeft), std::make_pair(&full_right_future, &imageRight)})
         {
-            diff_mat.create(255, 255, CV_8UC3);
-            diff_mat = cv::Scalar(128, 128, 128);
+            if (!side.first->valid())
+                continue;
+            DecodedImage decoded = side.first->get();
+            if (decoded.path != side.second->name || decoded.frame_index != side.second->frame_index || side.second->reduction <= 1)
+                continue;
+            if (decoded.mat.empty())
+            {
+                // until the inputs change again, rather than decoding it again every frame
+                status_message = "Failed to decode " + decoded.path + ", not compared";
+                compare_condition_updated = false;
+                continue;
+            }
+            side.second->load_decoded(decoded);
         }
+        full_load_pending = false;
+    }
+    else if ((!imageLeft.mat.empty() && !imageRight.mat.empty() && compare_condition_updated) && !diff_future.valid() && !full_load_pending
+             && (imageLeft.reduction > 1 || imageRight.reduction > 1))
+    {
+        for (auto side : {std::make_pair(&full_left_future, &imageLeft), std::make_pair(&full_right_future, &imageRight)})
+        {
+            if (side.second->reduction > 1)
+            {
+                const std::string path = side.second->name;
+                const int64_t frame_index = side.second->frame_index;
+                *side.first = std::async(std::launch::async, [path, frame_index]() { return decode_image_file(path, frame_index); });
+            }
+        }
+        full_load_pending = true;
+    }
 
-        if (diff_image.mat.empty())
+    if ((!imageLeft.mat.empty() && !imageRight.mat.empty() && compare_condition_updated) && !diff_future.valid() && !full_load_pending
+        && imageLeft.reduction <= 1 && imageRight.reduction <= 1)
+    {
+        status_message.clear();
+        // cv::Mat headers are refcounted, so reloading an input meanwhile won't free what the job reads
+        cv::Mat left = imageLeft.mat;
+        cv::Mat right = imageRight.mat;
+        cv::Mat left_native = UseNativeCompare() ? imageLeft.native : cv::Mat();
+        cv::Mat right_native = UseNativeCompare() ? imageRight.native : cv::Mat();
+        const int thresh = diff_thresh;
+        const bool mosaic = !left_native.empty() && !imageLeft.cfa_pattern.empty();
+        // JPEG pairs are first compared by DCT coefficients, which skips the pixel diff if they only differ in metadata
+        const bool jpeg = left.size() == right.size() && is_jpeg_file(imageLeft.name) && is_jpeg_file(imageRight.name);
+        const std::string left_path = imageLeft.name;
+        const std::string right_path = imageRight.name;
+        const bool ssim = (compare_mode == CompareMode::Ssim) && left.size() == right.size() && left.type() == right.type();
+        const bool delta_e = UseDeltaECompare() && left.size() == right.size() && left.type() == right.type();
+        const DeltaEFormula formula = (compare_mode == CompareMode::DeltaE94) ? DeltaEFormula::Cie94
+                                      : (compare_mode == CompareMode::DeltaE2000) ? DeltaEFormula::Ciede2000
+                                                                                  : DeltaEFormula::Cie76;
+        const float delta_e_tolerance = delta_e_thresh;
+        const int radius = (compare_mode == CompareMode::Neighborhood && left.size() == right.size() && left.type() == right.type()) ? neighborhood_radius : 0;
+        const bool aligned = (compare_mode == CompareMode::Aligned);
+        const bool structural = (compare_mode == CompareMode::Structural);
+        const bool columns = structural_columns;
+        const bool resampled = (compare_mode == CompareMode::Resampled);
+        const ResampleFilter filter = resample_filter;
+        // the bounds are cheap to derive, and the job then doesn't share the model with reference loading
+        const CompareMask mask = ignore_mask;
+        // native compares have their tolerance in native units, so blobs and the pyramid of 8-bit pixels wouldn't match
+        const bool locate = (compare_mode == CompareMode::Tolerance) && left_native.empty() && left.size() == right.size() && left.type() == right.type();
+        cv::Mat noise_low;
+        cv::Mat noise_high;
+        if (compare_mode == CompareMode::NoiseModel && noise_model.size() == right.size())
         {
-            diff_image.clear(); // free texture memory
+            noise_model.bounds(noise_envelope ? NoiseBound::Envelope : NoiseBound::Sigma, noise_sigmas, thresh, noise_low, noise_high);
         }
-        diff_image.load_mat(diff_mat);
+        diff_future = std::async(std::launch::async, [this, left, right, left_native, right_native, thresh, mosaic, jpeg, ssim, delta_e, formula, delta_e_tolerance, radius, aligned, structural, columns, resampled, filter, noise_low, noise_high, mask, locate, left_path, right_path]() {
+            DiffResult result;
+            cv::Mat block_map;
+            // every fast path below honors the mask, so none of them may drop it
+            const CompareMask* ignored = (!mask.empty() && mask.size() == left.size()) ? &mask : NULL;
+            if (!delta_e)
+            {
+                delta_e_comparer.reset();
+            }
+            if (!resampled)
+            {
+                resampled_comparer.reset();
+            }
+            if (delta_e)
+            {
+                comparer.reset();
+                result.mat = delta_e_comparer.compare(left, right, formula, delta_e_tolerance, result.is_exactly_same, result.delta_e_stats);
+                result.delta_e = true;
+            }
+            else if (aligned)
+            {
+                // the overlap changes with the offset, so there are no tiles to reuse
+                comparer.reset();
+                result.mat = compare_aligned(left, right, thresh, result.is_exactly_same, result.offset, result.stats);
+                result.aligned = true;
+            }
+            else if (structural)
+            {
+                // rows move with the alignment, so there are no tiles to reuse
+                comparer.reset();
+                result.mat = compare_structural(left, right, thresh, columns, result.is_exactly_same, result.structure, result.stats);
+                result.structural = true;
+            }
+            else if (!noise_low.empty())
+            {
+                comparer.reset();
+                result.mat = compare_to_noise_model(right, noise_low, noise_high, result.is_exactly_same, result.noise_outside_pixels);
+            }
+            else if (resampled)
+            {
+                comparer.reset();
+                result.mat = resampled_comparer.compare(left, right, filter, thresh, result.is_exactly_same, result.stats);
+            }
+            else if (radius > 0)
+            {
+                comparer.reset();
+                result.mat = compare_neighborhood(left, right, radius, thresh, result.is_exactly_same, result.neighborhood_diff_pixels);
+            }
+            else if (ssim)
+            {
+                // the heatmap replaces the tolerance rendering; the statistics still use the tolerance
+                comparer.reset();
+                result.mat = compare_ssim(left, right, result.ssim_scores);
+                result.ssim = true;
+                compute_diff_stats(left, right, thresh, result.stats);
+                result.is_exactly_same = (result.stats.max_delta == 0);
+            }
+            else if (jpeg && compare_jpeg_coefficients(left_path, right_path, block_map) != JpegCompare::Undecided)
+            {
+                comparer.reset();
+                result.mat = compare_marked_blocks(left, right, block_map, 8, thresh, result.is_exactly_same, result.stats, ignored);
+            }
+            else if (mosaic)
+            {
+                comparer.reset();
+                result.mat = compare_mosaic(left_native, right_native, left, thresh, result.is_exactly_same, result.cfa_stats, ignored);
+                result.mosaic = true;
+            }
+            else if (!left_native.empty())
+            {
+                comparer.reset();
+                result.mat = compare_native_mat(left_native, right_native, left, thresh, result.is_exactly_same, ignored);
+            }
+            else if (ignored && left.size() == right.size())
+            {
+                // masked tiles change with the mask, so there are no tiles to reuse
+                comparer.reset();
+                result.mat = compare_masked(left, right, mask, thresh, result.is_exactly_same, result.stats);
+            }
+            else
+            {
+                result.mat = comparer.compare(left, right, thresh, result.is_exactly_same, result.stats);
+            }
+            if (locate && !result.is_exactly_same)
+            {
+                // blobs and the pyramid share one pass over the deltas
+                result.blobs = find_diff_blobs(left, right, thresh, ignored, &result.pyramid);
+            }
+            if (result.mat.empty())
+            {
+                result.mat.create(255, 255, CV_8UC3);
+                result.mat = cv::Scalar(128, 128, 128);
+            }
+            return result;
+        });
         compare_condition_updated = false;
-        show_diff_image = true;
+    }
+}
+
+// inputs are first loaded as previews as small as the zoom allows, full decode is deferred
+int MyApp::PreviewReduction() const
+{
+    int reduction = 1;
+    while (reduction < 8 && zoom_percent * reduction * 2 <= 100)
+    {
+        reduction *= 2;
+    }
+    return reduction;
+}
+
+// a preview is replaced by the full image once it would be drawn magnified
+void MyApp::LoadFullResolutionIfZoomed()
+{
+    if (zoom_percent * imageLeft.reduction > 100)
+    {
+        imageLeft.load_full();
+    }
+    if (zoom_percent * imageRight.reduction > 100)
+    {
+        imageRight.load_full();
+    }
+}
+
+bool MyApp::UseDeltaECompare() const
+{
+    return compare_mode == CompareMode::DeltaE76 || compare_mode == CompareMode::DeltaE94 || compare_mode == CompareMode::DeltaE2000;
+}
+
+// both sides hold high bit depth samples of the same layout
+bool MyApp::UseNativeCompare() const
+{
+    return !imageLeft.native.empty() && !imageRight.native.empty()
+           && imageLeft.bit_depth == imageRight.bit_depth
+           && imageLeft.cfa_pattern == imageRight.cfa_pattern
+           && imageLeft.native.size() == imageRight.native.size()
+           && imageLeft.native.type() == imageRight.native.type();
+}
+
+// differing pixels per CFA site of the last mosaic compare, e.g. R, Gr, Gb, B for rggb
+void MyApp::CfaStatsUI()
+{
+    const std::string& cfa = imageLeft.cfa_pattern;
+    if (cfa.size() != 4)
+    {
+        return;
+    }
+    for (int k = 0; k < 4; k++)
+    {
+        char name[3] = { (char)toupper(cfa[k]), 0, 0 };
+        if (name[0] == 'G')
+        {
+            // the other site of the same row tells the two greens apart
+            name[1] = (char)tolower(cfa[(k / 2) * 2 + 1 - k % 2]);
+        }
+        ImGui::Text("%-2s: %lld px, max %d", name, (long long)cfa_stats.diff_pixels[k], cfa_stats.max_delta[k]);
+    }
+}
+
+// statistics of the last 8-bit compare, and the histogram of the non zero per pixel deltas
+void MyApp::DiffStatsUI()
+{
+    const DiffStats& st = diff_stats;
+    if (st.channels == 0 || st.pixels == 0)
+    {
+        return;
+    }
+    ImGui::Text("Diff Pixels: %lld (%.3f%%), Max Delta: %d", (long long)st.diff_pixels, 100.0 * st.diff_pixels / st.pixels, st.max_delta);
+    if (st.max_delta == 0)
+    {
+        return;
+    }
+    ImGui::Text("PSNR: %.2f dB, MSE: %.3f, MAE: %.3f", st.psnr(), st.mse(), st.mae());
+    const char* channel_names[4] = {"B", "G", "R", "A"};
+    for (int k = 0; k < st.channels; k++)
+    {
+        if (std::isinf(st.psnr(k)))
+            ImGui::Text("%s: max %d, MAE %.3f, PSNR inf", channel_names[k], st.channel_max[k], st.mae(k));
+        else
+            ImGui::Text("%s: max %d, MAE %.3f, PSNR %.2f dB", channel_names[k], st.channel_max[k], st.mae(k), st.psnr(k));
+    }
+    // bin 0 usually dwarfs the others, so plot from delta 1 on a log scale
+    delta_plot.resize(st.max_delta);
+    for (int d = 1; d <= st.max_delta; d++)
+    {
+        delta_plot[d - 1] = std::log10(1.0f + static_cast<float>(st.histogram[d]));
+    }
+    ImGui::PlotHistogram("##Deltas", delta_plot.data(), static_cast<int>(delta_plot.size()), 0, "pixels by max delta (log)", 0.0f, FLT_MAX, ImVec2(256, 60));
+}
+
+// regions above the tolerance, most severe first; picking one brings it into view
+void MyApp::DiffBlobsUI()
+{
+    if (diff_blobs.empty())
+    {
+        return;
+    }
+    ImGui::Text("Blobs: %d", static_cast<int>(diff_blobs.size()));
+    if (ImGui::BeginListBox("##Blobs", ImVec2(256, 6 * ImGui::GetTextLineHeightWithSpacing())))
+    {
+        // noisy diffs have many blobs, so only the visible rows are submitted
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(diff_blobs.size()));
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                const DiffBlob& blob = diff_blobs[i];
+                Str256 label;
+                label.setf("%dx%d at (%d, %d), %lld px, max %d##blob%d", blob.bounds.width, blob.bounds.height, blob.bounds.x, blob.bounds.y, (long long)blob.pixels, blob.max_delta, i);
+                if (ImGui::Selectable(label.c_str(), selected_blob == i))
+                {
+                    selected_blob = i;
+                    FocusOn(blob.bounds);
+                }
+            }
+        }
+        ImGui::EndListBox();
+    }
+}
+
+// zoom so `region` takes about a third of the diff view, and center the image views on it
+void MyApp::FocusOn(const cv::Rect& region)
+{
+    const ImVec2 view = (diff_view_size.x > 0 && diff_view_size.y > 0) ? diff_view_size : ImVec2(512, 512);
+    const float fit = std::min(view.x / region.width, view.y / region.height) / 3;
+    zoom_percent = std::max(zoom_percent_min, std::min(zoom_percent_max, static_cast<int>(fit * 100)));
+    LoadFullResolutionIfZoomed();
+    CenterOn(cv::Point2f(region.x + region.width / 2.0f, region.y + region.height / 2.0f));
+}
+
+void MyApp::CenterOn(const cv::Point2f& pixel)
+{
+    scroll_target = pixel;
+    scroll_frames = 3;
+}
+
+// overview of the difference pyramid, one square per cell of the finest level that fits; clicking centers the views
+void MyApp::MinimapUI()
+{
+    if (diff_pyramid.empty())
+    {
+        return;
+    }
+    if (ImGui::Button("Next Difference"))
+    {
+        // the search is top-down through non zero cells only, and wraps around after the last one
+        cv::Point cell;
+        if (diff_pyramid.next_difference(difference_cell, cell) || diff_pyramid.next_difference(cv::Point(-1, -1), cell))
+        {
+            difference_cell = cell;
+            FocusOn(diff_pyramid.cell_rect(0, cell));
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Shade by Count", &minimap_counts);
+
+    const int minimap_cells = 64;
+    const float minimap_side = 192.0f;
+    int level = 0;
+    while (level + 1 < diff_pyramid.levels() && std::max(diff_pyramid.level_size(level).width, diff_pyramid.level_size(level).height) > minimap_cells)
+    {
+        level++;
+    }
+    const cv::Size cells = diff_pyramid.level_size(level);
+    const float side = minimap_side / std::max(cells.width, cells.height);
+
+    // counts span orders of magnitude, so they are shaded on a log scale
+    const int top = diff_pyramid.levels() - 1;
+    const double peak = minimap_counts ? std::log1p(static_cast<double>(diff_pyramid.diff_pixels(top, cv::Point(0, 0)))) : diff_pyramid.max_delta(top, cv::Point(0, 0));
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("##Minimap", ImVec2(cells.width * side, cells.height * side));
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    for (int y = 0; y < cells.height; y++)
+    {
+        for (int x = 0; x < cells.width; x++)
+        {
+            const cv::Point cell(x, y);
+            const double value = minimap_counts ? std::log1p(static_cast<double>(diff_pyramid.diff_pixels(level, cell))) : diff_pyramid.max_delta(level, cell);
+            const int shade = (peak > 0) ? static_cast<int>(255 * value / peak) : 0;
+            const ImU32 color = (diff_pyramid.diff_pixels(level, cell) > 0) ? IM_COL32(std::max(shade, 64), 0, 0, 255) : IM_COL32(40, 40, 40, 255);
+            const ImVec2 p_min(origin.x + x * side, origin.y + y * side);
+            draw_list->AddRectFilled(p_min, ImVec2(p_min.x + side, p_min.y + side), color);
+        }
+    }
+    if (ImGui::IsItemClicked(ImGuiMouseButton_Left))
+    {
+        const ImVec2 mouse = ImGui::GetIO().MousePos;
+        const cv::Point cell(ImClamp(static_cast<int>((mouse.x - origin.x) / side), 0, cells.width - 1), ImClamp(static_cast<int>((mouse.y - origin.y) / side), 0, cells.height - 1));
+        const cv::Rect rect = diff_pyramid.cell_rect(level, cell);
+        CenterOn(cv::Point2f(rect.x + rect.width / 2.0f, rect.y + rect.height / 2.0f));
+    }
+}
+
+// references are folded into the model one by one, so only one of them is in memory at a time
+void MyApp::NoiseModelUI()
+{
+    if (ImGui::Button("Add References"))
+    {
+        auto f = pfd::open_file("Choose reference captures", pfd::path::home(), {filter_msg1, filter_msg2, "All Files", "*"}, pfd::opt::multiselect);
+        for (const std::string& path : f.result())
+        {
+            noise_model.add(load_image(path));
+        }
+        compare_condition_updated = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+    {
+        noise_model.reset();
+        compare_condition_updated = true;
+    }
+    ImGui::Text("References: %d", noise_model.frame_count());
+    compare_condition_updated |= ImGui::Checkbox("Min/Max Envelope", &noise_envelope);
+    if (!noise_envelope)
+    {
+        ImGui::Text("Sigmas: %.1f", noise_sigmas);
+        compare_condition_updated |= ImGui::SliderFloat("##Sigmas", &noise_sigmas, 0.0f, 10.0f, "", ImGuiSliderFlags_NoInput);
+    }
+}
+
+// ignore masks are in the pixels of the full left image, which is decoded in the background; rather than decoding it
+// on the UI thread, mask edits wait for that
+bool MyApp::LeftFullForMask()
+{
+    if (imageLeft.mat.empty())
+    {
+        return false;
+    }
+    if (imageLeft.reduction <= 1)
+    {
+        return true;
+    }
+    if (imageRight.mat.empty())
+    {
+        // the full loads only start with a compare
+        status_message = "Load both images to edit the mask";
+        return false;
+    }
+    if (!full_load_pending)
+    {
+        compare_condition_updated = true;
+    }
+    status_message = "Loading the full image, edit the mask once it is shown";
+    return false;
+}
+
+void MyApp::MaskUI()
+{
+    if (ImGui::Button("Load Mask") && LeftFullForMask())
+    {
+        auto f = pfd::open_file("Choose ignore mask (.pbm, .txt rectangle list, or image)", pfd::path::home(), {"All Files", "*"});
+        if (!f.result().empty())
+        {
+            // the current mask stays in place if the file can't be loaded
+            if (load_compare_mask(f.result()[0], imageLeft.mat.size(), ignore_mask))
+            {
+                compare_condition_updated = true;
+            }
+            else
+            {
+                status_message = "Failed to load mask " + f.result()[0];
+            }
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save Mask") && !ignore_mask.empty())
+    {
+        auto f = pfd::save_file("Save ignore mask", pfd::path::home() + "/mask.pbm", {"PBM", "*.pbm"});
+        if (!f.result().empty())
+        {
+            save_compare_mask(f.result(), ignore_mask);
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear Mask"))
+    {
+        ignore_mask = CompareMask();
+        compare_condition_updated = true;
+    }
+    ImGui::Checkbox("Draw Ignore Rects", &draw_mask);
+    if (!ignore_mask.empty())
+    {
+        ImGui::Text("Ignored: %lld px", (long long)ignore_mask.ignored_pixels());
+    }
+}
+
+// @return true if a frame was picked on the timeline
+bool MyApp::SequenceTimelineUI()
+{
+    bool frame_picked = false;
+    if (imageLeft.frame_count <= 1 || imageRight.frame_count <= 1)
+    {
+        return frame_picked;
+    }
+
+    if (ImGui::Button("Compare Sequence"))
+    {
+        if (sequence_comparer.open(imageLeft.name, imageRight.name))
+        {
+            // sequence frames are compared as 8-bit BGRA, so bring a native tolerance to that scale
+            const int shift = UseNativeCompare() ? imageLeft.bit_depth - 8 : 0;
+            sequence_comparer.start(diff_thresh >> shift);
+            timeline_stale = true;
+        }
+    }
+
+    // only copy the timeline while it grows, plus once after it finished
+    const bool running = sequence_comparer.is_running();
+    if (running || timeline_stale)
+    {
+        timeline_stale = running;
+        timeline = sequence_comparer.timeline();
+        timeline_plot.resize(timeline.size());
+        for (int i = 0; i < timeline.size(); i++)
+        {
+            timeline_plot[i] = static_cast<float>(timeline[i].diff_pixels);
+        }
+    }
+    if (timeline.empty())
+    {
+        return frame_picked;
+    }
+
+    if (running)
+    {
+        ImGui::SameLine();
+        ImGui::Text("%d / %lld", static_cast<int>(timeline.size()), (long long)sequence_comparer.frame_count());
+    }
+
+    ImGui::PlotHistogram("##Timeline", timeline_plot.data(), static_cast<int>(timeline_plot.size()), 0, "differing pixels", 0.0f, FLT_MAX, ImVec2(256, 60));
+    if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+    {
+        // scrub: pick the frame under the mouse
+        ImRect rc = ImRect(ImGui::GetItemRectMin(), ImGui::GetItemRectMax());
+        float t = (ImGui::GetIO().MousePos.x - rc.Min.x) / rc.GetWidth();
+        frame_index = ImClamp(static_cast<int>(t * timeline.size()), 0, static_cast<int>(timeline.size()) - 1);
+        frame_picked = true;
+    }
+
+    if (frame_index >= 0 && frame_index < static_cast<int64_t>(timeline.size()))
+    {
+        const FrameMetrics& m = timeline[frame_index];
+        ImGui::Text("Diff Pixels: %lld, Max Delta: %d", (long long)m.diff_pixels, m.max_delta);
+        if (std::isinf(m.psnr))
+            ImGui::Text("PSNR: inf");
+        else
+            ImGui::Text("PSNR: %.2f dB", m.psnr);
+    }
+    return frame_picked;
+}
+
+void MyApp::WatchImage(const RichImage& image, int& watch_id)
+{
+    file_watcher.remove(watch_id);
+    watch_id = -1;
+    if (!image.name.empty())
+    {
+        watch_id = file_watcher.add(image.name);
+    }
+}
+
+void MyApp::ReloadChangedImages()
+{
+    std::vector<int> changed = file_watcher.poll();
+    for (int id : changed)
+    {
+        // only reload the side whose file changed
+        if (id == left_watch_id && !imageLeft.mat.empty())
+        {
+            imageLeft.reload();
+            compare_condition_updated = true;
+        }
+        if (id == right_watch_id && !imageRight.mat.empty())
+        {
+            imageRight.reload();
+            compare_condition_updated = true;
+        }
     }
 }
 
@@ -566,7 +1393,7 @@ void MyApp::LoadImage(RichImage& image)
     UI_ChooseImageFile();
     if (filepath.c_str())
     {
-        image.load_from_file(filepath);
+        image.load_from_file(filepath, 0, PreviewReduction());
     }
     filepath = NULL;
 }
@@ -0,0 +1,355 @@
+#include "compare_mask.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <bitset>
+#include <utility>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const uint64_t all_bits = ~0ULL;
+
+// PBM stores the leftmost pixel in the most significant bit
+uchar reverse_bits(uchar b)
+{
+    b = static_cast<uchar>((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+    b = static_cast<uchar>((b & 0xCC) >> 2 | (b & 0x33) << 2);
+    b = static_cast<uchar>((b & 0xAA) >> 1 | (b & 0x55) << 1);
+    return b;
+}
+
+// next whitespace separated number of a PNM header, skipping comments
+bool read_header_int(FILE* fp, int& value)
+{
+    int c = fgetc(fp);
+    while (c != EOF && (isspace(c) || c == '#'))
+    {
+        if (c == '#')
+        {
+            while (c != EOF && c != '\n')
+                c = fgetc(fp);
+        }
+        c = fgetc(fp);
+    }
+    value = 0;
+    if (c == EOF || !isdigit(c))
+    {
+        return false;
+    }
+    while (c != EOF && isdigit(c))
+    {
+        value = value * 10 + (c - '0');
+        c = fgetc(fp);
+    }
+    // the single whitespace after the height is consumed here too
+    return true;
+}
+
+bool load_pbm(const std::string& path, const cv::Size& size, imcmp::CompareMask& mask)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "failed to open %s\n", path.c_str());
+        return false;
+    }
+    char magic[2] = {0, 0};
+    int width = 0;
+    int height = 0;
+    if (fread(magic, 1, 2, fp) != 2 || magic[0] != 'P' || magic[1] != '4' || !read_header_int(fp, width) || !read_header_int(fp, height) || cv::Size(width, height) != size)
+    {
+        fprintf(stderr, "%s is not a binary PBM of %dx%d\n", path.c_str(), size.width, size.height);
+        fclose(fp);
+        return false;
+    }
+
+    mask = imcmp::CompareMask(size);
+    const int row_bytes = (width + 7) / 8;
+    const int tail = width & 63;
+    std::vector<uchar> row(row_bytes);
+    bool ok = true;
+    for (int y = 0; y < height && ok; y++)
+    {
+        ok = (fread(row.data(), 1, row_bytes, fp) == static_cast<size_t>(row_bytes));
+        uint64_t* words = mask.row_bits(y);
+        for (int k = 0; k < row_bytes && ok; k++)
+        {
+            words[k >> 3] |= static_cast<uint64_t>(reverse_bits(row[k])) << ((k & 7) * 8);
+        }
+        if (tail)
+        {
+            words[(width - 1) >> 6] &= (1ULL << tail) - 1;
+        }
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        fprintf(stderr, "%s is truncated\n", path.c_str());
+    }
+    return ok;
+}
+
+bool load_rect_list(const std::string& path, const cv::Size& size, imcmp::CompareMask& mask)
+{
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp)
+    {
+        fprintf(stderr, "failed to open %s\n", path.c_str());
+        return false;
+    }
+    mask = imcmp::CompareMask(size);
+    std::vector<cv::Rect> rois;
+    char line[256];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), fp))
+    {
+        line_number++;
+        char* text = line;
+        while (isspace(static_cast<uchar>(*text)))
+            text++;
+        if (*text == '\0' || *text == '#')
+            continue;
+        const bool roi = (strncmp(text, "roi", 3) == 0);
+        cv::Rect rect;
+        if (sscanf(roi ? text + 3 : text, "%d %d %d %d", &rect.x, &rect.y, &rect.width, &rect.height) != 4)
+        {
+            fprintf(stderr, "%s:%d: expected \"[roi] x y width height\"\n", path.c_str(), line_number);
+            ok = false;
+        }
+        else if (roi)
+        {
+            rois.push_back(rect);
+        }
+        else
+        {
+            mask.ignore_rect(rect);
+        }
+    }
+    fclose(fp);
+    if (ok && !rois.empty())
+    {
+        mask.keep_only(rois);
+    }
+    return ok;
+}
+
+bool has_suffix(const std::string& path, const char* suffix)
+{
+    const size_t n = strlen(suffix);
+    if (path.size() < n)
+        return false;
+    std::string tail = path.substr(path.size() - n);
+    std::transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+    return tail == suffix;
+}
+
+} // namespace
+
+imcmp::CompareMask::CompareMask(const cv::Size& size)
+    : width(size.width), height(size.height), words_per_row((size.width + 63) / 64)
+{
+    bits.assign(static_cast<size_t>(words_per_row) * height, 0);
+}
+
+cv::Size imcmp::CompareMask::size() const
+{
+    return cv::Size(width, height);
+}
+
+bool imcmp::CompareMask::empty() const
+{
+    return bits.empty();
+}
+
+void imcmp::CompareMask::ignore_rect(const cv::Rect& rect)
+{
+    const cv::Rect r = rect & cv::Rect(0, 0, width, height);
+    for (int y = r.y; y < r.y + r.height; y++)
+    {
+        uint64_t* row = &bits[static_cast<size_t>(y) * words_per_row];
+        for (int x = r.x; x < r.x + r.width;)
+        {
+            // the bits of [x, end) within the word of x
+            const int end = std::min(r.x + r.width, (x & ~63) + 64);
+            const int count = end - x;
+            const uint64_t span = (count == 64) ? all_bits : ((1ULL << count) - 1) << (x & 63);
+            row[x >> 6] |= span;
+            x = end;
+        }
+    }
+}
+
+void imcmp::CompareMask::keep_only(const std::vector<cv::Rect>& rois)
+{
+    CompareMask keep(size());
+    for (const cv::Rect& roi : rois)
+    {
+        keep.ignore_rect(roi);
+    }
+    // rows are padded with bits which must stay clear
+    const int tail = width & 63;
+    const uint64_t last_word = tail ? (1ULL << tail) - 1 : all_bits;
+    for (size_t i = 0; i < bits.size(); i++)
+    {
+        const bool last = (i % words_per_row == static_cast<size_t>(words_per_row - 1));
+        bits[i] |= ~keep.bits[i] & (last ? last_word : all_bits);
+    }
+}
+
+void imcmp::CompareMask::ignore_where(const cv::Mat& mask)
+{
+    CV_Assert(mask.type() == CV_8UC1 && mask.size() == size());
+    for (int y = 0; y < height; y++)
+    {
+        const uchar* m = mask.ptr<uchar>(y);
+        uint64_t* row = &bits[static_cast<size_t>(y) * words_per_row];
+        for (int x = 0; x < width; x++)
+        {
+            row[x >> 6] |= static_cast<uint64_t>(m[x] != 0) << (x & 63);
+        }
+    }
+}
+
+bool imcmp::CompareMask::is_ignored(int x, int y) const
+{
+    return (bits[static_cast<size_t>(y) * words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+int64_t imcmp::CompareMask::ignored_pixels() const
+{
+    int64_t count = 0;
+    for (uint64_t word : bits)
+    {
+        count += std::bitset<64>(word).count();
+    }
+    return count;
+}
+
+bool imcmp::CompareMask::is_fully_ignored(const cv::Rect& rect) const
+{
+    std::vector<cv::Range> spans;
+    for (int y = rect.y; y < rect.y + rect.height && spans.empty(); y++)
+    {
+        unmasked_spans(y, rect.x, rect.x + rect.width, spans);
+    }
+    return spans.empty();
+}
+
+void imcmp::CompareMask::unmasked_spans(int y, int x0, int x1, std::vector<cv::Range>& spans) const
+{
+    const uint64_t* row = &bits[static_cast<size_t>(y) * words_per_row];
+    int x = x0;
+    while (x < x1)
+    {
+        // skip ignored pixels, whole words at once
+        while (x < x1)
+        {
+            if ((x & 63) == 0 && row[x >> 6] == all_bits)
+                x += 64;
+            else if ((row[x >> 6] >> (x & 63)) & 1)
+                x++;
+            else
+                break;
+        }
+        const int start = x;
+        while (x < x1)
+        {
+            if ((x & 63) == 0 && row[x >> 6] == 0)
+                x += 64;
+            else if (((row[x >> 6] >> (x & 63)) & 1) == 0)
+                x++;
+            else
+                break;
+        }
+        x = std::min(x, x1);
+        if (x > start)
+        {
+            spans.push_back(cv::Range(start, x));
+        }
+    }
+}
+
+uint64_t* imcmp::CompareMask::row_bits(int y)
+{
+    return &bits[static_cast<size_t>(y) * words_per_row];
+}
+
+const uint64_t* imcmp::CompareMask::row_bits(int y) const
+{
+    return &bits[static_cast<size_t>(y) * words_per_row];
+}
+
+cv::Mat imcmp::CompareMask::to_mat() const
+{
+    cv::Mat mat(height, width, CV_8UC1);
+    for (int y = 0; y < height; y++)
+    {
+        uchar* m = mat.ptr<uchar>(y);
+        for (int x = 0; x < width; x++)
+        {
+            m[x] = is_ignored(x, y) ? 255 : 0;
+        }
+    }
+    return mat;
+}
+
+bool imcmp::load_compare_mask(const std::string& path, const cv::Size& size, CompareMask& mask)
+{
+    // parsed aside, so a bad file leaves the current mask in place
+    CompareMask loaded;
+    bool ok = false;
+    if (has_suffix(path, ".txt"))
+    {
+        ok = load_rect_list(path, size, loaded);
+    }
+    else if (has_suffix(path, ".pbm"))
+    {
+        ok = load_pbm(path, size, loaded);
+    }
+    else
+    {
+        cv::Mat image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+        if (image.empty() || image.size() != size)
+        {
+            fprintf(stderr, "failed to load %s as a mask of %dx%d\n", path.c_str(), size.width, size.height);
+            return false;
+        }
+        loaded = CompareMask(size);
+        loaded.ignore_where(image);
+        ok = true;
+    }
+    if (ok)
+    {
+        mask = std::move(loaded);
+    }
+    return ok;
+}
+
+bool imcmp::save_compare_mask(const std::string& path, const CompareMask& mask)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "failed to open %s for writing\n", path.c_str());
+        return false;
+    }
+    const cv::Size size = mask.size();
+    fprintf(fp, "P4\n%d %d\n", size.width, size.height);
+    const int row_bytes = (size.width + 7) / 8;
+    std::vector<uchar> row(row_bytes);
+    bool ok = true;
+    for (int y = 0; y < size.height && ok; y++)
+    {
+        const uint64_t* words = mask.row_bits(y);
+        for (int k = 0; k < row_bytes; k++)
+        {
+            row[k] = reverse_bits(static_cast<uchar>(words[k >> 3] >> ((k & 7) * 8)));
+        }
+        ok = (fwrite(row.data(), 1, row_bytes, fp) == static_cast<size_t>(row_bytes));
+    }
+    fclose(fp);
+    return ok;
+}
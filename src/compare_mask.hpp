@@ -0,0 +1,56 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+namespace imcmp {
+
+/// @brief bit-packed ignore mask, one bit per pixel, set where differences are ignored, e.g. timestamps or cursors
+///
+/// Rows are padded to whole 64-bit words, so the tiles of the compare kernels (64 pixels wide, starting at multiples
+/// of 64) look up one word per row, and runs of pixels that are not ignored are found a word at a time.
+class CompareMask
+{
+public:
+    CompareMask() {}
+    /// @brief mask of `size` which ignores nothing
+    explicit CompareMask(const cv::Size& size);
+
+    cv::Size size() const;
+    bool empty() const;
+    void ignore_rect(const cv::Rect& rect);
+    /// @brief ignore everything outside the union of `rois`
+    void keep_only(const std::vector<cv::Rect>& rois);
+    /// @brief ignore the pixels where the CV_8UC1 `mask` of the same size is non zero
+    void ignore_where(const cv::Mat& mask);
+    bool is_ignored(int x, int y) const;
+    int64_t ignored_pixels() const;
+    bool is_fully_ignored(const cv::Rect& rect) const;
+    /// @brief append the runs [start, end) of row `y` within [x0, x1) which are not ignored
+    void unmasked_spans(int y, int x0, int x1, std::vector<cv::Range>& spans) const;
+    /// @brief CV_8UC1, 255 where ignored
+    cv::Mat to_mat() const;
+    /// @brief the words of row `y`, for bulk access; bits past the width must stay clear
+    uint64_t* row_bits(int y);
+    const uint64_t* row_bits(int y) const;
+
+private:
+    int width = 0;
+    int height = 0;
+    int words_per_row = 0;
+    std::vector<uint64_t> bits; // bit (x & 63) of word (x >> 6) of a row
+};
+
+/// @brief load a mask for images of `size`
+///
+/// A `.txt` file is a rectangle list, one "x y width height" per line, ignored; lines starting with "roi" are regions
+/// of interest instead, and everything outside all of them is ignored; "#" starts a comment. A `.pbm` file ignores
+/// the pixels whose bit is set (black). Any other file is read as a grayscale image, which ignores the pixels where
+/// it is not zero. `mask` is left unchanged if the file can't be loaded.
+bool load_compare_mask(const std::string& path, const cv::Size& size, CompareMask& mask);
+
+/// @brief save as a PBM (P4), which stores the mask bit-packed too
+bool save_compare_mask(const std::string& path, const CompareMask& mask);
+
+} // namespace imcmp
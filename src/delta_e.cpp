@@ -0,0 +1,384 @@
+#include "delta_e.hpp"
+#include "image_compare.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+namespace {
+
+const int cube_root_table_size = 4096;
+const int pair_cache_bits = 12;
+
+// CIELAB f(t), with the exact CIE epsilon and kappa
+double lab_f(double t)
+{
+    return (t > 216.0 / 24389.0) ? std::cbrt(t) : (24389.0 / 27.0 * t + 16.0) / 116.0;
+}
+
+// per channel contributions to XYZ, already divided by the D65 white, and f(t) sampled over [0, 1]
+class LabTables
+{
+public:
+    float xyz[3][256][3]; // [B, G, R][value][X, Y, Z]
+    float f[cube_root_table_size + 2];
+
+    LabTables()
+    {
+        // linear sRGB to XYZ, columns R, G, B
+        const double m[3][3] = {
+            {0.4124564, 0.3575761, 0.1804375},
+            {0.2126729, 0.7151522, 0.0721750},
+            {0.0193339, 0.1191920, 0.9503041},
+        };
+        const double white[3] = {0.95047, 1.0, 1.08883};
+        for (int v = 0; v < 256; v++)
+        {
+            const double c = v / 255.0;
+            const double linear = (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            for (int k = 0; k < 3; k++)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    xyz[k][v][i] = static_cast<float>(m[i][2 - k] * linear / white[i]);
+                }
+            }
+        }
+        for (int i = 0; i < cube_root_table_size + 2; i++)
+        {
+            f[i] = static_cast<float>(lab_f(static_cast<double>(i) / cube_root_table_size));
+        }
+    }
+};
+
+const LabTables& lab_tables()
+{
+    static const LabTables tables;
+    return tables;
+}
+
+inline float lookup_f(const float* f, float t)
+{
+    const float pos = std::min(std::max(t, 0.f), 1.f) * cube_root_table_size;
+    const int i = static_cast<int>(pos);
+    return f[i] + (f[i + 1] - f[i]) * (pos - i);
+}
+
+inline void lab_of(const LabTables& tables, const uchar* bgr, float& L, float& a, float& b)
+{
+    float xyz[3] = {0, 0, 0};
+    for (int k = 0; k < 3; k++)
+    {
+        const float* c = tables.xyz[k][bgr[k]];
+        xyz[0] += c[0];
+        xyz[1] += c[1];
+        xyz[2] += c[2];
+    }
+    const float fx = lookup_f(tables.f, xyz[0]);
+    const float fy = lookup_f(tables.f, xyz[1]);
+    const float fz = lookup_f(tables.f, xyz[2]);
+    L = 116.f * fy - 16.f;
+    a = 500.f * (fx - fy);
+    b = 200.f * (fy - fz);
+}
+
+// a row of Lab, planar so the deltaE kernels load whole vectors
+class LabRow
+{
+public:
+    std::vector<float> L;
+    std::vector<float> a;
+    std::vector<float> b;
+
+    explicit LabRow(int cols)
+        : L(cols), a(cols), b(cols)
+    {
+    }
+
+    void convert(const LabTables& tables, const uchar* src, int cn, int cols)
+    {
+        for (int j = 0; j < cols; j++, src += cn)
+        {
+            lab_of(tables, src, L[j], a[j], b[j]);
+        }
+    }
+};
+
+float cie76(float L1, float a1, float b1, float L2, float a2, float b2)
+{
+    const float dl = L1 - L2;
+    const float da = a1 - a2;
+    const float db = b1 - b2;
+    return std::sqrt(dl * dl + da * da + db * db);
+}
+
+// graphic arts: kL = 1, K1 = 0.045, K2 = 0.015
+float cie94(float L1, float a1, float b1, float L2, float a2, float b2)
+{
+    const float dl = L1 - L2;
+    const float da = a1 - a2;
+    const float db = b1 - b2;
+    const float c1 = std::sqrt(a1 * a1 + b1 * b1);
+    const float c2 = std::sqrt(a2 * a2 + b2 * b2);
+    const float dc = c1 - c2;
+    const float dh2 = std::max(da * da + db * db - dc * dc, 0.f);
+    const float sc = 1.f + 0.045f * c1;
+    const float sh = 1.f + 0.015f * c1;
+    return std::sqrt(dl * dl + (dc / sc) * (dc / sc) + dh2 / (sh * sh));
+}
+
+// Sharma, Wu, Dalal, "The CIEDE2000 color-difference formula: implementation notes"
+float ciede2000(float L1, float a1, float b1, float L2, float a2, float b2)
+{
+    const double deg = CV_PI / 180.0;
+    const double pow25_7 = 6103515625.0; // 25^7
+    const double c_bar = (std::sqrt(a1 * a1 + b1 * b1) + std::sqrt(a2 * a2 + b2 * b2)) / 2;
+    const double c_bar7 = std::pow(c_bar, 7);
+    const double g = 0.5 * (1 - std::sqrt(c_bar7 / (c_bar7 + pow25_7)));
+    const double a1p = (1 + g) * a1;
+    const double a2p = (1 + g) * a2;
+    const double c1p = std::sqrt(a1p * a1p + b1 * b1);
+    const double c2p = std::sqrt(a2p * a2p + b2 * b2);
+    double h1p = (b1 == 0 && a1p == 0) ? 0 : std::atan2(b1, a1p) / deg;
+    double h2p = (b2 == 0 && a2p == 0) ? 0 : std::atan2(b2, a2p) / deg;
+    h1p += (h1p < 0) ? 360 : 0;
+    h2p += (h2p < 0) ? 360 : 0;
+
+    const double dlp = L2 - L1;
+    const double dcp = c2p - c1p;
+    double dhp = 0;
+    if (c1p * c2p != 0)
+    {
+        dhp = h2p - h1p;
+        dhp -= (dhp > 180) ? 360 : 0;
+        dhp += (dhp < -180) ? 360 : 0;
+    }
+    const double dHp = 2 * std::sqrt(c1p * c2p) * std::sin(dhp * deg / 2);
+
+    const double l_bar = (L1 + L2) / 2.0;
+    const double c_bar_p = (c1p + c2p) / 2;
+    double h_bar_p = h1p + h2p;
+    if (c1p * c2p != 0)
+    {
+        if (std::abs(h1p - h2p) <= 180)
+            h_bar_p /= 2;
+        else if (h1p + h2p < 360)
+            h_bar_p = (h_bar_p + 360) / 2;
+        else
+            h_bar_p = (h_bar_p - 360) / 2;
+    }
+
+    const double t = 1 - 0.17 * std::cos((h_bar_p - 30) * deg) + 0.24 * std::cos(2 * h_bar_p * deg)
+                     + 0.32 * std::cos((3 * h_bar_p + 6) * deg) - 0.20 * std::cos((4 * h_bar_p - 63) * deg);
+    const double d_theta = 30 * std::exp(-((h_bar_p - 275) / 25) * ((h_bar_p - 275) / 25));
+    const double c_bar_p7 = std::pow(c_bar_p, 7);
+    const double rc = 2 * std::sqrt(c_bar_p7 / (c_bar_p7 + pow25_7));
+    const double l50 = (l_bar - 50) * (l_bar - 50);
+    const double sl = 1 + 0.015 * l50 / std::sqrt(20 + l50);
+    const double sc = 1 + 0.045 * c_bar_p;
+    const double sh = 1 + 0.015 * c_bar_p * t;
+    const double rt = -std::sin(2 * d_theta * deg) * rc;
+
+    const double l_term = dlp / sl;
+    const double c_term = dcp / sc;
+    const double h_term = dHp / sh;
+    return static_cast<float>(std::sqrt(l_term * l_term + c_term * c_term + h_term * h_term + rt * c_term * h_term));
+}
+
+void delta_e_row_76(const LabRow& p, const LabRow& q, float* d, int cols)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_float32::nlanes;
+    for (; j + step <= cols; j += step)
+    {
+        const cv::v_float32 dl = cv::vx_load(&p.L[j]) - cv::vx_load(&q.L[j]);
+        const cv::v_float32 da = cv::vx_load(&p.a[j]) - cv::vx_load(&q.a[j]);
+        const cv::v_float32 db = cv::vx_load(&p.b[j]) - cv::vx_load(&q.b[j]);
+        cv::v_store(d + j, cv::v_sqrt(dl * dl + da * da + db * db));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < cols; j++)
+    {
+        d[j] = cie76(p.L[j], p.a[j], p.b[j], q.L[j], q.a[j], q.b[j]);
+    }
+}
+
+void delta_e_row_94(const LabRow& p, const LabRow& q, float* d, int cols)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_float32::nlanes;
+    const cv::v_float32 one = cv::vx_setall_f32(1.f);
+    const cv::v_float32 k1 = cv::vx_setall_f32(0.045f);
+    const cv::v_float32 k2 = cv::vx_setall_f32(0.015f);
+    const cv::v_float32 zero = cv::vx_setzero_f32();
+    for (; j + step <= cols; j += step)
+    {
+        const cv::v_float32 a1 = cv::vx_load(&p.a[j]);
+        const cv::v_float32 b1 = cv::vx_load(&p.b[j]);
+        const cv::v_float32 a2 = cv::vx_load(&q.a[j]);
+        const cv::v_float32 b2 = cv::vx_load(&q.b[j]);
+        const cv::v_float32 dl = cv::vx_load(&p.L[j]) - cv::vx_load(&q.L[j]);
+        const cv::v_float32 da = a1 - a2;
+        const cv::v_float32 db = b1 - b2;
+        const cv::v_float32 c1 = cv::v_sqrt(a1 * a1 + b1 * b1);
+        const cv::v_float32 dc = c1 - cv::v_sqrt(a2 * a2 + b2 * b2);
+        const cv::v_float32 dh2 = cv::v_max(da * da + db * db - dc * dc, zero);
+        const cv::v_float32 dc_sc = dc / (one + k1 * c1);
+        const cv::v_float32 sh = one + k2 * c1;
+        cv::v_store(d + j, cv::v_sqrt(dl * dl + dc_sc * dc_sc + dh2 / (sh * sh)));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < cols; j++)
+    {
+        d[j] = cie94(p.L[j], p.a[j], p.b[j], q.L[j], q.a[j], q.b[j]);
+    }
+}
+
+// CIEDE2000 is too branchy and transcendental to vectorize, so identical pixels are skipped
+// and the results of recent color pairs are kept, which flat regions and gradients hit often
+class PairCache
+{
+public:
+    uint64_t keys[1 << pair_cache_bits] = {}; // pair + 1, 0 is empty
+    float values[1 << pair_cache_bits];
+};
+
+inline uint32_t pack_bgr(const uchar* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+void delta_e_row_2000(const LabTables& tables, const uchar* p1, const uchar* p2, int cn, float* d, int cols, PairCache& cache)
+{
+    for (int j = 0; j < cols; j++, p1 += cn, p2 += cn)
+    {
+        const uint32_t c1 = pack_bgr(p1);
+        const uint32_t c2 = pack_bgr(p2);
+        if (c1 == c2)
+        {
+            d[j] = 0;
+            continue;
+        }
+        const uint64_t key = ((static_cast<uint64_t>(c1) << 24) | c2) + 1;
+        const int slot = static_cast<int>((key * 0x9E3779B97F4A7C15ULL) >> (64 - pair_cache_bits));
+        if (cache.keys[slot] != key)
+        {
+            float L1, a1, b1, L2, a2, b2;
+            lab_of(tables, p1, L1, a1, b1);
+            lab_of(tables, p2, L2, a2, b2);
+            cache.keys[slot] = key;
+            cache.values[slot] = ciede2000(L1, a1, b1, L2, a2, b2);
+        }
+        d[j] = cache.values[slot];
+    }
+}
+
+} // namespace
+
+cv::Vec3f imcmp::bgr_to_lab(const uchar* bgr)
+{
+    cv::Vec3f lab;
+    lab_of(lab_tables(), bgr, lab[0], lab[1], lab[2]);
+    return lab;
+}
+
+float imcmp::delta_e(const cv::Vec3f& lab1, const cv::Vec3f& lab2, DeltaEFormula formula)
+{
+    switch (formula)
+    {
+    case DeltaEFormula::Cie94:
+        return cie94(lab1[0], lab1[1], lab1[2], lab2[0], lab2[1], lab2[2]);
+    case DeltaEFormula::Ciede2000:
+        return ciede2000(lab1[0], lab1[1], lab1[2], lab2[0], lab2[1], lab2[2]);
+    default:
+        return cie76(lab1[0], lab1[1], lab1[2], lab2[0], lab2[1], lab2[2]);
+    }
+}
+
+void imcmp::compute_delta_e(const cv::Mat& src1, const cv::Mat& src2, DeltaEFormula formula, cv::Mat& delta_e)
+{
+    CV_Assert(src1.size() == src2.size() && src1.type() == src2.type() && src1.depth() == CV_8U);
+    CV_Assert(src1.channels() == 3 || src1.channels() == 4);
+
+    const LabTables& tables = lab_tables();
+    const int cn = src1.channels();
+    const int cols = src1.cols;
+    delta_e.create(src1.size(), CV_32FC1);
+    cv::parallel_for_(cv::Range(0, src1.rows), [&](const cv::Range& range) {
+        if (formula == DeltaEFormula::Ciede2000)
+        {
+            std::unique_ptr<PairCache> cache(new PairCache());
+            for (int i = range.start; i < range.end; i++)
+            {
+                delta_e_row_2000(tables, src1.ptr(i), src2.ptr(i), cn, delta_e.ptr<float>(i), cols, *cache);
+            }
+            return;
+        }
+        LabRow lab1(cols);
+        LabRow lab2(cols);
+        for (int i = range.start; i < range.end; i++)
+        {
+            lab1.convert(tables, src1.ptr(i), cn, cols);
+            lab2.convert(tables, src2.ptr(i), cn, cols);
+            if (formula == DeltaEFormula::Cie94)
+                delta_e_row_94(lab1, lab2, delta_e.ptr<float>(i), cols);
+            else
+                delta_e_row_76(lab1, lab2, delta_e.ptr<float>(i), cols);
+        }
+    });
+}
+
+cv::Mat imcmp::DeltaEComparer::compare(const cv::Mat& image_left, const cv::Mat& image_right, DeltaEFormula formula, float thresh, bool& is_exactly_same, DeltaEStats& stats)
+{
+    if (image_left.empty() || image_left.size() != image_right.size() || image_left.type() != image_right.type()
+        || image_left.depth() != CV_8U || image_left.channels() < 3)
+    {
+        fprintf(stderr, "deltaE compare requires 8-bit color images of same size and format\n");
+        reset();
+        return cv::Mat();
+    }
+
+    // we hold references to the last pair, so their buffers can't be reused by other images
+    const bool warm = !delta_map.empty() && image_left.data == last_left.data && image_right.data == last_right.data
+                      && image_left.size() == last_left.size() && formula == last_formula;
+    if (!warm)
+    {
+        compute_delta_e(image_left, image_right, formula, delta_map);
+        double max_value = 0;
+        cv::minMaxLoc(delta_map, NULL, &max_value);
+        max_delta_e = static_cast<float>(max_value);
+        mean_delta_e = cv::mean(delta_map).val[0];
+        last_left = image_left;
+        last_right = image_right;
+        last_formula = formula;
+    }
+
+    cv::Mat display = image_left;
+    if (image_left.channels() == 3)
+    {
+        cv::cvtColor(image_left, display, cv::COLOR_BGR2BGRA);
+    }
+    cv::Mat diff;
+    render_delta(delta_map, display, thresh, diff);
+    stats.diff_pixels = cv::countNonZero(delta_map > thresh);
+    stats.max_delta_e = max_delta_e;
+    stats.mean_delta_e = mean_delta_e;
+    is_exactly_same = (max_delta_e == 0);
+    return diff;
+}
+
+void imcmp::DeltaEComparer::reset()
+{
+    last_left.release();
+    last_right.release();
+    delta_map.release();
+    max_delta_e = 0;
+    mean_delta_e = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+namespace imcmp {
+
+enum class DeltaEFormula
+{
+    Cie76,
+    Cie94,     // graphic arts weights, the left image is the reference
+    Ciede2000,
+};
+
+/// @brief CIELAB (D65) of one 8-bit sRGB pixel in BGR order, through the same tables as compute_delta_e()
+cv::Vec3f bgr_to_lab(const uchar* bgr);
+
+/// @brief color difference of two CIELAB colors
+float delta_e(const cv::Vec3f& lab1, const cv::Vec3f& lab2, DeltaEFormula formula);
+
+/// @brief per pixel deltaE (CV_32FC1) of two same-sized 8-bit BGR or BGRA sRGB images, alpha is ignored
+///
+/// sRGB to Lab goes through per channel XYZ tables and an interpolated cube root table. CIE76 and CIE94 are
+/// vectorized; CIEDE2000 skips identical pixels and memoizes recent color pairs. Rows run in parallel.
+void compute_delta_e(const cv::Mat& src1, const cv::Mat& src2, DeltaEFormula formula, cv::Mat& delta_e);
+
+class DeltaEStats
+{
+public:
+    int64_t diff_pixels = 0; // above the tolerance
+    float max_delta_e = 0;
+    double mean_delta_e = 0;
+};
+
+/// @brief deltaE compare which keeps the last deltaE map
+///
+/// Comparing the same pair with the same formula again, e.g. when only the tolerance changed,
+/// re-thresholds the kept map instead of recomputing it.
+class DeltaEComparer
+{
+public:
+    /// @return diff image like compare_two_mat(), with pixels above `thresh` deltaE in red, and other differing pixels in blue
+    cv::Mat compare(const cv::Mat& image_left, const cv::Mat& image_right, DeltaEFormula formula, float thresh, bool& is_exactly_same, DeltaEStats& stats);
+    void reset();
+
+private:
+    cv::Mat last_left;
+    cv::Mat last_right;
+    DeltaEFormula last_formula = DeltaEFormula::Cie76;
+    cv::Mat delta_map;
+    float max_delta_e = 0;
+    double mean_delta_e = 0;
+};
+
+} // namespace imcmp
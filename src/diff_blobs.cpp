@@ -0,0 +1,245 @@
+#include "diff_blobs.hpp"
+#include "compare_mask.hpp"
+#include "diff_pyramid.hpp"
+#include "image_compare.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const int band_rows = 64;
+
+// horizontal run [start, end) of differing pixels
+struct Run
+{
+    int row;
+    int start;
+    int end;
+    int max_delta;
+};
+
+int find_root(std::vector<int>& parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// the smaller index wins, so labels don't depend on the order of the unions
+void unite(std::vector<int>& parent, int a, int b)
+{
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+// append the runs of row `y` within [x0, x1) of its per pixel max channel deltas
+void find_runs(const uchar* delta, int y, int x0, int x1, int thresh, std::vector<Run>& runs)
+{
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    const cv::v_uint8 t = cv::vx_setall_u8(static_cast<uchar>(thresh));
+#endif
+    int x = x0;
+    while (x < x1)
+    {
+#if CV_SIMD
+        // skip whole vectors of pixels within the tolerance, then scan the one which stopped the skip
+        for (; x + step <= x1; x += step)
+        {
+            if (cv::v_check_any(cv::vx_load(delta + x) > t))
+                break;
+        }
+#endif
+        while (x < x1 && delta[x] <= thresh)
+            x++;
+        if (x >= x1)
+            break;
+
+        Run run = {y, x, x, 0};
+        for (; x < x1 && delta[x] > thresh; x++)
+        {
+            run.max_delta = std::max(run.max_delta, static_cast<int>(delta[x]));
+        }
+        run.end = x;
+        runs.push_back(run);
+    }
+#if CV_SIMD
+    cv::vx_cleanup();
+#endif
+}
+
+// unite the runs of [cur_begin, cur_end) with the 8-connected ones of the row above, [prev_begin, prev_end)
+// both sorted by start
+void connect_rows(const std::vector<Run>& runs, std::vector<int>& parent, int prev_begin, int prev_end, int cur_begin, int cur_end)
+{
+    int i = prev_begin;
+    for (int r = cur_begin; r < cur_end; r++)
+    {
+        while (i < prev_end && runs[i].end < runs[r].start)
+            i++;
+        for (int k = i; k < prev_end && runs[k].start <= runs[r].end; k++)
+        {
+            unite(parent, r, k);
+        }
+    }
+}
+
+// labeled runs of rows [y0, y1), with indices local to the band
+struct Band
+{
+    std::vector<Run> runs;
+    std::vector<int> parent;
+    int first_row_end = 0; // runs [0, first_row_end) are on row y0
+    int last_row_begin = 0; // runs [last_row_begin, runs.size()) are on row y1 - 1
+};
+
+} // namespace
+
+std::vector<imcmp::DiffBlob> imcmp::find_diff_blobs(const cv::Mat& src1, const cv::Mat& src2, int thresh, const CompareMask* mask, DiffPyramid* pyramid)
+{
+    static_assert(band_rows % DiffPyramid::cell_size == 0, "a band must hold whole rows of pyramid cells");
+    std::vector<DiffBlob> blobs;
+    if (pyramid)
+    {
+        pyramid->reset();
+    }
+    if (src1.size() != src2.size() || src1.type() != src2.type() || src1.depth() != CV_8U)
+    {
+        fprintf(stderr, "blobs require two 8-bit images of the same size and type\n");
+        return blobs;
+    }
+    if (mask && !mask->empty() && mask->size() != src1.size())
+    {
+        fprintf(stderr, "mask must be of the size of the images\n");
+        return blobs;
+    }
+    if (mask && mask->empty())
+    {
+        mask = NULL;
+    }
+
+    if (pyramid && !src1.empty())
+    {
+        pyramid->begin(src1.size());
+    }
+    else
+    {
+        pyramid = NULL;
+    }
+
+    const int cn = src1.channels();
+    const int band_count = (src1.rows + band_rows - 1) / band_rows;
+    std::vector<Band> bands(band_count);
+    cv::parallel_for_(cv::Range(0, band_count), [&](const cv::Range& range) {
+        std::vector<cv::Range> spans(1, cv::Range(0, src1.cols));
+        std::vector<uchar> delta(src1.cols);
+        for (int b = range.start; b < range.end; b++)
+        {
+            Band& band = bands[b];
+            const int y0 = b * band_rows;
+            const int y1 = std::min(y0 + band_rows, src1.rows);
+            int prev_begin = 0;
+            int prev_end = 0;
+            for (int y = y0; y < y1; y++)
+            {
+                const int begin = static_cast<int>(band.runs.size());
+                max_channel_absdiff_row(src1.ptr<uchar>(y), src2.ptr<uchar>(y), delta.data(), src1.cols, cn);
+                if (mask)
+                {
+                    // clear the ignored pixels, for the pyramid
+                    spans.clear();
+                    mask->unmasked_spans(y, 0, src1.cols, spans);
+                    int x = 0;
+                    for (const cv::Range& span : spans)
+                    {
+                        memset(delta.data() + x, 0, span.start - x);
+                        x = span.end;
+                    }
+                    memset(delta.data() + x, 0, src1.cols - x);
+                }
+                for (const cv::Range& span : spans)
+                {
+                    find_runs(delta.data(), y, span.start, span.end, thresh, band.runs);
+                }
+                if (pyramid)
+                {
+                    pyramid->add_row(y, delta.data(), thresh);
+                }
+                const int end = static_cast<int>(band.runs.size());
+                for (int i = begin; i < end; i++)
+                    band.parent.push_back(i);
+                if (y > y0)
+                    connect_rows(band.runs, band.parent, prev_begin, prev_end, begin, end);
+                if (y == y0)
+                    band.first_row_end = end;
+                prev_begin = begin;
+                prev_end = end;
+            }
+            band.last_row_begin = prev_begin;
+        }
+    });
+
+    // concatenate the bands, offsetting their labels, then unite across band boundaries
+    std::vector<int> offsets(band_count + 1, 0);
+    for (int b = 0; b < band_count; b++)
+    {
+        offsets[b + 1] = offsets[b] + static_cast<int>(bands[b].runs.size());
+    }
+    std::vector<Run> runs(offsets[band_count]);
+    std::vector<int> parent(offsets[band_count]);
+    for (int b = 0; b < band_count; b++)
+    {
+        std::copy(bands[b].runs.begin(), bands[b].runs.end(), runs.begin() + offsets[b]);
+        for (size_t i = 0; i < bands[b].parent.size(); i++)
+        {
+            parent[offsets[b] + i] = offsets[b] + bands[b].parent[i];
+        }
+    }
+    for (int b = 1; b < band_count; b++)
+    {
+        connect_rows(runs, parent, offsets[b - 1] + bands[b - 1].last_row_begin, offsets[b], offsets[b], offsets[b] + bands[b].first_row_end);
+    }
+    bands.clear();
+    if (pyramid)
+    {
+        pyramid->finish();
+    }
+
+    std::vector<int> blob_of_root(runs.size(), -1);
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        const int root = find_root(parent, static_cast<int>(i));
+        const Run& run = runs[i];
+        const cv::Rect rect(run.start, run.row, run.end - run.start, 1);
+        if (blob_of_root[root] < 0)
+        {
+            blob_of_root[root] = static_cast<int>(blobs.size());
+            blobs.push_back(DiffBlob());
+            blobs.back().bounds = rect;
+        }
+        DiffBlob& blob = blobs[blob_of_root[root]];
+        blob.bounds |= rect;
+        blob.pixels += rect.width;
+        blob.max_delta = std::max(blob.max_delta, run.max_delta);
+    }
+
+    std::sort(blobs.begin(), blobs.end(), [](const DiffBlob& a, const DiffBlob& b) {
+        if (a.max_delta != b.max_delta)
+            return a.max_delta > b.max_delta;
+        if (a.pixels != b.pixels)
+            return a.pixels > b.pixels;
+        if (a.bounds.y != b.bounds.y)
+            return a.bounds.y < b.bounds.y;
+        return a.bounds.x < b.bounds.x;
+    });
+    return blobs;
+}
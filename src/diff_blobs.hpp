@@ -0,0 +1,30 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace imcmp {
+
+class CompareMask;
+class DiffPyramid;
+
+/// @brief a connected region of pixels differing by more than the tolerance
+class DiffBlob
+{
+public:
+    cv::Rect bounds;
+    int64_t pixels = 0;
+    int max_delta = 0; // max channel delta
+};
+
+/// @brief 8-connected regions of the pixels of two same-sized 8-bit images whose any channel differs by more than
+/// `thresh`, most severe first: by max delta, then by pixel count
+///
+/// Labeling is run-based union-find over row bands processed in parallel, whose boundaries are merged afterwards,
+/// so memory grows with the differing runs rather than the image. Each row's per pixel deltas come from
+/// max_channel_absdiff_row(), which is only vectorized for 1 and 4 channels, so 3-channel images are diffed pixel by
+/// pixel; the deltas are then scanned vectorized for runs above `thresh`. Pixels ignored by `mask`, if not NULL, are
+/// left out. If `pyramid` is not NULL, it is built from the same deltas, as DiffPyramid::build() would.
+std::vector<DiffBlob> find_diff_blobs(const cv::Mat& src1, const cv::Mat& src2, int thresh, const CompareMask* mask = NULL, DiffPyramid* pyramid = NULL);
+
+} // namespace imcmp
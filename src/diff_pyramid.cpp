@@ -0,0 +1,204 @@
+#include "diff_pyramid.hpp"
+#include "compare_mask.hpp"
+#include "image_compare.hpp"
+#include <algorithm>
+#include <stdio.h>
+
+namespace {
+
+// Z order index of a cell, x in the even bits
+uint64_t morton(const cv::Point& cell)
+{
+    uint64_t code = 0;
+    for (int bit = 0; bit < 31; bit++)
+    {
+        code |= static_cast<uint64_t>((cell.x >> bit) & 1) << (2 * bit);
+        code |= static_cast<uint64_t>((cell.y >> bit) & 1) << (2 * bit + 1);
+    }
+    return code;
+}
+
+} // namespace
+
+bool imcmp::DiffPyramid::build(const cv::Mat& src1, const cv::Mat& src2, int thresh, const CompareMask* mask)
+{
+    reset();
+    if (src1.empty() || src1.size() != src2.size() || src1.type() != src2.type() || src1.depth() != CV_8U)
+    {
+        fprintf(stderr, "difference pyramid requires two 8-bit images of the same size and type\n");
+        return false;
+    }
+    if (mask && !mask->empty() && mask->size() != src1.size())
+    {
+        fprintf(stderr, "mask must be of the size of the images\n");
+        return false;
+    }
+    if (mask && mask->empty())
+    {
+        mask = NULL;
+    }
+
+    begin(src1.size());
+    const int cn = src1.channels();
+    cv::parallel_for_(cv::Range(0, pyramid[0].size.height), [&](const cv::Range& range) {
+        std::vector<uchar> delta(src1.cols);
+        for (int y = range.start * cell_size; y < std::min(range.end * cell_size, src1.rows); y++)
+        {
+            max_channel_absdiff_row(src1.ptr<uchar>(y), src2.ptr<uchar>(y), delta.data(), src1.cols, cn);
+            if (mask)
+            {
+                const uint64_t* bits = mask->row_bits(y);
+                for (int x = 0; x < src1.cols; x++)
+                {
+                    if ((bits[x >> 6] >> (x & 63)) & 1)
+                        delta[x] = 0;
+                }
+            }
+            add_row(y, delta.data(), thresh);
+        }
+    });
+    finish();
+    return true;
+}
+
+void imcmp::DiffPyramid::begin(const cv::Size& size)
+{
+    reset();
+    image_size = size;
+    Level base;
+    base.size = cv::Size((size.width + cell_size - 1) / cell_size, (size.height + cell_size - 1) / cell_size);
+    base.max_delta.assign(base.size.area(), 0);
+    base.diff_pixels.assign(base.size.area(), 0);
+    pyramid.push_back(std::move(base));
+}
+
+void imcmp::DiffPyramid::add_row(int y, const uchar* delta, int thresh)
+{
+    Level& base = pyramid[0];
+    const size_t offset = static_cast<size_t>(y / cell_size) * base.size.width;
+    uchar* cell_max = &base.max_delta[offset];
+    int64_t* cell_count = &base.diff_pixels[offset];
+    for (int cx = 0; cx < base.size.width; cx++)
+    {
+        const int x_end = std::min((cx + 1) * cell_size, image_size.width);
+        int m = cell_max[cx];
+        int count = 0;
+        for (int x = cx * cell_size; x < x_end; x++)
+        {
+            m = std::max(m, static_cast<int>(delta[x]));
+            count += (delta[x] > thresh);
+        }
+        cell_max[cx] = static_cast<uchar>(m);
+        cell_count[cx] += count;
+    }
+}
+
+void imcmp::DiffPyramid::finish()
+{
+    while (pyramid.back().size.area() > 1)
+    {
+        const Level& below = pyramid.back();
+        Level level;
+        level.size = cv::Size((below.size.width + 1) / 2, (below.size.height + 1) / 2);
+        level.max_delta.assign(level.size.area(), 0);
+        level.diff_pixels.assign(level.size.area(), 0);
+        cv::parallel_for_(cv::Range(0, level.size.height), [&](const cv::Range& range) {
+            for (int y = range.start; y < range.end; y++)
+            {
+                for (int x = 0; x < level.size.width; x++)
+                {
+                    int m = 0;
+                    int64_t count = 0;
+                    for (int dy = 0; dy < 2 && y * 2 + dy < below.size.height; dy++)
+                    {
+                        for (int dx = 0; dx < 2 && x * 2 + dx < below.size.width; dx++)
+                        {
+                            const size_t i = static_cast<size_t>(y * 2 + dy) * below.size.width + x * 2 + dx;
+                            m = std::max(m, static_cast<int>(below.max_delta[i]));
+                            count += below.diff_pixels[i];
+                        }
+                    }
+                    level.max_delta[static_cast<size_t>(y) * level.size.width + x] = static_cast<uchar>(m);
+                    level.diff_pixels[static_cast<size_t>(y) * level.size.width + x] = count;
+                }
+            }
+        });
+        pyramid.push_back(std::move(level));
+    }
+}
+
+void imcmp::DiffPyramid::reset()
+{
+    image_size = cv::Size();
+    pyramid.clear();
+}
+
+bool imcmp::DiffPyramid::empty() const
+{
+    return pyramid.empty();
+}
+
+int imcmp::DiffPyramid::levels() const
+{
+    return static_cast<int>(pyramid.size());
+}
+
+cv::Size imcmp::DiffPyramid::level_size(int level) const
+{
+    return pyramid[level].size;
+}
+
+int imcmp::DiffPyramid::max_delta(int level, const cv::Point& cell) const
+{
+    const Level& l = pyramid[level];
+    return l.max_delta[static_cast<size_t>(cell.y) * l.size.width + cell.x];
+}
+
+int64_t imcmp::DiffPyramid::diff_pixels(int level, const cv::Point& cell) const
+{
+    const Level& l = pyramid[level];
+    return l.diff_pixels[static_cast<size_t>(cell.y) * l.size.width + cell.x];
+}
+
+cv::Rect imcmp::DiffPyramid::cell_rect(int level, const cv::Point& cell) const
+{
+    const int side = cell_size << level;
+    return cv::Rect(cell.x * side, cell.y * side, side, side) & cv::Rect(0, 0, image_size.width, image_size.height);
+}
+
+bool imcmp::DiffPyramid::next_difference(const cv::Point& from, cv::Point& cell) const
+{
+    if (pyramid.empty())
+    {
+        return false;
+    }
+    return find_after(levels() - 1, cv::Point(0, 0), from, cell);
+}
+
+bool imcmp::DiffPyramid::find_after(int level, const cv::Point& node, const cv::Point& from, cv::Point& cell) const
+{
+    if (diff_pixels(level, node) == 0)
+    {
+        return false;
+    }
+    // the level 0 cells beneath `node` are a contiguous range of Z order; skip it if it ends at or before `from`
+    if (from.x >= 0 && ((morton(node) + 1) << (2 * level)) <= morton(from) + 1)
+    {
+        return false;
+    }
+    if (level == 0)
+    {
+        cell = node;
+        return true;
+    }
+    const cv::Size below = level_size(level - 1);
+    for (int k = 0; k < 4; k++)
+    {
+        const cv::Point child(node.x * 2 + (k & 1), node.y * 2 + (k >> 1));
+        if (child.x < below.width && child.y < below.height && find_after(level - 1, child, from, cell))
+        {
+            return true;
+        }
+    }
+    return false;
+}
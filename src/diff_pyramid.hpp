@@ -0,0 +1,59 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace imcmp {
+
+class CompareMask;
+
+/// @brief max pooling pyramid of the per pixel deltas of two images, for overviews and navigation of large diffs
+///
+/// Level 0 cells are cell_size pixels square, and each level above halves both dimensions, down to a single cell.
+/// Every cell holds the max channel delta and the count of pixels above the tolerance beneath it, so a search can
+/// descend into non zero cells only.
+class DiffPyramid
+{
+public:
+    static const int cell_size = 16;
+
+    /// @brief build from two same-sized 8-bit images; pixels ignored by `mask`, if not NULL, count as equal
+    /// @retval false if sizes or types differ
+    bool build(const cv::Mat& src1, const cv::Mat& src2, int thresh, const CompareMask* mask = NULL);
+    /// @brief build from a pass which already has the per pixel deltas, e.g. find_diff_blobs(): begin(), then
+    /// add_row() for every row, then finish(); rows of different level 0 cell rows may be added in parallel
+    void begin(const cv::Size& size);
+    /// @param delta the max channel delta of the `size.width` pixels of row `y`, 0 where ignored
+    void add_row(int y, const uchar* delta, int thresh);
+    void finish();
+    void reset();
+    bool empty() const;
+    int levels() const;
+    cv::Size level_size(int level) const;
+    int max_delta(int level, const cv::Point& cell) const;
+    int64_t diff_pixels(int level, const cv::Point& cell) const;
+    /// @brief pixels beneath `cell`, clipped to the image
+    cv::Rect cell_rect(int level, const cv::Point& cell) const;
+
+    /// @brief the first level 0 cell with pixels above the tolerance after `from` in Z order, descending from the
+    /// top only into cells which have some, so the cost grows with the levels rather than the area
+    /// @param from (-1, -1) to find the first one
+    /// @retval false if there is none after `from`
+    bool next_difference(const cv::Point& from, cv::Point& cell) const;
+
+private:
+    class Level
+    {
+    public:
+        cv::Size size;
+        std::vector<uchar> max_delta;
+        std::vector<int64_t> diff_pixels;
+    };
+
+    bool find_after(int level, const cv::Point& node, const cv::Point& from, cv::Point& cell) const;
+
+    cv::Size image_size;
+    std::vector<Level> pyramid;
+};
+
+} // namespace imcmp
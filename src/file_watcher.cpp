@@ -0,0 +1,335 @@
+#include "file_watcher.hpp"
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <stdio.h>
+
+#if __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace {
+
+int64_t now_milliseconds()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void split_path(const std::string& filepath, std::string& dir, std::string& name)
+{
+    std::filesystem::path p = std::filesystem::absolute(std::filesystem::path(filepath));
+    dir = p.parent_path().string();
+    name = p.filename().string();
+}
+
+bool stat_file(const std::string& filepath, int64_t& mtime, int64_t& size)
+{
+    std::error_code ec;
+    std::filesystem::path p{filepath};
+    auto t = std::filesystem::last_write_time(p, ec);
+    if (ec) return false;
+    auto sz = std::filesystem::file_size(p, ec);
+    if (ec) return false;
+    mtime = t.time_since_epoch().count();
+    size = static_cast<int64_t>(sz);
+    return true;
+}
+
+} // namespace
+
+namespace imcmp {
+
+FileWatcher::FileWatcher()
+    : fd(-1)
+{
+#if __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "inotify_init1 failed, fallback to polling file stat\n");
+    }
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#if __linux__
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+}
+
+int FileWatcher::add(const std::string& filepath)
+{
+    Entry entry;
+    split_path(filepath, entry.dir, entry.name);
+    entry.used = true;
+    stat_file(entry.dir + "/" + entry.name, entry.mtime, entry.size);
+
+#if __linux__
+    if (fd >= 0)
+    {
+        // a directory watch may already exist for a sibling file; inotify returns the same wd then
+        const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE;
+        entry.wd = inotify_add_watch(fd, entry.dir.c_str(), mask);
+        if (entry.wd < 0)
+        {
+            fprintf(stderr, "inotify_add_watch failed for %s\n", entry.dir.c_str());
+            return -1;
+        }
+    }
+#endif
+
+    for (int i = 0; i < entries.size(); i++)
+    {
+        if (!entries[i].used)
+        {
+            entries[i] = entry;
+            return i;
+        }
+    }
+    entries.push_back(entry);
+    return static_cast<int>(entries.size()) - 1;
+}
+
+void FileWatcher::remove(int id)
+{
+    if (id < 0 || id >= entries.size() || !entries[id].used)
+    {
+        return;
+    }
+    const int wd = entries[id].wd;
+    entries[id] = Entry();
+
+#if __linux__
+    // only drop the directory watch once no other entry shares it
+    if (fd >= 0 && wd >= 0)
+    {
+        bool shared = false;
+        for (const Entry& e : entries)
+        {
+            shared |= (e.used && e.wd == wd);
+        }
+        if (!shared)
+        {
+            inotify_rm_watch(fd, wd);
+        }
+    }
+#endif
+}
+
+void FileWatcher::read_events(int64_t now_ms)
+{
+#if __linux__
+    alignas(struct inotify_event) char buf[4096];
+    while (true)
+    {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            // EAGAIN: queue drained
+            break;
+        }
+        for (char* ptr = buf; ptr < buf + len;)
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0)
+            {
+                continue;
+            }
+            for (Entry& e : entries)
+            {
+                if (e.used && e.wd == event->wd && e.name == event->name)
+                {
+                    e.pending = true;
+                    e.last_event_ms = now_ms;
+                }
+            }
+        }
+    }
+#endif
+}
+
+void FileWatcher::check_stat(int64_t now_ms)
+{
+    for (Entry& e : entries)
+    {
+        if (!e.used)
+        {
+            continue;
+        }
+        int64_t mtime = 0;
+        int64_t size = -1;
+        if (!stat_file(e.dir + "/" + e.name, mtime, size))
+        {
+            continue;
+        }
+        if (mtime != e.mtime || size != e.size)
+        {
+            e.mtime = mtime;
+            e.size = size;
+            e.pending = true;
+            e.last_event_ms = now_ms;
+        }
+    }
+}
+
+std::vector<int> FileWatcher::poll(int debounce_ms)
+{
+    const int64_t now_ms = now_milliseconds();
+    if (fd >= 0)
+    {
+        read_events(now_ms);
+    }
+    else
+    {
+        check_stat(now_ms);
+    }
+
+    std::vector<int> changed;
+    for (int i = 0; i < entries.size(); i++)
+    {
+        Entry& e = entries[i];
+        if (e.used && e.pending && now_ms - e.last_event_ms >= debounce_ms)
+        {
+            e.pending = false;
+            changed.push_back(i);
+        }
+    }
+    return changed;
+}
+
+DirectoryWatcher::DirectoryWatcher(const std::string& _dir)
+    : dir(_dir), fd(-1), wd(-1), overflows(0)
+{
+#if __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0)
+    {
+        wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+        {
+            fprintf(stderr, "inotify_add_watch failed for %s\n", dir.c_str());
+            close(fd);
+            fd = -1;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "inotify_init1 failed, fallback to scanning %s\n", dir.c_str());
+    }
+#endif
+    if (fd < 0)
+    {
+        // files already there are not "new": the 2nd scan marks them as reported
+        scan();
+        scan();
+    }
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#if __linux__
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+}
+
+bool DirectoryWatcher::valid() const
+{
+    std::error_code ec;
+    return std::filesystem::is_directory(std::filesystem::path(dir), ec);
+}
+
+int64_t DirectoryWatcher::overflow_count() const
+{
+    return overflows;
+}
+
+std::vector<std::string> DirectoryWatcher::wait(int timeout_ms)
+{
+    std::vector<std::string> names;
+#if __linux__
+    if (fd >= 0)
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (::poll(&pfd, 1, timeout_ms) <= 0)
+        {
+            return names;
+        }
+
+        alignas(struct inotify_event) char buf[4096];
+        while (true)
+        {
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len <= 0)
+            {
+                break;
+            }
+            for (char* ptr = buf; ptr < buf + len;)
+            {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    overflows++;
+                    continue;
+                }
+                if (event->len > 0 && !(event->mask & IN_ISDIR))
+                {
+                    names.emplace_back(event->name);
+                }
+            }
+        }
+        return names;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+    return scan();
+}
+
+std::vector<std::string> DirectoryWatcher::scan()
+{
+    std::vector<std::string> names;
+    std::error_code ec;
+    std::map<std::string, ScanEntry> current;
+    for (const auto& item : std::filesystem::directory_iterator(std::filesystem::path(dir), ec))
+    {
+        if (!item.is_regular_file(ec))
+        {
+            continue;
+        }
+        const std::string name = item.path().filename().string();
+        ScanEntry entry;
+        entry.size = static_cast<int64_t>(item.file_size(ec));
+
+        auto it = scanned.find(name);
+        if (it != scanned.end())
+        {
+            entry.reported = it->second.reported;
+            if (!entry.reported && it->second.size == entry.size)
+            {
+                entry.reported = true;
+                names.push_back(name);
+            }
+        }
+        current[name] = entry;
+    }
+    // dropping files that disappeared keeps this bounded by the directory size
+    scanned.swap(current);
+    return names;
+}
+
+} // namespace imcmp
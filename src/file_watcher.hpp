@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace imcmp {
+
+/// @brief watch a few files for modification
+///
+/// On Linux this is backed by inotify on each file's parent directory, so it
+/// still works when the producer replaces the file by write-then-rename.
+/// Elsewhere it falls back to polling the file's mtime and size.
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /// @brief start watching `filepath`
+    /// @return watch id (>= 0) on success, -1 on failure
+    int add(const std::string& filepath);
+    void remove(int id);
+
+    /// @brief collect watched files that changed and then stayed quiet for `debounce_ms`
+    /// A burst of writes to one file is reported once, after the last write.
+    /// Events are timestamped when poll() sees them, so call it frequently (e.g. once per UI frame).
+    std::vector<int> poll(int debounce_ms = 200);
+
+private:
+    class Entry
+    {
+    public:
+        std::string dir;
+        std::string name;
+        int wd = -1;
+        bool pending = false;
+        int64_t last_event_ms = 0;
+        int64_t mtime = 0;
+        int64_t size = -1;
+        bool used = false;
+    };
+
+    void read_events(int64_t now_ms);
+    void check_stat(int64_t now_ms);
+
+    int fd;
+    std::vector<Entry> entries; // index is the watch id
+};
+
+/// @brief watch one directory for files that were completely written into it
+///
+/// On Linux a file is reported once its writer closes it (IN_CLOSE_WRITE) or it is
+/// renamed into the directory (IN_MOVED_TO). Elsewhere the directory is rescanned,
+/// and a file is reported once its size stayed the same across two scans.
+class DirectoryWatcher
+{
+public:
+    explicit DirectoryWatcher(const std::string& dir);
+    ~DirectoryWatcher();
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    bool valid() const;
+
+    /// @brief wait up to `timeout_ms` for completed files
+    /// @return file names (without directory) in arrival order
+    std::vector<std::string> wait(int timeout_ms);
+
+    /// @brief number of times the kernel event queue overflowed, i.e. events were lost
+    int64_t overflow_count() const;
+
+private:
+    std::vector<std::string> scan();
+
+    class ScanEntry
+    {
+    public:
+        int64_t size = -1;
+        bool reported = false;
+    };
+
+    std::string dir;
+    int fd;
+    int wd;
+    int64_t overflows;
+    std::map<std::string, ScanEntry> scanned; // only used without inotify, pruned on every scan
+};
+
+} // namespace imcmp
@@ -0,0 +1,261 @@
+#include "hot_folder.hpp"
+#include "file_watcher.hpp"
+#include "image_io.hpp"
+#include "image_compare.hpp"
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+
+namespace imcmp {
+
+HotFolderIngest::HotFolderIngest(const Options& _options)
+    : options(_options), match_regex(_options.match_pattern), stopping(false), processed(0), log_file(NULL), log_bytes(0)
+{
+}
+
+HotFolderIngest::~HotFolderIngest()
+{
+    stop();
+    for (std::thread& t : workers)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    if (log_file)
+    {
+        fclose(log_file);
+    }
+}
+
+bool HotFolderIngest::run()
+{
+    DirectoryWatcher watcher(options.watch_dir);
+    if (!watcher.valid())
+    {
+        fprintf(stderr, "watch dir %s is not a directory\n", options.watch_dir.c_str());
+        return false;
+    }
+    if (!std::filesystem::is_directory(std::filesystem::path(options.reference_dir)))
+    {
+        fprintf(stderr, "reference dir %s is not a directory\n", options.reference_dir.c_str());
+        return false;
+    }
+
+    log_file = fopen(options.log_path.c_str(), "ab");
+    if (!log_file)
+    {
+        fprintf(stderr, "can not open log file %s\n", options.log_path.c_str());
+        return false;
+    }
+    log_bytes = ftell(log_file);
+
+    for (int i = 0; i < std::max(1, options.num_workers); i++)
+    {
+        workers.emplace_back(&HotFolderIngest::worker_loop, this);
+    }
+
+    int64_t reported_overflows = 0;
+    while (!stopping)
+    {
+        std::vector<std::string> names = watcher.wait(200);
+        if (watcher.overflow_count() != reported_overflows)
+        {
+            reported_overflows = watcher.overflow_count();
+            fprintf(stderr, "warning: inotify queue overflowed, some files were not seen\n");
+        }
+        for (const std::string& name : names)
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            // backpressure: wait for the workers rather than growing the queue
+            queue_not_full.wait(lock, [this] { return stopping || queue.size() < static_cast<size_t>(options.queue_capacity); });
+            if (stopping)
+            {
+                break;
+            }
+            queue.push_back(name);
+            queue_not_empty.notify_one();
+        }
+    }
+
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+    workers.clear();
+    return true;
+}
+
+void HotFolderIngest::stop()
+{
+    stopping = true;
+    queue_not_empty.notify_all();
+    queue_not_full.notify_all();
+}
+
+int64_t HotFolderIngest::processed_count() const
+{
+    return processed;
+}
+
+void HotFolderIngest::worker_loop()
+{
+    while (true)
+    {
+        std::string name;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_not_empty.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+            {
+                return; // stopping, and nothing left to do
+            }
+            name = queue.front();
+            queue.pop_front();
+            queue_not_full.notify_one();
+        }
+        process(name);
+        processed++;
+    }
+}
+
+void HotFolderIngest::process(const std::string& filename)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    CompareRecord record;
+    record.filename = filename;
+    record.reference = std::regex_replace(filename, match_regex, options.reference_format);
+
+    do {
+        // the file may be moved away between the event and its turn in the queue
+        const std::string path = options.watch_dir + "/" + filename;
+        if (!file_exist(path))
+        {
+            record.status = "file missing";
+            break;
+        }
+        FileInfo file_info = get_meta_info(path);
+        if (!file_info.valid)
+        {
+            record.status = file_info.err_msg;
+            break;
+        }
+        cv::Mat image = load_fourcc_and_convert_to_mat(file_info);
+        if (image.empty())
+        {
+            record.status = "failed to load";
+            break;
+        }
+
+        std::string err_msg;
+        cv::Mat reference = get_reference(record.reference, err_msg);
+        if (reference.empty())
+        {
+            record.status = err_msg;
+            break;
+        }
+        if (reference.size() != image.size() || reference.type() != image.type())
+        {
+            record.status = "size or format differs from reference";
+            break;
+        }
+
+        double psnr = 0;
+        compute_diff_metrics(image, reference, options.tolerance, record.diff_pixels, record.max_delta, psnr);
+        record.status = (record.diff_pixels == 0) ? "same" : "diff";
+    } while (0);
+
+    record.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    append_log(record);
+}
+
+cv::Mat HotFolderIngest::get_reference(const std::string& name, std::string& err_msg)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (auto it = reference_cache.begin(); it != reference_cache.end(); ++it)
+        {
+            if (it->name == name)
+            {
+                reference_cache.splice(reference_cache.begin(), reference_cache, it);
+                return it->image;
+            }
+        }
+    }
+
+    // decode outside the lock; two workers may decode the same reference once, which is harmless
+    const std::string path = options.reference_dir + "/" + name;
+    if (!file_exist(path))
+    {
+        err_msg = "reference missing: " + name;
+        return cv::Mat();
+    }
+    FileInfo file_info = get_meta_info(path);
+    if (!file_info.valid)
+    {
+        err_msg = "reference " + name + ": " + file_info.err_msg;
+        return cv::Mat();
+    }
+    cv::Mat image = load_fourcc_and_convert_to_mat(file_info);
+    if (image.empty())
+    {
+        err_msg = "reference " + name + ": failed to load";
+        return cv::Mat();
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    CachedReference cached;
+    cached.name = name;
+    cached.image = image;
+    reference_cache.push_front(cached);
+    while (reference_cache.size() > static_cast<size_t>(std::max(1, options.reference_cache_size)))
+    {
+        reference_cache.pop_back();
+    }
+    return image;
+}
+
+void HotFolderIngest::append_log(const CompareRecord& record)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+
+    // std::localtime() is not thread safe, so format the time under the lock too
+    char time_str[32];
+    std::time_t now = std::time(NULL);
+    std::strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+
+    if (log_file && log_bytes >= options.log_max_bytes)
+    {
+        fclose(log_file);
+        std::string rolled = options.log_path + ".1";
+        std::remove(rolled.c_str());
+        std::rename(options.log_path.c_str(), rolled.c_str());
+        log_file = fopen(options.log_path.c_str(), "ab");
+        log_bytes = 0;
+        if (!log_file)
+        {
+            fprintf(stderr, "can not reopen log file %s\n", options.log_path.c_str());
+        }
+    }
+    if (!log_file)
+    {
+        return;
+    }
+    int n = fprintf(log_file, "%s\t%s\t%s\t%s\t%lld\t%d\t%.1f\n",
+                    time_str,
+                    record.filename.c_str(),
+                    record.reference.c_str(),
+                    record.status.c_str(),
+                    (long long)record.diff_pixels,
+                    record.max_delta,
+                    record.elapsed_ms);
+    fflush(log_file);
+    if (n > 0)
+    {
+        log_bytes += n;
+    }
+}
+
+} // namespace imcmp
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace imcmp {
+
+/// @brief long running ingest: compare raw dumps as they arrive in a folder
+///
+/// Each completed file in `watch_dir` is matched to a reference in `reference_dir`
+/// by rewriting its name with `match_pattern` / `reference_format`
+/// (std::regex_replace syntax, e.g. "cam_(\\d+)_(.*)" and "ref_$2").
+/// Files are compared on a fixed worker pool and one line per file is appended
+/// to a rolling log. Memory stays bounded: at most `queue_capacity` paths are
+/// pending (the watcher blocks beyond that), each worker holds one frame, and at
+/// most `reference_cache_size` decoded references are cached.
+class HotFolderIngest
+{
+public:
+    class Options
+    {
+    public:
+        std::string watch_dir;
+        std::string reference_dir;
+        std::string log_path = "ingest.log";
+        std::string match_pattern = "(.*)";
+        std::string reference_format = "$1";
+        int tolerance = 1;
+        int num_workers = 4;
+        int queue_capacity = 64;
+        int reference_cache_size = 8;
+        int64_t log_max_bytes = 16 * 1024 * 1024; // then rolled over to `log_path`.1
+    };
+
+    explicit HotFolderIngest(const Options& options);
+    ~HotFolderIngest();
+
+    /// @brief watch and compare until stop() is called
+    /// @return false if the folders are invalid
+    bool run();
+    void stop();
+
+    int64_t processed_count() const;
+
+private:
+    class CompareRecord
+    {
+    public:
+        std::string filename;
+        std::string reference;
+        std::string status; // "same", "diff", or the error message
+        int64_t diff_pixels = 0;
+        int max_delta = 0;
+        double elapsed_ms = 0;
+    };
+
+    void worker_loop();
+    void process(const std::string& filename);
+    cv::Mat get_reference(const std::string& name, std::string& err_msg);
+    void append_log(const CompareRecord& record);
+
+    Options options;
+    std::regex match_regex;
+    std::atomic<bool> stopping;
+    std::atomic<int64_t> processed;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_not_empty;
+    std::condition_variable queue_not_full;
+    std::deque<std::string> queue;
+    std::vector<std::thread> workers;
+
+    // LRU of decoded references, most recently used at front
+    class CachedReference
+    {
+    public:
+        std::string name;
+        cv::Mat image;
+    };
+    std::mutex cache_mutex;
+    std::list<CachedReference> reference_cache;
+
+    std::mutex log_mutex;
+    FILE* log_file;
+    int64_t log_bytes;
+};
+
+} // namespace imcmp
@@ -1,4 +1,453 @@
 #include "image_compare.hpp"
+#include "compare_mask.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <string.h>
+
+namespace {
+
+const cv::Scalar above_color(0, 0, 255 - 50);
+const cv::Scalar below_color(255 - 50, 0, 0);
+const cv::Vec4b ignored_color(48, 48, 48, 255);
+const int mask_tile_size = 64;
+const int verdict_strip_rows = 16; // how often workers check whether another one already failed the pair
+
+// if the left and right image is differnt size, but same in the overlaped region, we compute the gray image, but assign to RGB pixels
+void fill_gray(const cv::Mat& src, cv::Mat& dst)
+{
+    cv::Size diff_size = dst.size();
+    for (int i = 0; i < diff_size.height; i++)
+    {
+        for (int j = 0; j < diff_size.width; j++)
+        {
+            float R2Y = 0.299;
+            float G2Y = 0.587;
+            float B2Y = 0.114;
+            int B = src.ptr(i, j)[0];
+            int G = src.ptr(i, j)[1];
+            int R = src.ptr(i, j)[2];
+            int gray = cv::saturate_cast<uchar>(R2Y * R + G2Y * G + B2Y * B);
+
+            dst.ptr(i, j)[0] = gray;
+            dst.ptr(i, j)[1] = gray;
+            dst.ptr(i, j)[2] = gray;
+            dst.ptr(i, j)[3] = 255;
+        }
+    }
+}
+
+std::vector<cv::Rect> make_tiles(const cv::Size& size, int tile_size)
+{
+    std::vector<cv::Rect> tiles;
+    for (int y = 0; y < size.height; y += tile_size)
+    {
+        for (int x = 0; x < size.width; x += tile_size)
+        {
+            tiles.emplace_back(x, y, std::min(tile_size, size.width - x), std::min(tile_size, size.height - y));
+        }
+    }
+    return tiles;
+}
+
+std::vector<uint64_t> compute_tile_hashes(const cv::Mat& image, const std::vector<cv::Rect>& tiles)
+{
+    std::vector<uint64_t> hashes(tiles.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range& range) {
+        for (int t = range.start; t < range.end; t++)
+        {
+            hashes[t] = imcmp::hash_region(image, tiles[t]);
+        }
+    });
+    return hashes;
+}
+
+template <typename T>
+void accumulate_cfa_stats(const cv::Mat& delta, int thresh, imcmp::CfaDiffStats& stats)
+{
+    std::mutex mutex;
+    cv::parallel_for_(cv::Range(0, delta.rows), [&](const cv::Range& range) {
+        imcmp::CfaDiffStats local;
+        for (int i = range.start; i < range.end; i++)
+        {
+            const T* d = delta.ptr<T>(i);
+            const int site = (i & 1) * 2;
+            for (int j = 0; j < delta.cols; j++)
+            {
+                const int k = site + (j & 1);
+                local.diff_pixels[k] += (d[j] > thresh);
+                local.max_delta[k] = std::max<int>(local.max_delta[k], d[j]);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int k = 0; k < 4; k++)
+        {
+            stats.diff_pixels[k] += local.diff_pixels[k];
+            stats.max_delta[k] = std::max(stats.max_delta[k], local.max_delta[k]);
+        }
+    });
+}
+
+double psnr_from_mse(double mse)
+{
+    return (mse == 0) ? std::numeric_limits<double>::infinity() : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// the diff kernel: one pass over a row gathers the statistics and, if `diff` is not NULL, renders it like getDiffImage()
+template <int cn>
+void accumulate_diff_row(const uchar* p1, const uchar* p2, uchar* diff, int cols, int thresh, imcmp::DiffStats& stats)
+{
+    const uchar above[4] = {cv::saturate_cast<uchar>(above_color.val[0]), cv::saturate_cast<uchar>(above_color.val[1]), cv::saturate_cast<uchar>(above_color.val[2]), 255};
+    const uchar below[4] = {cv::saturate_cast<uchar>(below_color.val[0]), cv::saturate_cast<uchar>(below_color.val[1]), cv::saturate_cast<uchar>(below_color.val[2]), 255};
+    for (int j = 0; j < cols; j++)
+    {
+        int pixel_max = 0;
+        for (int k = 0; k < cn; k++)
+        {
+            const int d = std::abs(p1[k] - p2[k]);
+            pixel_max = std::max(pixel_max, d);
+            stats.abs_sum[k] += d;
+            stats.sqr_sum[k] += d * d;
+            stats.channel_max[k] = std::max(stats.channel_max[k], d);
+        }
+        stats.histogram[pixel_max]++;
+        if (diff)
+        {
+            if (pixel_max == 0)
+            {
+                const int gray = 0.299f * p1[2] + 0.587f * p1[1] + 0.114f * p1[0];
+                diff[0] = diff[1] = diff[2] = static_cast<uchar>(gray);
+                diff[3] = 255;
+            }
+            else
+            {
+                memcpy(diff, (pixel_max > thresh) ? above : below, 4);
+            }
+            diff += 4;
+        }
+        p1 += cn;
+        p2 += cn;
+    }
+}
+
+// serial over the rows of `src1` and `src2`; `diff` is NULL or BGRA, and only rendered for BGRA inputs
+void accumulate_diff(const cv::Mat& src1, const cv::Mat& src2, cv::Mat* diff, int thresh, imcmp::DiffStats& stats)
+{
+    stats.channels = src1.channels();
+    stats.pixels += src1.total();
+    for (int i = 0; i < src1.rows; i++)
+    {
+        const uchar* p1 = src1.ptr(i);
+        const uchar* p2 = src2.ptr(i);
+        switch (src1.channels())
+        {
+        case 1:
+            accumulate_diff_row<1>(p1, p2, NULL, src1.cols, thresh, stats);
+            break;
+        case 2:
+            accumulate_diff_row<2>(p1, p2, NULL, src1.cols, thresh, stats);
+            break;
+        case 3:
+            accumulate_diff_row<3>(p1, p2, NULL, src1.cols, thresh, stats);
+            break;
+        default:
+            accumulate_diff_row<4>(p1, p2, diff ? diff->ptr(i) : NULL, src1.cols, thresh, stats);
+            break;
+        }
+    }
+}
+
+// diff_pixels and max_delta come from the histogram, so the kernel doesn't track them per pixel
+void finish_stats(imcmp::DiffStats& stats, int thresh)
+{
+    stats.diff_pixels = 0;
+    stats.max_delta = 0;
+    for (int d = 0; d < 256; d++)
+    {
+        stats.diff_pixels += (d > thresh) ? stats.histogram[d] : 0;
+        stats.max_delta = stats.histogram[d] ? d : stats.max_delta;
+    }
+}
+
+// accumulate_diff() over the whole images, in parallel by rows with 64-bit partial sums merged per range
+void diff_with_stats(const cv::Mat& src1, const cv::Mat& src2, cv::Mat* diff, int thresh, imcmp::DiffStats& stats)
+{
+    stats = imcmp::DiffStats();
+    stats.channels = src1.channels();
+    std::mutex mutex;
+    cv::parallel_for_(cv::Range(0, src1.rows), [&](const cv::Range& range) {
+        imcmp::DiffStats local;
+        cv::Mat diff_rows = diff ? diff->rowRange(range) : cv::Mat();
+        accumulate_diff(src1.rowRange(range), src2.rowRange(range), diff ? &diff_rows : NULL, thresh, local);
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.merge(local);
+    });
+    finish_stats(stats, thresh);
+}
+
+// per pixel max channel distance of each side outside the envelope of the other side, 0 inside
+void envelope_delta(const cv::Mat& left, const cv::Mat& right, const cv::Mat& left_min, const cv::Mat& left_max,
+                    const cv::Mat& right_min, const cv::Mat& right_max, cv::Mat& delta)
+{
+    delta.create(left.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, left.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            const uchar* l = left.ptr(i);
+            const uchar* r = right.ptr(i);
+            const uchar* lmin = left_min.ptr(i);
+            const uchar* lmax = left_max.ptr(i);
+            const uchar* rmin = right_min.ptr(i);
+            const uchar* rmax = right_max.ptr(i);
+            uchar* d = delta.ptr(i);
+            int j = 0;
+#if CV_SIMD
+            // 8-bit vector subtraction saturates, so a - b is max(a - b, 0)
+            const int step = cv::v_uint8::nlanes;
+            for (; j + step <= left.cols; j += step)
+            {
+                cv::v_uint8 vl[4], vr[4], vlmin[4], vlmax[4], vrmin[4], vrmax[4];
+                cv::v_load_deinterleave(l + 4 * j, vl[0], vl[1], vl[2], vl[3]);
+                cv::v_load_deinterleave(r + 4 * j, vr[0], vr[1], vr[2], vr[3]);
+                cv::v_load_deinterleave(lmin + 4 * j, vlmin[0], vlmin[1], vlmin[2], vlmin[3]);
+                cv::v_load_deinterleave(lmax + 4 * j, vlmax[0], vlmax[1], vlmax[2], vlmax[3]);
+                cv::v_load_deinterleave(rmin + 4 * j, vrmin[0], vrmin[1], vrmin[2], vrmin[3]);
+                cv::v_load_deinterleave(rmax + 4 * j, vrmax[0], vrmax[1], vrmax[2], vrmax[3]);
+                cv::v_uint8 m = cv::vx_setzero_u8();
+                for (int k = 0; k < 4; k++)
+                {
+                    m = cv::v_max(m, cv::v_max(cv::v_max(vl[k] - vrmax[k], vrmin[k] - vl[k]), cv::v_max(vr[k] - vlmax[k], vlmin[k] - vr[k])));
+                }
+                cv::v_store(d + j, m);
+            }
+            cv::vx_cleanup();
+#endif
+            for (; j < left.cols; j++)
+            {
+                int m = 0;
+                for (int k = 4 * j; k < 4 * j + 4; k++)
+                {
+                    m = std::max(m, std::max(std::max(l[k] - rmax[k], rmin[k] - l[k]), std::max(r[k] - lmax[k], lmin[k] - r[k])));
+                }
+                d[j] = static_cast<uchar>(m);
+            }
+        }
+    });
+}
+
+const int align_coarse_size = 512;
+const int align_refine_size = 256;
+const double align_min_response = 0.05;
+
+// phase correlate a crop of `luma1` with the crop of `luma2` at the current estimate, to correct it by the residual
+bool refine_translation(const cv::Mat& luma1, const cv::Mat& luma2, cv::Point2d& estimate)
+{
+    const cv::Point shift(cvRound(estimate.x), cvRound(estimate.y));
+    const cv::Rect overlap = cv::Rect(0, 0, luma1.cols, luma1.rows) & cv::Rect(-shift.x, -shift.y, luma2.cols, luma2.rows);
+    const int crop = std::min(align_refine_size, std::min(overlap.width, overlap.height));
+    if (crop < 32)
+    {
+        return false;
+    }
+    const cv::Rect rect1(overlap.x + (overlap.width - crop) / 2, overlap.y + (overlap.height - crop) / 2, crop, crop);
+    const cv::Rect rect2(rect1.x + shift.x, rect1.y + shift.y, crop, crop);
+    cv::Mat window;
+    cv::createHanningWindow(window, cv::Size(crop, crop), CV_32F);
+    double response = 0;
+    const cv::Point2d residual = cv::phaseCorrelate(luma1(rect1).clone(), luma2(rect2).clone(), window, &response);
+    // the previous level was within a pixel there, so a larger residual is a spurious peak
+    if (response < align_min_response || std::abs(residual.x) > 2 || std::abs(residual.y) > 2)
+    {
+        return false;
+    }
+    estimate = cv::Point2d(shift.x + residual.x, shift.y + residual.y);
+    return true;
+}
+
+} // namespace
+
+uint64_t imcmp::hash_region(const cv::Mat& image, const cv::Rect& rect)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const size_t row_bytes = rect.width * image.elemSize();
+    for (int i = rect.y; i < rect.y + rect.height; i++)
+    {
+        const uchar* p = image.ptr(i, rect.x);
+        size_t j = 0;
+        for (; j + 8 <= row_bytes; j += 8)
+        {
+            uint64_t v;
+            memcpy(&v, p + j, 8);
+            h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+            h ^= h >> 32;
+        }
+        for (; j < row_bytes; j++)
+        {
+            h = (h ^ p[j]) * 0x100000001B3ULL;
+        }
+    }
+    return h;
+}
+
+void imcmp::convert_to_luma(const cv::Mat& image, cv::Mat& luma)
+{
+    cv::Mat gray;
+    switch (image.channels())
+    {
+    case 3:
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        break;
+    case 4:
+        cv::cvtColor(image, gray, cv::COLOR_BGRA2GRAY);
+        break;
+    default:
+        gray = image;
+        break;
+    }
+    gray.convertTo(luma, CV_32F);
+}
+
+bool imcmp::estimate_translation(const cv::Mat& left, const cv::Mat& right, cv::Point& offset)
+{
+    // phase correlation needs equal sizes, and shifts are small compared to the images
+    const cv::Rect common(0, 0, std::min(left.cols, right.cols), std::min(left.rows, right.rows));
+    if (common.width < 32 || common.height < 32)
+    {
+        return false;
+    }
+
+    std::vector<cv::Mat> levels1(1);
+    std::vector<cv::Mat> levels2(1);
+    convert_to_luma(left(common), levels1[0]);
+    convert_to_luma(right(common), levels2[0]);
+    while (std::max(levels1.back().cols, levels1.back().rows) > align_coarse_size)
+    {
+        const cv::Size half(levels1.back().cols / 2, levels1.back().rows / 2);
+        levels1.emplace_back();
+        levels2.emplace_back();
+        cv::resize(levels1[levels1.size() - 2], levels1.back(), half, 0, 0, cv::INTER_AREA);
+        cv::resize(levels2[levels2.size() - 2], levels2.back(), half, 0, 0, cv::INTER_AREA);
+    }
+
+    const int top = static_cast<int>(levels1.size()) - 1;
+    cv::Mat window;
+    cv::createHanningWindow(window, levels1[top].size(), CV_32F);
+    double response = 0;
+    cv::Point2d estimate = cv::phaseCorrelate(levels1[top], levels2[top], window, &response);
+    if (response < align_min_response)
+    {
+        return false;
+    }
+    for (int level = top - 1; level >= 0; level--)
+    {
+        estimate = cv::Point2d(estimate.x * 2, estimate.y * 2);
+        refine_translation(levels1[level], levels2[level], estimate);
+    }
+    offset = cv::Point(cvRound(estimate.x), cvRound(estimate.y));
+    return true;
+}
+
+cv::Mat imcmp::compare_aligned(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same, cv::Point& offset, DiffStats& stats)
+{
+    offset = cv::Point(0, 0);
+    if (image_left.type() != CV_8UC4 || image_right.type() != CV_8UC4)
+    {
+        return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+    }
+
+    estimate_translation(image_left, image_right, offset);
+    const cv::Rect overlap = cv::Rect(0, 0, image_left.cols, image_left.rows) & cv::Rect(-offset.x, -offset.y, image_right.cols, image_right.rows);
+    if (overlap.empty())
+    {
+        offset = cv::Point(0, 0);
+        return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+    }
+    const cv::Rect right_rect(overlap.x + offset.x, overlap.y + offset.y, overlap.width, overlap.height);
+    cv::Mat overlap_diff = compare_two_mat(image_left(overlap), image_right(right_rect), toleranceThresh, is_exactly_same, stats);
+
+    cv::Mat gray;
+    cv::Mat diff;
+    cv::cvtColor(image_left, gray, cv::COLOR_BGRA2GRAY);
+    gray.convertTo(gray, CV_8U, 0.5);
+    cv::cvtColor(gray, diff, cv::COLOR_GRAY2BGRA);
+    cv::Mat diff_overlap = diff(overlap);
+    overlap_diff.copyTo(diff_overlap);
+    is_exactly_same = is_exactly_same && offset == cv::Point(0, 0) && image_left.size() == image_right.size();
+    return diff;
+}
+
+double imcmp::DiffStats::mse(int channel) const
+{
+    return (pixels > 0) ? static_cast<double>(sqr_sum[channel]) / pixels : 0;
+}
+
+double imcmp::DiffStats::mae(int channel) const
+{
+    return (pixels > 0) ? static_cast<double>(abs_sum[channel]) / pixels : 0;
+}
+
+double imcmp::DiffStats::psnr(int channel) const
+{
+    return psnr_from_mse(mse(channel));
+}
+
+double imcmp::DiffStats::mse() const
+{
+    const int color_channels = std::min(channels, 3);
+    int64_t sum = 0;
+    for (int k = 0; k < color_channels; k++)
+    {
+        sum += sqr_sum[k];
+    }
+    const double samples = static_cast<double>(pixels) * color_channels;
+    return (samples > 0) ? sum / samples : 0;
+}
+
+double imcmp::DiffStats::mae() const
+{
+    const int color_channels = std::min(channels, 3);
+    int64_t sum = 0;
+    for (int k = 0; k < color_channels; k++)
+    {
+        sum += abs_sum[k];
+    }
+    const double samples = static_cast<double>(pixels) * color_channels;
+    return (samples > 0) ? sum / samples : 0;
+}
+
+double imcmp::DiffStats::psnr() const
+{
+    return psnr_from_mse(mse());
+}
+
+void imcmp::DiffStats::merge(const DiffStats& other)
+{
+    channels = std::max(channels, other.channels);
+    pixels += other.pixels;
+    diff_pixels += other.diff_pixels;
+    max_delta = std::max(max_delta, other.max_delta);
+    for (int k = 0; k < 4; k++)
+    {
+        abs_sum[k] += other.abs_sum[k];
+        sqr_sum[k] += other.sqr_sum[k];
+        channel_max[k] = std::max(channel_max[k], other.channel_max[k]);
+    }
+    for (int d = 0; d < 256; d++)
+    {
+        histogram[d] += other.histogram[d];
+    }
+}
+
+void imcmp::render_delta(const cv::Mat& delta, const cv::Mat& display, double thresh, cv::Mat& diff)
+{
+    cv::Mat gray;
+    cv::cvtColor(display, gray, cv::COLOR_BGRA2GRAY);
+    cv::cvtColor(gray, diff, cv::COLOR_GRAY2BGRA);
+    diff.setTo(cv::Scalar(below_color.val[0], below_color.val[1], below_color.val[2], 255), delta > 0);
+    diff.setTo(cv::Scalar(above_color.val[0], above_color.val[1], above_color.val[2], 255), delta > thresh);
+}
 
 void imcmp::getDiffImage(const cv::Mat& src1, const cv::Mat& src2, cv::Mat& diff, int thresh, cv::Scalar below, cv::Scalar above)
 {
@@ -66,6 +515,13 @@ void imcmp::getDiffImage(const cv::Mat& src1, const cv::Mat& src2, cv::Mat& diff
 
 cv::Mat imcmp::compare_two_mat(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same)
 {
+    DiffStats stats;
+    return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+}
+
+cv::Mat imcmp::compare_two_mat(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same, DiffStats& stats)
+{
+    stats = DiffStats();
     if (image_left.channels() != 4 || image_right.channels() != 4)
     {
         fprintf(stderr, "only support BGRA image for comparision\n");
@@ -93,7 +549,6 @@ cv::Mat imcmp::compare_two_mat(const cv::Mat& image_left, const cv::Mat& image_r
     }
     else
     {
-        cv::Scalar pixel_diff;
         cv::Mat diff_image_left;
         cv::Mat diff_image_right;
         cv::Mat diff_image_compare;
@@ -148,50 +603,510 @@ cv::Mat imcmp::compare_two_mat(const cv::Mat& image_left, const cv::Mat& image_r
             diff_image_compare = image_compare;
         }
 
-        cv::absdiff(diff_image_left, diff_image_right, diff_image_compare);
-        pixel_diff = cv::sum(diff_image_compare);
-        int sum = pixel_diff.val[0] + pixel_diff.val[1] + pixel_diff.val[2] + pixel_diff.val[3];
-        //cv::setNumThreads(1);
+        // rendering and statistics in one pass, instead of absdiff, sum and getDiffImage
+        diff_with_stats(diff_image_left, diff_image_right, &diff_image_compare, toleranceThresh, stats);
+        is_exactly_same = (stats.max_delta == 0);
+        if (is_exactly_same)
+        {
+            fill_gray(diff_image_left, diff_image_compare);
+        }
+
+        diff = image_compare.clone();
+    }
 
-        if (sum == 0)
+    return diff;
+}
+
+cv::Mat imcmp::compare_marked_blocks(const cv::Mat& image_left, const cv::Mat& image_right, const cv::Mat& block_map, int block_size, int toleranceThresh, bool& is_exactly_same, DiffStats& stats, const CompareMask* mask)
+{
+    CV_Assert(image_left.size() == image_right.size() && image_left.type() == CV_8UC4 && image_right.type() == CV_8UC4);
+    CV_Assert(block_map.type() == CV_8UC1 && block_size > 0);
+    CV_Assert(!mask || mask->size() == image_left.size());
+
+    cv::Mat gray;
+    cv::Mat diff;
+    cv::cvtColor(image_left, gray, cv::COLOR_BGRA2GRAY);
+    cv::cvtColor(gray, diff, cv::COLOR_GRAY2BGRA);
+
+    // marked blocks may still decode to equal pixels, so the verdict comes from the pixels
+    std::mutex mutex;
+    stats = DiffStats();
+    const cv::Rect image_rect(0, 0, image_left.cols, image_left.rows);
+    cv::parallel_for_(cv::Range(0, block_map.rows), [&](const cv::Range& range) {
+        DiffStats local;
+        std::vector<cv::Range> spans;
+        for (int i = range.start; i < range.end; i++)
         {
-            // if the left and right image is differnt size, but same in the overlaped region, we compute the gray image, but assign to RGB pixels
-            cv::Size diff_size = diff_image_compare.size();
-            for (int i = 0; i < diff_size.height; i++)
+            const uchar* marked = block_map.ptr(i);
+            for (int j = 0; j < block_map.cols; j++)
             {
-                for (int j = 0; j < diff_size.width; j++)
+                const cv::Rect rect = cv::Rect(j * block_size, i * block_size, block_size, block_size) & image_rect;
+                if (!marked[j] || rect.empty() || (mask && mask->is_fully_ignored(rect)) || cv::norm(image_left(rect), image_right(rect), cv::NORM_INF) == 0)
                 {
-                    float R2Y = 0.299;
-                    float G2Y = 0.587;
-                    float B2Y = 0.114;
-                    int B = diff_image_left.ptr(i, j)[0];
-                    int G = diff_image_left.ptr(i, j)[1];
-                    int R = diff_image_left.ptr(i, j)[2];
-                    int gray = cv::saturate_cast<uchar>(R2Y * R + G2Y * G + B2Y * B);
-
-                    diff_image_compare.ptr(i, j)[0] = gray;
-                    diff_image_compare.ptr(i, j)[1] = gray;
-                    diff_image_compare.ptr(i, j)[2] = gray;
-                    diff_image_compare.ptr(i, j)[3] = 255;
+                    continue;
+                }
+                if (!mask)
+                {
+                    cv::Mat block_diff = diff(rect);
+                    accumulate_diff(image_left(rect), image_right(rect), &block_diff, toleranceThresh, local);
+                    continue;
+                }
+                // same spans as compare_masked(), so both give the same stats
+                for (int y = rect.y; y < rect.y + rect.height; y++)
+                {
+                    spans.clear();
+                    mask->unmasked_spans(y, rect.x, rect.x + rect.width, spans);
+                    for (const cv::Range& span : spans)
+                    {
+                        accumulate_diff_row<4>(image_left.ptr(y, span.start), image_right.ptr(y, span.start), diff.ptr(y, span.start), span.size(), toleranceThresh, local);
+                        local.pixels += span.size();
+                    }
                 }
             }
-            is_exactly_same = true;
         }
-        else
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.merge(local);
+    });
+    // the pixels of the other blocks are identical
+    const int64_t total = static_cast<int64_t>(image_left.total()) - (mask ? mask->ignored_pixels() : 0);
+    stats.channels = 4;
+    stats.histogram[0] += total - stats.pixels;
+    stats.pixels = total;
+    if (mask)
+    {
+        diff.setTo(ignored_color, mask->to_mat());
+    }
+    finish_stats(stats, toleranceThresh);
+    is_exactly_same = (stats.max_delta == 0);
+    return diff;
+}
+
+cv::Mat imcmp::compare_neighborhood(const cv::Mat& image_left, const cv::Mat& image_right, int radius, int toleranceThresh, bool& is_exactly_same, int64_t& diff_pixels)
+{
+    if (image_left.size() != image_right.size() || image_left.type() != CV_8UC4 || image_right.type() != CV_8UC4 || radius < 0)
+    {
+        fprintf(stderr, "neighborhood compare requires BGRA images of same size\n");
+        return cv::Mat();
+    }
+
+    // rectangular kernels are applied as a row pass and a column pass
+    const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * radius + 1, 2 * radius + 1));
+    cv::Mat left_min, left_max, right_min, right_max;
+    cv::erode(image_left, left_min, kernel);
+    cv::dilate(image_left, left_max, kernel);
+    cv::erode(image_right, right_min, kernel);
+    cv::dilate(image_right, right_max, kernel);
+
+    cv::Mat delta;
+    envelope_delta(image_left, image_right, left_min, left_max, right_min, right_max, delta);
+    is_exactly_same = (cv::norm(image_left, image_right, cv::NORM_INF) == 0);
+    diff_pixels = cv::countNonZero(delta > toleranceThresh);
+
+    cv::Mat diff;
+    render_delta(delta, image_left, toleranceThresh, diff);
+    return diff;
+}
+
+void imcmp::compute_diff_stats(const cv::Mat& src1, const cv::Mat& src2, int thresh, DiffStats& stats)
+{
+    CV_Assert(src1.size() == src2.size() && src1.type() == src2.type() && src1.depth() == CV_8U && src1.channels() <= 4);
+    diff_with_stats(src1, src2, NULL, thresh, stats);
+}
+
+void imcmp::compute_diff_metrics(const cv::Mat& src1, const cv::Mat& src2, int thresh, int64_t& diff_pixels, int& max_delta, double& psnr)
+{
+    DiffStats stats;
+    compute_diff_stats(src1, src2, thresh, stats);
+    diff_pixels = stats.diff_pixels;
+    max_delta = stats.max_delta;
+    psnr = stats.psnr();
+}
+
+imcmp::CompareVerdict imcmp::compare_verdict(const cv::Mat& src1, const cv::Mat& src2, int toleranceThresh, int64_t budget, int hard_cap, const CompareMask* mask)
+{
+    CV_Assert(src1.size() == src2.size() && src1.type() == src2.type() && src1.depth() == CV_8U && src1.channels() <= 4);
+    CV_Assert(!mask || mask->empty() || mask->size() == src1.size());
+    if (mask && mask->empty())
+    {
+        mask = NULL;
+    }
+
+    std::atomic<bool> failed(false);
+    std::atomic<int64_t> diff_pixels(0);
+    std::atomic<int> max_delta(0);
+    std::atomic<int> scanned_rows(0);
+    const int strips = (src1.rows + verdict_strip_rows - 1) / verdict_strip_rows;
+    cv::parallel_for_(cv::Range(0, strips), [&](const cv::Range& range) {
+        std::vector<uchar> delta(src1.cols);
+        std::vector<cv::Range> spans(1, cv::Range(0, src1.cols));
+        for (int s = range.start; s < range.end && !failed.load(std::memory_order_relaxed); s++)
         {
-            cv::Scalar above_color(0, 0, 255 - 50);
-            cv::Scalar below_color(255 - 50, 0, 0);
-            imcmp::getDiffImage(diff_image_left, diff_image_right, diff_image_compare, toleranceThresh, below_color, above_color);
-            is_exactly_same = false;
+            const int y0 = s * verdict_strip_rows;
+            const int y1 = std::min(y0 + verdict_strip_rows, src1.rows);
+            int64_t count = 0;
+            int strip_max = 0;
+            for (int y = y0; y < y1; y++)
+            {
+                max_channel_absdiff_row(src1.ptr<uchar>(y), src2.ptr<uchar>(y), delta.data(), src1.cols, src1.channels());
+                if (mask)
+                {
+                    spans.clear();
+                    mask->unmasked_spans(y, 0, src1.cols, spans);
+                }
+                for (const cv::Range& span : spans)
+                {
+                    for (int j = span.start; j < span.end; j++)
+                    {
+                        strip_max = std::max(strip_max, static_cast<int>(delta[j]));
+                        count += (delta[j] > toleranceThresh);
+                    }
+                }
+            }
+            const int64_t total = diff_pixels.fetch_add(count) + count;
+            int seen = max_delta.load();
+            while (strip_max > seen && !max_delta.compare_exchange_weak(seen, strip_max))
+            {
+            }
+            scanned_rows.fetch_add(y1 - y0);
+            if (total > budget || (hard_cap >= 0 && strip_max > hard_cap))
+            {
+                failed.store(true);
+            }
         }
+    });
 
-        diff = image_compare.clone();
-        printf("Compare get pixel diff: (%d, %d, %d) with thresh %d\n",
-               (int)pixel_diff.val[0],
-               (int)pixel_diff.val[1],
-               (int)pixel_diff.val[2],
-               toleranceThresh);
+    CompareVerdict verdict;
+    verdict.passed = !failed.load();
+    verdict.stopped_early = (scanned_rows.load() < src1.rows);
+    verdict.diff_pixels = diff_pixels.load();
+    verdict.max_delta = max_delta.load();
+    return verdict;
+}
+
+void imcmp::max_channel_absdiff_row(const uchar* src1, const uchar* src2, uchar* delta, int cols, int cn)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    if (cn == 4)
+    {
+        for (; j + step <= cols; j += step)
+        {
+            cv::v_uint8 a0, a1, a2, a3, b0, b1, b2, b3;
+            cv::v_load_deinterleave(src1 + j * 4, a0, a1, a2, a3);
+            cv::v_load_deinterleave(src2 + j * 4, b0, b1, b2, b3);
+            const cv::v_uint8 d01 = cv::v_max(cv::v_absdiff(a0, b0), cv::v_absdiff(a1, b1));
+            const cv::v_uint8 d23 = cv::v_max(cv::v_absdiff(a2, b2), cv::v_absdiff(a3, b3));
+            cv::v_store(delta + j, cv::v_max(d01, d23));
+        }
+    }
+    else if (cn == 1)
+    {
+        for (; j + step <= cols; j += step)
+        {
+            cv::v_store(delta + j, cv::v_absdiff(cv::vx_load(src1 + j), cv::vx_load(src2 + j)));
+        }
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < cols; j++)
+    {
+        int d = 0;
+        for (int k = 0; k < cn; k++)
+        {
+            d = std::max(d, std::abs(src1[j * cn + k] - src2[j * cn + k]));
+        }
+        delta[j] = static_cast<uchar>(d);
+    }
+}
+
+void imcmp::max_channel_absdiff_16u(const cv::Mat& src1, const cv::Mat& src2, cv::Mat& delta)
+{
+    CV_Assert(src1.size() == src2.size() && src1.type() == src2.type() && src1.depth() == CV_16U);
+    CV_Assert(src1.channels() == 1 || src1.channels() == 3);
+
+    if (src1.channels() == 1)
+    {
+        cv::absdiff(src1, src2, delta);
+        return;
+    }
+
+    delta.create(src1.size(), CV_16UC1);
+    cv::parallel_for_(cv::Range(0, src1.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            const ushort* p1 = src1.ptr<ushort>(i);
+            const ushort* p2 = src2.ptr<ushort>(i);
+            ushort* d = delta.ptr<ushort>(i);
+            int j = 0;
+#if CV_SIMD
+            const int step = cv::v_uint16::nlanes;
+            for (; j + step <= src1.cols; j += step)
+            {
+                cv::v_uint16 a0, a1, a2, b0, b1, b2;
+                cv::v_load_deinterleave(p1 + 3 * j, a0, a1, a2);
+                cv::v_load_deinterleave(p2 + 3 * j, b0, b1, b2);
+                cv::v_store(d + j, cv::v_max(cv::v_absdiff(a0, b0), cv::v_max(cv::v_absdiff(a1, b1), cv::v_absdiff(a2, b2))));
+            }
+            cv::vx_cleanup();
+#endif
+            for (; j < src1.cols; j++)
+            {
+                int m = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    m = std::max(m, std::abs(p1[3 * j + k] - p2[3 * j + k]));
+                }
+                d[j] = m;
+            }
+        }
+    });
+}
+
+cv::Mat imcmp::compare_native_mat(const cv::Mat& native_left, const cv::Mat& native_right, const cv::Mat& display_left, int toleranceThresh, bool& is_exactly_same, const CompareMask* mask)
+{
+    if (native_left.size() != native_right.size() || native_left.type() != native_right.type() || display_left.size() != native_left.size()
+        || (mask && mask->size() != native_left.size()))
+    {
+        fprintf(stderr, "native compare requires same size and format\n");
+        return cv::Mat();
+    }
+
+    // one vectorized pass over the 16-bit samples, then mask ops which are as cheap as on 8-bit
+    cv::Mat delta;
+    max_channel_absdiff_16u(native_left, native_right, delta);
+    cv::Mat ignored;
+    if (mask)
+    {
+        ignored = mask->to_mat();
+        delta.setTo(0, ignored);
+    }
+    is_exactly_same = (cv::countNonZero(delta) == 0);
+
+    cv::Mat diff;
+    render_delta(delta, display_left, toleranceThresh, diff);
+    if (!ignored.empty())
+    {
+        diff.setTo(ignored_color, ignored);
+    }
+    return diff;
+}
+
+cv::Mat imcmp::compare_mosaic(const cv::Mat& mosaic_left, const cv::Mat& mosaic_right, const cv::Mat& display_left, int toleranceThresh, bool& is_exactly_same, CfaDiffStats& stats, const CompareMask* mask)
+{
+    if (mosaic_left.size() != mosaic_right.size() || mosaic_left.type() != mosaic_right.type() || display_left.size() != mosaic_left.size()
+        || (mosaic_left.type() != CV_8UC1 && mosaic_left.type() != CV_16UC1) || (mask && mask->size() != mosaic_left.size()))
+    {
+        fprintf(stderr, "mosaic compare requires single channel mosaics of same size and format\n");
+        return cv::Mat();
+    }
+
+    // a single plane pass: each sample only ever meets the same CFA site of the other side
+    cv::Mat delta;
+    cv::absdiff(mosaic_left, mosaic_right, delta);
+    cv::Mat ignored;
+    if (mask)
+    {
+        ignored = mask->to_mat();
+        delta.setTo(0, ignored);
+    }
+    stats = CfaDiffStats();
+    if (delta.depth() == CV_8U)
+        accumulate_cfa_stats<uchar>(delta, toleranceThresh, stats);
+    else
+        accumulate_cfa_stats<ushort>(delta, toleranceThresh, stats);
+
+    is_exactly_same = true;
+    for (int k = 0; k < 4; k++)
+    {
+        is_exactly_same &= (stats.max_delta[k] == 0);
+    }
+
+    cv::Mat diff;
+    render_delta(delta, display_left, toleranceThresh, diff);
+    if (!ignored.empty())
+    {
+        diff.setTo(ignored_color, ignored);
+    }
+    return diff;
+}
+
+cv::Mat imcmp::IncrementalComparer::compare(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same)
+{
+    DiffStats stats;
+    return compare(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+}
+
+cv::Mat imcmp::IncrementalComparer::compare(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same, DiffStats& stats)
+{
+    const bool cacheable = !image_left.empty() && !image_right.empty()
+                           && image_left.type() == CV_8UC4 && image_right.type() == CV_8UC4
+                           && image_left.size() == image_right.size();
+    if (!cacheable)
+    {
+        reset();
+        return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+    }
+
+    const std::vector<cv::Rect> tiles = make_tiles(image_left.size(), tile_size);
+    const bool warm = !last_diff.empty() && last_diff.size() == image_left.size() && last_thresh == toleranceThresh;
+    if (!warm)
+    {
+        reset();
+    }
+
+    // a side whose buffer did not change keeps its hashes; we hold a reference to it, so its address can't be reused
+    std::vector<uint64_t> new_left_hashes = (warm && image_left.data == last_left.data) ? left_hashes : compute_tile_hashes(image_left, tiles);
+    std::vector<uint64_t> new_right_hashes = (warm && image_right.data == last_right.data) ? right_hashes : compute_tile_hashes(image_right, tiles);
+
+    // the previous diff may still be displayed, so update a copy of it
+    cv::Mat diff;
+    if (warm)
+    {
+        diff = last_diff.clone();
+    }
+    else
+    {
+        diff.create(image_left.size(), CV_8UC4);
+        tile_stats.assign(tiles.size(), DiffStats());
+    }
+
+    std::vector<int> dirty_tiles;
+    for (int t = 0; t < tiles.size(); t++)
+    {
+        if (!warm || new_left_hashes[t] != left_hashes[t] || new_right_hashes[t] != right_hashes[t])
+        {
+            dirty_tiles.push_back(t);
+        }
+    }
+    const int dirty_count = static_cast<int>(dirty_tiles.size());
+
+    cv::parallel_for_(cv::Range(0, dirty_count), [&](const cv::Range& range) {
+        for (int k = range.start; k < range.end; k++)
+        {
+            const int t = dirty_tiles[k];
+            const cv::Rect& rect = tiles[t];
+            cv::Mat diff_tile = diff(rect);
+            tile_stats[t] = DiffStats();
+            accumulate_diff(image_left(rect), image_right(rect), &diff_tile, toleranceThresh, tile_stats[t]);
+        }
+    });
+
+    last_left = image_left;
+    last_right = image_right;
+    last_diff = diff;
+    last_thresh = toleranceThresh;
+    left_hashes.swap(new_left_hashes);
+    right_hashes.swap(new_right_hashes);
+
+    stats = DiffStats();
+    for (int t = 0; t < tile_stats.size(); t++)
+    {
+        stats.merge(tile_stats[t]);
     }
+    finish_stats(stats, toleranceThresh);
+    is_exactly_same = (stats.max_delta == 0);
 
+    if (is_exactly_same)
+    {
+        // same as compare_two_mat(): show the gray image, but keep last_diff as the per-tile rendering
+        cv::Mat gray(image_left.size(), CV_8UC4);
+        fill_gray(image_left, gray);
+        return gray;
+    }
     return diff;
 }
+
+void imcmp::IncrementalComparer::reset()
+{
+    last_left.release();
+    last_right.release();
+    last_diff.release();
+    last_thresh = -1;
+    left_hashes.clear();
+    right_hashes.clear();
+    tile_stats.clear();
+}
+
+cv::Mat imcmp::compare_masked(const cv::Mat& image_left, const cv::Mat& image_right, const CompareMask& mask, int toleranceThresh, bool& is_exactly_same, DiffStats& stats)
+{
+    if (image_left.type() != CV_8UC4 || image_right.type() != CV_8UC4 || image_left.size() != image_right.size() || mask.size() != image_left.size())
+    {
+        fprintf(stderr, "masked compare requires BGRA images and a mask of the same size, compared without the mask\n");
+        return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+    }
+
+    stats = DiffStats();
+    stats.channels = 4;
+    cv::Mat diff(image_left.size(), CV_8UC4);
+    const std::vector<cv::Rect> tiles = make_tiles(image_left.size(), mask_tile_size);
+    std::mutex mutex;
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range& range) {
+        DiffStats local;
+        std::vector<cv::Range> spans;
+        for (int t = range.start; t < range.end; t++)
+        {
+            const cv::Rect& tile = tiles[t];
+            if (mask.is_fully_ignored(tile))
+            {
+                diff(tile).setTo(ignored_color);
+                continue;
+            }
+            for (int i = tile.y; i < tile.y + tile.height; i++)
+            {
+                spans.clear();
+                mask.unmasked_spans(i, tile.x, tile.x + tile.width, spans);
+                cv::Vec4b* d = diff.ptr<cv::Vec4b>(i);
+                int x = tile.x;
+                for (const cv::Range& span : spans)
+                {
+                    std::fill(d + x, d + span.start, ignored_color);
+                    accumulate_diff_row<4>(image_left.ptr(i, span.start), image_right.ptr(i, span.start), diff.ptr(i, span.start), span.size(), toleranceThresh, local);
+                    local.pixels += span.size();
+                    x = span.end;
+                }
+                std::fill(d + x, d + tile.x + tile.width, ignored_color);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.merge(local);
+    });
+    finish_stats(stats, toleranceThresh);
+    is_exactly_same = (stats.max_delta == 0);
+    return diff;
+}
+
+void imcmp::resample(const cv::Mat& src, const cv::Size& size, ResampleFilter filter, cv::Mat& dst)
+{
+    const int interpolation = (filter == ResampleFilter::Area) ? cv::INTER_AREA : (filter == ResampleFilter::Bilinear) ? cv::INTER_LINEAR : cv::INTER_LANCZOS4;
+    cv::resize(src, dst, size, 0, 0, interpolation);
+}
+
+cv::Mat imcmp::ResampledComparer::compare(const cv::Mat& image_left, const cv::Mat& image_right, ResampleFilter filter, int toleranceThresh, bool& is_exactly_same, DiffStats& stats)
+{
+    if (image_left.empty() || image_right.empty() || image_left.type() != CV_8UC4 || image_right.type() != CV_8UC4)
+    {
+        return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+    }
+
+    cv::Mat right = image_right;
+    if (image_right.size() != image_left.size())
+    {
+        resample(image_right, image_left.size(), filter, resampled);
+        right = resampled;
+    }
+
+    cv::Mat diff(image_left.size(), CV_8UC4);
+    diff_with_stats(image_left, right, &diff, toleranceThresh, stats);
+    is_exactly_same = (stats.max_delta == 0) && image_left.size() == image_right.size();
+    if (stats.max_delta == 0)
+    {
+        fill_gray(image_left, diff);
+    }
+    return diff;
+}
+
+void imcmp::ResampledComparer::reset()
+{
+    resampled.release();
+}
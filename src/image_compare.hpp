@@ -4,7 +4,192 @@
 
 namespace imcmp {
 
+/// @brief what the diff image shows
+enum class CompareMode
+{
+    Tolerance, // pixels differing above the tolerance in red, below it in blue
+    Ssim,      // heatmap of the luma SSIM map, see compare_ssim()
+    DeltaE76,  // tolerance in CIELAB deltaE units, see compute_delta_e()
+    DeltaE94,
+    DeltaE2000,
+    Neighborhood, // tolerance against the neighbors within a radius, see compare_neighborhood()
+    Aligned,      // tolerance after undoing a global translation, see compare_aligned()
+    Structural,   // tolerance of the rows paired after inserted or removed rows, see compare_structural()
+    Resampled,    // tolerance after resizing the right image to the left one, see ResampledComparer
+    NoiseModel,   // the right image against the per pixel noise floor of reference captures, see NoiseModel
+};
+
+class CompareMask;
+
+/// @brief luma of an 8-bit gray, BGR or BGRA image as CV_32FC1, in [0, 255]
+void convert_to_luma(const cv::Mat& image, cv::Mat& luma);
+
+/// @brief statistics of the absolute differences of two 8-bit images, gathered in the same pass as the diff image
+///
+/// Per channel values are indexed by channel; the overall MSE, PSNR and MAE are over the color channels only,
+/// since raw inputs are loaded as BGRA with opaque alpha, which should not inflate PSNR.
+class DiffStats
+{
+public:
+    int channels = 0;
+    int64_t pixels = 0;
+    int64_t diff_pixels = 0; // whose any channel differs by more than the tolerance
+    int max_delta = 0;
+    int64_t abs_sum[4] = {0, 0, 0, 0};
+    int64_t sqr_sum[4] = {0, 0, 0, 0};
+    int channel_max[4] = {0, 0, 0, 0};
+    int64_t histogram[256] = {}; // pixels by their max channel delta
+
+    double mse(int channel) const;
+    double mae(int channel) const;
+    double psnr(int channel) const; // infinity if identical
+    double mse() const;
+    double mae() const;
+    double psnr() const;
+    void merge(const DiffStats& other);
+};
+
 void getDiffImage(const cv::Mat& src1, const cv::Mat& src2, cv::Mat& diff, int thresh, cv::Scalar below, cv::Scalar above);
+/// @brief gray rendering of BGRA `display`, with the pixels whose single channel `delta` is non zero in blue, and above `thresh` in red
+void render_delta(const cv::Mat& delta, const cv::Mat& display, double thresh, cv::Mat& diff);
 cv::Mat compare_two_mat(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same);
+/// @brief compare_two_mat() which also returns the DiffStats of the overlapped region
+cv::Mat compare_two_mat(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same, DiffStats& stats);
+
+/// @brief compare_two_mat() of same-sized BGRA images, only diffing the blocks marked non zero in `block_map`
+/// `block_map` has one element per `block_size` x `block_size` block, e.g. from compare_jpeg_coefficients();
+/// pixels of unmarked blocks are known to be identical and rendered gray. Pixels ignored by `mask`, if any,
+/// are skipped as in compare_masked().
+cv::Mat compare_marked_blocks(const cv::Mat& image_left, const cv::Mat& image_right, const cv::Mat& block_map, int block_size, int toleranceThresh, bool& is_exactly_same, DiffStats& stats, const CompareMask* mask = NULL);
+
+/// @brief compare_two_mat() of same-sized BGRA images which forgives shifts of up to `radius` pixels, e.g. anti-aliasing or sub-pixel jitter
+///
+/// A pixel matches if each of its channels is within `toleranceThresh` of the min/max envelope of that channel over the
+/// (2 * radius + 1)^2 window of the other image, checked both ways. The envelopes come from separable erode/dilate, so the
+/// cost grows little with the radius. Channels are enveloped independently, so this is slightly more lenient than requiring
+/// a single neighbor to match on all channels. `diff_pixels` counts the pixels that don't match.
+cv::Mat compare_neighborhood(const cv::Mat& image_left, const cv::Mat& image_right, int radius, int toleranceThresh, bool& is_exactly_same, int64_t& diff_pixels);
+
+/// @brief estimate the translation of `right` relative to `left`, i.e. right(x + offset.x, y + offset.y) shows left(x, y)
+///
+/// Phase correlation of luma on a downsampled level of at most 512 pixels wide, then refined level by level up to full
+/// resolution by phase correlating 256 x 256 crops at the current estimate, so the cost is dominated by the downsampling.
+/// @return false if no confident peak was found, e.g. for unrelated or flat images
+bool estimate_translation(const cv::Mat& left, const cv::Mat& right, cv::Point& offset);
+
+/// @brief compare_two_mat() of the overlap of two 8-bit BGRA images after estimate_translation()
+/// The diff image has the size of `image_left`; its part not covered by the shifted right image is dimmed.
+/// `is_exactly_same` is only true without offset, for equal sizes and identical overlap.
+cv::Mat compare_aligned(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same, cv::Point& offset, DiffStats& stats);
+
+/// @brief compare_two_mat() of same-sized BGRA images which skips the pixels ignored by `mask`, e.g. timestamps
+///
+/// Work is split in 64 x 64 tiles; fully ignored tiles are only filled, and the others are diffed span by span
+/// of pixels which are not ignored. Ignored pixels are drawn dark and left out of `stats`.
+cv::Mat compare_masked(const cv::Mat& image_left, const cv::Mat& image_right, const CompareMask& mask, int toleranceThresh, bool& is_exactly_same, DiffStats& stats);
+
+/// @brief 64-bit hash of the pixels of `rect`, equal for regions with identical bytes
+uint64_t hash_region(const cv::Mat& image, const cv::Rect& rect);
+
+/// @brief DiffStats of two 8-bit images of the same size and type, with 1 to 4 channels, without a diff image
+void compute_diff_stats(const cv::Mat& src1, const cv::Mat& src2, int thresh, DiffStats& stats);
+
+/// @brief count pixels whose any channel differs by more than `thresh`, max channel delta and PSNR (infinity if identical)
+/// src1 and src2 are 8-bit images of the same size and type
+void compute_diff_metrics(const cv::Mat& src1, const cv::Mat& src2, int thresh, int64_t& diff_pixels, int& max_delta, double& psnr);
+
+/// @brief result of compare_verdict()
+class CompareVerdict
+{
+public:
+    bool passed = true;
+    bool stopped_early = false; // failed before all rows were scanned
+    int64_t diff_pixels = 0;    // above the tolerance in the scanned rows, so only a lower bound if stopped early
+    int max_delta = 0;          // of the scanned rows
+};
+
+/// @brief pass/fail of two 8-bit images of the same size and type, with 1 to 4 channels, e.g. for CI gating
+///
+/// Fails if more than `budget` pixels differ by more than `toleranceThresh`, or any pixel by more than `hard_cap`
+/// (negative for no cap). Strips of rows are scanned in parallel into shared atomic counters, and all workers stop
+/// once the pair is known to fail; no diff image or statistics are built. Pixels ignored by `mask`, if not NULL, are
+/// skipped.
+CompareVerdict compare_verdict(const cv::Mat& src1, const cv::Mat& src2, int toleranceThresh, int64_t budget, int hard_cap, const CompareMask* mask = NULL);
+
+/// @brief per pixel max channel absolute difference of a row of `cols` 8-bit pixels of `cn` channels, vectorized for 1 and 4
+void max_channel_absdiff_row(const uchar* src1, const uchar* src2, uchar* delta, int cols, int cn);
+
+/// @brief per pixel max channel absolute difference of two CV_16UC1 or CV_16UC3 images, to CV_16UC1 `delta`
+void max_channel_absdiff_16u(const cv::Mat& src1, const cv::Mat& src2, cv::Mat& delta);
+
+/// @brief compare_two_mat() for high bit depth images in native units, e.g. loaded by load_native_frame()
+/// `toleranceThresh` is in native units too; `display_left` is the 8-bit BGRA rendering of `native_left`,
+/// used for the gray background of the diff image. Pixels ignored by `mask`, if any, count as equal and are drawn dark.
+cv::Mat compare_native_mat(const cv::Mat& native_left, const cv::Mat& native_right, const cv::Mat& display_left, int toleranceThresh, bool& is_exactly_same, const CompareMask* mask = NULL);
+
+/// @brief per CFA site results of compare_mosaic(), indexed by (row & 1) * 2 + (col & 1)
+class CfaDiffStats
+{
+public:
+    int64_t diff_pixels[4] = {0, 0, 0, 0}; // above the tolerance
+    int max_delta[4] = {0, 0, 0, 0};
+};
+
+/// @brief compare two Bayer mosaics (CV_8UC1 or CV_16UC1) directly, without demosaicing them
+/// Each sample is compared with the same site of the other side in one pass over the plane, and
+/// the results are also split by CFA site. `display_left` is the demosaiced BGRA rendering of `mosaic_left`.
+/// Samples ignored by `mask`, if any, count as equal and are drawn dark.
+cv::Mat compare_mosaic(const cv::Mat& mosaic_left, const cv::Mat& mosaic_right, const cv::Mat& display_left, int toleranceThresh, bool& is_exactly_same, CfaDiffStats& stats, const CompareMask* mask = NULL);
+
+/// @brief compare_two_mat() that remembers the last compared pair
+///
+/// Both inputs are cut into tiles and each tile is hashed. When the same-sized
+/// pair is compared again (e.g. one side was reloaded after its file changed),
+/// only tiles whose hash changed on either side are re-diffed; the other tiles
+/// are taken from the previous diff image.
+class IncrementalComparer
+{
+public:
+    cv::Mat compare(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same);
+    /// @brief compare() which also returns the DiffStats, merged from the kept per-tile statistics
+    cv::Mat compare(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool& is_exactly_same, DiffStats& stats);
+    void reset();
+
+private:
+    static const int tile_size = 64;
+
+    cv::Mat last_left;
+    cv::Mat last_right;
+    cv::Mat last_diff;
+    int last_thresh = -1;
+    std::vector<uint64_t> left_hashes;
+    std::vector<uint64_t> right_hashes;
+    std::vector<DiffStats> tile_stats;
+};
+
+enum class ResampleFilter
+{
+    Area,     // pixel area averaging, the usual choice for downscaling
+    Bilinear,
+    Lanczos,  // 8x8 Lanczos window
+};
+
+/// @brief cv::resize() of `src` to `size` with `filter`; `dst` is reused if it already has that size and type
+void resample(const cv::Mat& src, const cv::Size& size, ResampleFilter filter, cv::Mat& dst);
+
+/// @brief compare_two_mat() of two 8-bit BGRA images of different resolutions, e.g. a 2x or 0.5x export of the other
+///
+/// The right image is resized to the size of the left one by resample(), which is vectorized and runs in parallel,
+/// into a buffer kept across compares, then diffed with it in one pass; no other copy of the right image is made.
+/// `is_exactly_same` is only true for equal sizes and identical pixels.
+class ResampledComparer
+{
+public:
+    cv::Mat compare(const cv::Mat& image_left, const cv::Mat& image_right, ResampleFilter filter, int toleranceThresh, bool& is_exactly_same, DiffStats& stats);
+    void reset();
+
+private:
+    cv::Mat resampled;
+};
 
 } // namespace imcmp
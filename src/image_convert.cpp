@@ -0,0 +1,287 @@
+#include "image_convert.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <vector>
+
+namespace {
+
+// BT.601 limited range in Q14, e.g. CY = 1.164 * (1 << 14)
+const int SHIFT = 14;
+const int CY = 19071;
+const int CVR = 26149;
+const int CVG = -13320;
+const int CUG = -6406;
+const int CUB = 33063;
+const int ROUND = 1 << (SHIFT - 1);
+
+inline void yuv_to_bgra_pixel(int Y, int U, int V, uchar* bgra)
+{
+    const int y = std::max(0, Y - 16) * CY + ROUND;
+    const int u = U - 128;
+    const int v = V - 128;
+    bgra[0] = cv::saturate_cast<uchar>((y + CUB * u) >> SHIFT);
+    bgra[1] = cv::saturate_cast<uchar>((y + CVG * v + CUG * u) >> SHIFT);
+    bgra[2] = cv::saturate_cast<uchar>((y + CVR * v) >> SHIFT);
+    bgra[3] = 255;
+}
+
+// duplicate each chroma sample horizontally
+void upsample_row_x2(const uchar* src, uchar* dst, int dst_width)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    for (; j + 2 * step <= dst_width; j += 2 * step)
+    {
+        cv::v_uint8 c = cv::vx_load(src + j / 2);
+        cv::v_store_interleave(dst + j, c, c);
+    }
+#endif
+    for (; j < dst_width; j++)
+    {
+        dst[j] = src[j / 2];
+    }
+}
+
+} // namespace
+
+void imcmp::yuv444_row_to_bgra(const uchar* y, const uchar* u, const uchar* v, uchar* bgra, int width)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    const cv::v_int32 v_cy = cv::vx_setall_s32(CY);
+    const cv::v_int32 v_cvr = cv::vx_setall_s32(CVR);
+    const cv::v_int32 v_cvg = cv::vx_setall_s32(CVG);
+    const cv::v_int32 v_cug = cv::vx_setall_s32(CUG);
+    const cv::v_int32 v_cub = cv::vx_setall_s32(CUB);
+    const cv::v_int32 v_round = cv::vx_setall_s32(ROUND);
+    const cv::v_int32 v_zero = cv::vx_setzero_s32();
+    const cv::v_int16 v_16 = cv::vx_setall_s16(16);
+    const cv::v_int16 v_128 = cv::vx_setall_s16(128);
+    const cv::v_uint8 v_alpha = cv::vx_setall_u8(255);
+    for (; j + step <= width; j += step)
+    {
+        cv::v_uint16 y16[2], u16[2], v16[2];
+        cv::v_expand(cv::vx_load(y + j), y16[0], y16[1]);
+        cv::v_expand(cv::vx_load(u + j), u16[0], u16[1]);
+        cv::v_expand(cv::vx_load(v + j), v16[0], v16[1]);
+
+        cv::v_int16 b16[2], g16[2], r16[2];
+        for (int h = 0; h < 2; h++)
+        {
+            cv::v_int32 ys[2], us[2], vs[2];
+            cv::v_expand(cv::v_reinterpret_as_s16(y16[h]) - v_16, ys[0], ys[1]);
+            cv::v_expand(cv::v_reinterpret_as_s16(u16[h]) - v_128, us[0], us[1]);
+            cv::v_expand(cv::v_reinterpret_as_s16(v16[h]) - v_128, vs[0], vs[1]);
+
+            cv::v_int32 b[2], g[2], r[2];
+            for (int q = 0; q < 2; q++)
+            {
+                const cv::v_int32 yy = cv::v_max(ys[q], v_zero) * v_cy + v_round;
+                b[q] = cv::v_shr<SHIFT>(yy + us[q] * v_cub);
+                g[q] = cv::v_shr<SHIFT>(yy + vs[q] * v_cvg + us[q] * v_cug);
+                r[q] = cv::v_shr<SHIFT>(yy + vs[q] * v_cvr);
+            }
+            b16[h] = cv::v_pack(b[0], b[1]);
+            g16[h] = cv::v_pack(g[0], g[1]);
+            r16[h] = cv::v_pack(r[0], r[1]);
+        }
+        cv::v_store_interleave(bgra + 4 * j, cv::v_pack_u(b16[0], b16[1]), cv::v_pack_u(g16[0], g16[1]), cv::v_pack_u(r16[0], r16[1]), v_alpha);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < width; j++)
+    {
+        yuv_to_bgra_pixel(y[j], u[j], v[j], bgra + 4 * j);
+    }
+}
+
+void imcmp::planar_yuv_to_bgra(const uchar* y_plane, int y_stride,
+                               const uchar* u_plane, int u_stride,
+                               const uchar* v_plane, int v_stride,
+                               int width, int height, int chroma_shift_x, int chroma_shift_y,
+                               cv::Mat& bgra)
+{
+    bgra.create(height, width, CV_8UC4);
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+        std::vector<uchar> u_row(width);
+        std::vector<uchar> v_row(width);
+        for (int i = range.start; i < range.end; i++)
+        {
+            const uchar* y = y_plane + (size_t)i * y_stride;
+            const uchar* u = u_plane + (size_t)(i >> chroma_shift_y) * u_stride;
+            const uchar* v = v_plane + (size_t)(i >> chroma_shift_y) * v_stride;
+            if (chroma_shift_x)
+            {
+                upsample_row_x2(u, u_row.data(), width);
+                upsample_row_x2(v, v_row.data(), width);
+                u = u_row.data();
+                v = v_row.data();
+            }
+            yuv444_row_to_bgra(y, u, v, bgra.ptr(i), width);
+        }
+    });
+}
+
+void imcmp::packed_yuv422_to_bgra(const uchar* src, int width, int height, const int order[4], cv::Mat& bgra)
+{
+    bgra.create(height, width, CV_8UC4);
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+        std::vector<uchar> y_row(width);
+        std::vector<uchar> u_row(width);
+        std::vector<uchar> v_row(width);
+        for (int i = range.start; i < range.end; i++)
+        {
+            const uchar* s = src + (size_t)i * width * 2;
+            int j = 0;
+#if CV_SIMD
+            const int step = cv::v_uint8::nlanes;
+            for (; j + 2 * step <= width; j += 2 * step)
+            {
+                cv::v_uint8 c[4];
+                cv::v_load_deinterleave(s + 2 * j, c[0], c[1], c[2], c[3]);
+                cv::v_store_interleave(y_row.data() + j, c[order[0]], c[order[2]]);
+                cv::v_store_interleave(u_row.data() + j, c[order[1]], c[order[1]]);
+                cv::v_store_interleave(v_row.data() + j, c[order[3]], c[order[3]]);
+            }
+#endif
+            for (; j < width; j += 2)
+            {
+                const uchar* m = s + 2 * j;
+                y_row[j] = m[order[0]];
+                y_row[j + 1] = m[order[2]];
+                u_row[j] = u_row[j + 1] = m[order[1]];
+                v_row[j] = v_row[j + 1] = m[order[3]];
+            }
+            yuv444_row_to_bgra(y_row.data(), u_row.data(), v_row.data(), bgra.ptr(i), width);
+        }
+    });
+}
+
+void imcmp::packed_yuv444_to_bgra(const uchar* src, int width, int height, const int order[3], cv::Mat& bgra)
+{
+    bgra.create(height, width, CV_8UC4);
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+        std::vector<uchar> y_row(width);
+        std::vector<uchar> u_row(width);
+        std::vector<uchar> v_row(width);
+        for (int i = range.start; i < range.end; i++)
+        {
+            const uchar* s = src + (size_t)i * width * 3;
+            int j = 0;
+#if CV_SIMD
+            const int step = cv::v_uint8::nlanes;
+            for (; j + step <= width; j += step)
+            {
+                cv::v_uint8 c[3];
+                cv::v_load_deinterleave(s + 3 * j, c[0], c[1], c[2]);
+                cv::v_store(y_row.data() + j, c[order[0]]);
+                cv::v_store(u_row.data() + j, c[order[1]]);
+                cv::v_store(v_row.data() + j, c[order[2]]);
+            }
+#endif
+            for (; j < width; j++)
+            {
+                y_row[j] = s[3 * j + order[0]];
+                u_row[j] = s[3 * j + order[1]];
+                v_row[j] = s[3 * j + order[2]];
+            }
+            yuv444_row_to_bgra(y_row.data(), u_row.data(), v_row.data(), bgra.ptr(i), width);
+        }
+    });
+}
+
+void imcmp::unpack_u16(const uchar* src, ushort* dst, int count, int shift, bool big_endian)
+{
+    int j = 0;
+#if CV_SIMD
+    // raw dumps are little endian, same as every host we build for, so lanes can be loaded as they are
+    const int step = cv::v_uint16::nlanes;
+    const ushort* s = reinterpret_cast<const ushort*>(src);
+    for (; j + step <= count; j += step)
+    {
+        cv::v_uint16 v = cv::vx_load(s + j);
+        if (big_endian)
+        {
+            v = cv::v_shl<8>(v) | cv::v_shr<8>(v);
+        }
+        cv::v_store(dst + j, v >> shift);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < count; j++)
+    {
+        const uchar* p = src + 2 * j;
+        const ushort v = big_endian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+        dst[j] = v >> shift;
+    }
+}
+
+void imcmp::unpack_raw10(const uchar* src, ushort* dst, int width)
+{
+    // a 5-byte group does not map to vector lanes; this loop is simple enough for the compiler to unroll
+    for (int j = 0; j + 4 <= width; j += 4)
+    {
+        const uchar* p = src + j / 4 * 5;
+        const int low = p[4];
+        dst[j] = (p[0] << 2) | (low & 3);
+        dst[j + 1] = (p[1] << 2) | ((low >> 2) & 3);
+        dst[j + 2] = (p[2] << 2) | ((low >> 4) & 3);
+        dst[j + 3] = (p[3] << 2) | (low >> 6);
+    }
+}
+
+void imcmp::unpack_raw12(const uchar* src, ushort* dst, int width)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    const cv::v_uint16 v_mask = cv::vx_setall_u16(15);
+    for (; j + 2 * step <= width; j += 2 * step)
+    {
+        cv::v_uint8 c0, c1, c2;
+        cv::v_load_deinterleave(src + j / 2 * 3, c0, c1, c2);
+        cv::v_uint16 h0[2], h1[2], low[2];
+        cv::v_expand(c0, h0[0], h0[1]);
+        cv::v_expand(c1, h1[0], h1[1]);
+        cv::v_expand(c2, low[0], low[1]);
+        for (int h = 0; h < 2; h++)
+        {
+            const cv::v_uint16 p0 = cv::v_shl<4>(h0[h]) | (low[h] & v_mask);
+            const cv::v_uint16 p1 = cv::v_shl<4>(h1[h]) | cv::v_shr<4>(low[h]);
+            cv::v_store_interleave(dst + j + h * step, p0, p1);
+        }
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j + 2 <= width; j += 2)
+    {
+        const uchar* p = src + j / 2 * 3;
+        dst[j] = (p[0] << 4) | (p[2] & 15);
+        dst[j + 1] = (p[1] << 4) | (p[2] >> 4);
+    }
+}
+
+void imcmp::merge_yuv420sp_row_16u(const ushort* y, const ushort* uv, ushort* yuv, int width)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint16::nlanes;
+    for (; j + 2 * step <= width; j += 2 * step)
+    {
+        cv::v_uint16 u, v, u0, u1, v0, v1;
+        cv::v_load_deinterleave(uv + j, u, v);
+        cv::v_zip(u, u, u0, u1);
+        cv::v_zip(v, v, v0, v1);
+        cv::v_store_interleave(yuv + 3 * j, cv::vx_load(y + j), u0, v0);
+        cv::v_store_interleave(yuv + 3 * (j + step), cv::vx_load(y + j + step), u1, v1);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < width; j++)
+    {
+        yuv[3 * j] = y[j];
+        yuv[3 * j + 1] = uv[j / 2 * 2];
+        yuv[3 * j + 2] = uv[j / 2 * 2 + 1];
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+namespace imcmp {
+
+// YUV to BGRA kernels for the raw layouts OpenCV's cvtColor() has no direct code for.
+// All of them use BT.601 limited range, same as OpenCV's YUV420/YUV422 conversions,
+// are vectorized with OpenCV's universal intrinsics and run rows in parallel.
+// `bgra` is only (re)allocated if it is not already width x height CV_8UC4.
+
+/// @brief convert full-resolution Y, U and V rows to BGRA
+void yuv444_row_to_bgra(const uchar* y, const uchar* u, const uchar* v, uchar* bgra, int width);
+
+/// @brief planar YUV; chroma planes are subsampled by (1 << chroma_shift_x, 1 << chroma_shift_y)
+/// Each plane has its own row stride in bytes, so line-interleaved planes can be described too.
+void planar_yuv_to_bgra(const uchar* y_plane, int y_stride,
+                        const uchar* u_plane, int u_stride,
+                        const uchar* v_plane, int v_stride,
+                        int width, int height, int chroma_shift_x, int chroma_shift_y,
+                        cv::Mat& bgra);
+
+/// @brief packed 4:2:2, `order` holds the byte offsets of Y0, U, Y1 and V in each 4-byte macropixel
+void packed_yuv422_to_bgra(const uchar* src, int width, int height, const int order[4], cv::Mat& bgra);
+
+/// @brief packed 4:4:4, `order` holds the byte offsets of Y, U and V in each 3-byte pixel
+void packed_yuv444_to_bgra(const uchar* src, int width, int height, const int order[3], cv::Mat& bgra);
+
+// Unpackers of high bit depth samples to 16-bit, LSB aligned. `dst` holds one ushort per sample.
+
+/// @brief 16-bit containers: swap bytes if `big_endian`, then shift right by `shift` (6 for MSB aligned 10-bit)
+void unpack_u16(const uchar* src, ushort* dst, int count, int shift, bool big_endian);
+
+/// @brief MIPI RAW10, 4 pixels in 5 bytes: the high 8 bits of each, then a byte with their low 2 bits
+void unpack_raw10(const uchar* src, ushort* dst, int width);
+
+/// @brief MIPI RAW12, 2 pixels in 3 bytes: the high 8 bits of each, then a byte with their low 4 bits
+void unpack_raw12(const uchar* src, ushort* dst, int width);
+
+/// @brief interleave a Y row and a half-resolution UV row (U0 V0 U1 V1 ...) to Y U V pixels
+void merge_yuv420sp_row_16u(const ushort* y, const ushort* uv, ushort* yuv, int width);
+
+} // namespace imcmp
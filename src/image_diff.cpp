@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef STR_IMPLEMENTATION
+#define STR_IMPLEMENTATION 1
+#endif
+#include "image_io.hpp"
+#include "image_compare.hpp"
+#include "strip_compare.hpp"
+#include "ssim.hpp"
+#include "row_diff.hpp"
+#include "noise_model.hpp"
+#include "compare_mask.hpp"
+
+static void help(const char* exe_name)
+{
+    printf("Usage: %s [options] left_image right_image\n", exe_name);
+    printf("       %s [options] -n reference [-n reference ...] candidate\n", exe_name);
+    printf("  -t N           tolerance per channel (default 1)\n");
+    printf("  -s ROWS        compare in strips of ROWS rows, for images larger than memory (raw formats and PNG)\n");
+    printf("  -m PATH        with -s, write the pixels above tolerance to PATH as a PBM mask\n");
+    printf("  -S             also print SSIM and MS-SSIM of luma (not with -s)\n");
+    printf("  -a             align the right image to the left by phase correlation first, then compare the overlap (not with -s)\n");
+    printf("  -r RADIUS      forgive shifts of up to RADIUS pixels, e.g. anti-aliasing; the exit code follows this count (not with -s)\n");
+    printf("  -R             align rows first, for images that gained or lost rows, e.g. UI content; widths must match (not with -s, -S or -r)\n");
+    printf("  -C             like -R, for columns; heights must match\n");
+    printf("  -z FILTER      resize the right image to the size of the left one first, FILTER is area, bilinear or lanczos (not with -s)\n");
+    printf("  -i MASK        ignore the pixels of MASK: a PBM, an image (non zero is ignored), or a .txt list of\n");
+    printf("                 \"x y width height\" rectangles to ignore and \"roi x y width height\" regions to keep (not with -s, -R, -C or -n)\n");
+    printf("  -n PATH        add a reference capture to a per pixel noise floor model, and compare the candidate to it;\n");
+    printf("                 the tolerance widens the model on each side\n");
+    printf("  -k SIGMAS      with -n, a candidate sample may be SIGMAS standard deviations from the mean (default 3)\n");
+    printf("  -e             with -n, a candidate sample may be anywhere between the min and max of the references\n");
+    printf("  -q             verdict only, for CI gates: stop as soon as the pair is known to fail, without statistics;\n");
+    printf("                 only with -t, -i, -b and -x\n");
+    printf("  -b PIXELS      with -q, fail only if more than PIXELS pixels differ by more than the tolerance (default 0)\n");
+    printf("  -x DELTA       with -q, also fail if any pixel differs by more than DELTA\n");
+    printf("Exit code: 0 if no pixel differs by more than the tolerance (with -q, if within the budget), 2 if some do, 1 on errors\n");
+}
+
+// BGRA, like the images the GUI compares
+static cv::Mat load_bgra(const std::string& path)
+{
+    cv::Mat image = imcmp::load_image(path);
+    switch (image.channels())
+    {
+    case 1:
+        cv::cvtColor(image, image, cv::COLOR_GRAY2BGRA);
+        break;
+    case 3:
+        cv::cvtColor(image, image, cv::COLOR_BGR2BGRA);
+        break;
+    default:
+        break;
+    }
+    return image;
+}
+
+// references are loaded one at a time and folded into the model
+static int compare_to_references(const std::vector<std::string>& references, const std::string& candidate_path, int tolerance, float sigmas, bool envelope)
+{
+    imcmp::NoiseModel model;
+    for (const std::string& path : references)
+    {
+        if (!model.add(imcmp::load_image(path)))
+        {
+            fprintf(stderr, "failed to add reference %s\n", path.c_str());
+            return 1;
+        }
+    }
+    cv::Mat low;
+    cv::Mat high;
+    model.bounds(envelope ? imcmp::NoiseBound::Envelope : imcmp::NoiseBound::Sigma, sigmas, tolerance, low, high);
+    const cv::Mat candidate = load_bgra(candidate_path);
+    bool is_within = false;
+    int64_t outside_pixels = 0;
+    if (imcmp::compare_to_noise_model(candidate, low, high, is_within, outside_pixels).empty())
+    {
+        return 1;
+    }
+    printf("%dx%d: %lld pixels outside the noise floor of %d references\n", candidate.cols, candidate.rows, (long long)outside_pixels, model.frame_count());
+    return is_within ? 0 : 2;
+}
+
+int main(int argc, char** argv)
+{
+    int tolerance = 1;
+    int strip_rows = 0;
+    std::string mask_path;
+    bool ssim = false;
+    int radius = 0;
+    bool align = false;
+    bool structural = false;
+    bool columns = false;
+    const char* resample = NULL;
+    std::vector<std::string> references;
+    float sigmas = 3.0f;
+    bool envelope = false;
+    std::string mask_file;
+    bool verdict_only = false;
+    int64_t budget = 0;
+    int hard_cap = -1;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "-t") == 0 && has_value) tolerance = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && has_value) strip_rows = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && has_value) mask_path = argv[++i];
+        else if (strcmp(argv[i], "-S") == 0) ssim = true;
+        else if (strcmp(argv[i], "-r") == 0 && has_value) radius = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-a") == 0) align = true;
+        else if (strcmp(argv[i], "-R") == 0) structural = true;
+        else if (strcmp(argv[i], "-C") == 0) structural = columns = true;
+        else if (strcmp(argv[i], "-z") == 0 && has_value) resample = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && has_value) references.push_back(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && has_value) sigmas = static_cast<float>(atof(argv[++i]));
+        else if (strcmp(argv[i], "-e") == 0) envelope = true;
+        else if (strcmp(argv[i], "-i") == 0 && has_value) mask_file = argv[++i];
+        else if (strcmp(argv[i], "-q") == 0) verdict_only = true;
+        else if (strcmp(argv[i], "-b") == 0 && has_value) budget = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-x") == 0 && has_value) hard_cap = atoi(argv[++i]);
+        else positional.push_back(argv[i]);
+    }
+    if (verdict_only && (strip_rows > 0 || !mask_path.empty() || ssim || radius > 0 || align || structural || resample || !references.empty()))
+    {
+        fprintf(stderr, "-q can't be combined with -s, -m, -S, -r, -a, -R, -C, -z or -n\n");
+        return 1;
+    }
+    if (!mask_file.empty() && (strip_rows > 0 || structural || !references.empty()))
+    {
+        fprintf(stderr, "-i can't be combined with -s, -R, -C or -n\n");
+        return 1;
+    }
+    if (!references.empty() && positional.size() != 1)
+    {
+        fprintf(stderr, "-n compares a single candidate to the references, got %d images\n", static_cast<int>(positional.size()));
+        return 1;
+    }
+    if (!references.empty())
+    {
+        return compare_to_references(references, positional[0], tolerance, sigmas, envelope);
+    }
+    if (positional.size() != 2)
+    {
+        help(argv[0]);
+        return 1;
+    }
+    if (verdict_only)
+    {
+        const cv::Mat left = load_bgra(positional[0]);
+        const cv::Mat right = load_bgra(positional[1]);
+        if (left.empty() || right.empty() || left.size() != right.size() || left.type() != right.type())
+        {
+            fprintf(stderr, "failed to load, or size or format differs\n");
+            return 1;
+        }
+        imcmp::CompareMask mask;
+        if (!mask_file.empty() && !imcmp::load_compare_mask(mask_file, left.size(), mask))
+        {
+            return 1;
+        }
+        const imcmp::CompareVerdict verdict = imcmp::compare_verdict(left, right, tolerance, budget, hard_cap, &mask);
+        printf("%s: %s%lld pixels differ by more than %d, max delta %s%d\n", verdict.passed ? "PASS" : "FAIL", verdict.stopped_early ? "at least " : "",
+               (long long)verdict.diff_pixels, tolerance, verdict.stopped_early ? "at least " : "", verdict.max_delta);
+        return verdict.passed ? 0 : 2;
+    }
+
+    imcmp::DiffStats stats;
+    imcmp::SsimScores ssim_scores;
+    int64_t unmatched_pixels = -1;
+    int structural_edits = -1; // removed and inserted rows, of a structural compare
+    cv::Size size;
+    if (strip_rows > 0)
+    {
+        imcmp::StripCompareResult result;
+        if (!imcmp::compare_in_strips(positional[0], positional[1], tolerance, strip_rows, mask_path, result))
+        {
+            return 1;
+        }
+        stats = result.stats;
+        size = cv::Size(result.width, result.height);
+    }
+    else
+    {
+        cv::Mat left = load_bgra(positional[0]);
+        cv::Mat right = load_bgra(positional[1]);
+        if (resample && !left.empty() && !right.empty() && left.size() != right.size())
+        {
+            imcmp::ResampleFilter filter = imcmp::ResampleFilter::Area;
+            if (strcmp(resample, "bilinear") == 0) filter = imcmp::ResampleFilter::Bilinear;
+            else if (strcmp(resample, "lanczos") == 0) filter = imcmp::ResampleFilter::Lanczos;
+            else if (strcmp(resample, "area") != 0)
+            {
+                fprintf(stderr, "unknown resample filter %s\n", resample);
+                return 1;
+            }
+            printf("resampled %dx%d to %dx%d\n", right.cols, right.rows, left.cols, left.rows);
+            cv::Mat resampled;
+            imcmp::resample(right, left.size(), filter, resampled);
+            right = resampled;
+        }
+        cv::Point offset;
+        if (align && !left.empty() && !right.empty() && imcmp::estimate_translation(left, right, offset))
+        {
+            const cv::Rect overlap = cv::Rect(0, 0, left.cols, left.rows) & cv::Rect(-offset.x, -offset.y, right.cols, right.rows);
+            printf("offset (%d, %d), comparing the %dx%d overlap\n", offset.x, offset.y, overlap.width, overlap.height);
+            right = right(cv::Rect(overlap.x + offset.x, overlap.y + offset.y, overlap.width, overlap.height));
+            left = left(overlap);
+        }
+        if (structural && !left.empty() && !right.empty() && (columns ? left.rows == right.rows : left.cols == right.cols))
+        {
+            // only the rows paired by the alignment are diffed, so sizes may differ along the aligned axis
+            bool is_exactly_same = false;
+            imcmp::StructuralDiff structure;
+            imcmp::compare_structural(left, right, tolerance, columns, is_exactly_same, structure, stats);
+            const char* unit = columns ? "columns" : "rows";
+            for (const imcmp::RowRun& run : structure.runs)
+            {
+                if (run.op == imcmp::RowOp::Removed)
+                    printf("removed %d %s at left %d\n", run.rows, unit, run.left_row);
+                else if (run.op == imcmp::RowOp::Inserted)
+                    printf("inserted %d %s at right %d\n", run.rows, unit, run.right_row);
+            }
+            printf("%d %s removed, %d inserted, %d changed\n", structure.removed, unit, structure.inserted, structure.changed);
+            structural_edits = structure.removed + structure.inserted;
+        }
+        else
+        {
+            if (left.empty() || right.empty() || left.size() != right.size() || left.type() != right.type())
+            {
+                fprintf(stderr, "failed to load, or size or format differs\n");
+                return 1;
+            }
+            if (!mask_file.empty())
+            {
+                imcmp::CompareMask mask;
+                if (!imcmp::load_compare_mask(mask_file, left.size(), mask))
+                {
+                    return 1;
+                }
+                printf("ignoring %lld pixels\n", (long long)mask.ignored_pixels());
+                bool is_exactly_same = false;
+                imcmp::compare_masked(left, right, mask, tolerance, is_exactly_same, stats);
+            }
+            else
+            {
+                imcmp::compute_diff_stats(left, right, tolerance, stats);
+            }
+            if (ssim)
+            {
+                imcmp::compare_ssim(left, right, ssim_scores);
+            }
+            if (radius > 0 && left.type() == CV_8UC4)
+            {
+                bool is_exactly_same = false;
+                imcmp::compare_neighborhood(left, right, radius, tolerance, is_exactly_same, unmatched_pixels);
+            }
+        }
+        size = left.size();
+    }
+
+    printf("%dx%d: %lld pixels differ by more than %d, max delta %d\n", size.width, size.height, (long long)stats.diff_pixels, tolerance, stats.max_delta);
+    printf("PSNR %.2f dB, MSE %.4f, MAE %.4f\n", stats.psnr(), stats.mse(), stats.mae());
+    const char* channel_names[4] = {"B", "G", "R", "A"};
+    for (int k = 0; k < stats.channels; k++)
+    {
+        printf("  %s: max %d, PSNR %.2f dB, MSE %.4f, MAE %.4f\n", channel_names[k], stats.channel_max[k], stats.psnr(k), stats.mse(k), stats.mae(k));
+    }
+    if (ssim && strip_rows <= 0 && structural_edits < 0)
+    {
+        printf("SSIM %.6f, MS-SSIM %.6f\n", ssim_scores.ssim, ssim_scores.ms_ssim);
+    }
+    if (unmatched_pixels >= 0)
+    {
+        printf("%lld pixels differ by more than %d from all neighbors within radius %d\n", (long long)unmatched_pixels, tolerance, radius);
+        return unmatched_pixels > 0 ? 2 : 0;
+    }
+    return (stats.diff_pixels > 0 || structural_edits > 0) ? 2 : 0;
+}
@@ -0,0 +1,413 @@
+#include "image_format.hpp"
+#include <opencv2/imgproc.hpp>
+#include <array>
+#include <stdint.h>
+
+namespace {
+
+using imcmp::FormatDesc;
+using imcmp::FormatKind;
+using imcmp::NativeLayout;
+using imcmp::PlaneDesc;
+
+constexpr PlaneDesc plane(int row_num, int row_den, int shift_y)
+{
+    PlaneDesc p;
+    p.row_num = row_num;
+    p.row_den = row_den;
+    p.shift_y = shift_y;
+    return p;
+}
+
+constexpr FormatDesc encoded(const char* ext)
+{
+    FormatDesc d;
+    d.ext = ext;
+    d.kind = FormatKind::Encoded;
+    return d;
+}
+
+constexpr FormatDesc cvt_color(const char* ext, int size_num, int size_den, int src_type, int src_rows_x2, int cvt_code, int align)
+{
+    FormatDesc d;
+    d.ext = ext;
+    d.kind = FormatKind::CvtColor;
+    d.size_num = size_num;
+    d.size_den = size_den;
+    d.width_align = align;
+    d.height_align = align;
+    d.src_type = src_type;
+    d.src_rows_x2 = src_rows_x2;
+    d.cvt_code = cvt_code;
+    d.planes[0] = plane(size_num, size_den, 0);
+    return d;
+}
+
+// 4:2:0 with interleaved chroma, e.g. nv12
+constexpr FormatDesc yuv420sp(const char* ext, int cvt_code)
+{
+    FormatDesc d = cvt_color(ext, 3, 2, CV_8UC1, 3, cvt_code, 2);
+    d.plane_count = 2;
+    d.planes[0] = plane(1, 1, 0);
+    d.planes[1] = plane(1, 1, 1);
+    return d;
+}
+
+// 4:2:0 planar, e.g. i420
+constexpr FormatDesc yuv420p(const char* ext, int cvt_code)
+{
+    FormatDesc d = cvt_color(ext, 3, 2, CV_8UC1, 3, cvt_code, 2);
+    d.plane_count = 3;
+    d.planes[0] = plane(1, 1, 0);
+    d.planes[1] = plane(1, 2, 1);
+    d.planes[2] = plane(1, 2, 1);
+    return d;
+}
+
+constexpr FormatDesc planar_yuv(const char* ext, int chroma_shift_x, int chroma_shift_y, bool swap_uv, bool line_packed = false)
+{
+    FormatDesc d;
+    d.ext = ext;
+    d.kind = FormatKind::PlanarYuv;
+    d.size_num = 2 + 4 / (1 << (chroma_shift_x + chroma_shift_y)); // Y plus two chroma planes, in half bytes per pixel
+    d.size_den = 2;
+    d.width_align = 1 << chroma_shift_x;
+    d.height_align = 1 << chroma_shift_y;
+    d.chroma_shift_x = chroma_shift_x;
+    d.chroma_shift_y = chroma_shift_y;
+    d.swap_uv = swap_uv;
+    d.line_packed = line_packed;
+    if (line_packed)
+    {
+        d.planes[0] = plane(d.size_num, d.size_den, 0);
+    }
+    else
+    {
+        d.plane_count = 3;
+        d.planes[0] = plane(1, 1, 0);
+        d.planes[1] = plane(1, 1 << chroma_shift_x, chroma_shift_y);
+        d.planes[2] = plane(1, 1 << chroma_shift_x, chroma_shift_y);
+    }
+    return d;
+}
+
+constexpr FormatDesc packed_yuv422(const char* ext, int y0, int u, int y1, int v)
+{
+    FormatDesc d;
+    d.ext = ext;
+    d.kind = FormatKind::PackedYuv422;
+    d.size_num = 2;
+    d.width_align = 2;
+    d.planes[0] = plane(2, 1, 0);
+    d.order[0] = y0;
+    d.order[1] = u;
+    d.order[2] = y1;
+    d.order[3] = v;
+    return d;
+}
+
+constexpr FormatDesc packed_yuv444(const char* ext, int y, int u, int v)
+{
+    FormatDesc d;
+    d.ext = ext;
+    d.kind = FormatKind::PackedYuv444;
+    d.size_num = 3;
+    d.planes[0] = plane(3, 1, 0);
+    d.order[0] = y;
+    d.order[1] = u;
+    d.order[2] = v;
+    return d;
+}
+
+constexpr FormatDesc native(const char* ext, NativeLayout layout, int size_num, int size_den, int bit_depth,
+                            int width_align = 1, int height_align = 1, bool big_endian = false, int shift = 0, const char* cfa = "")
+{
+    FormatDesc d;
+    d.ext = ext;
+    d.kind = FormatKind::Native;
+    d.size_num = size_num;
+    d.size_den = size_den;
+    d.width_align = width_align;
+    d.height_align = height_align;
+    d.bit_depth = bit_depth;
+    d.layout = layout;
+    d.big_endian = big_endian;
+    d.shift = shift;
+    d.cfa = cfa;
+    if (layout == NativeLayout::P01x)
+    {
+        d.plane_count = 2;
+        d.planes[0] = plane(2, 1, 0);
+        d.planes[1] = plane(2, 1, 1);
+    }
+    else
+    {
+        d.planes[0] = plane(size_num, size_den, 0);
+    }
+    return d;
+}
+
+constexpr FormatDesc bayer(const char* ext, const char* cfa, int bit_depth)
+{
+    return native(ext, bit_depth == 8 ? NativeLayout::Plane8 : NativeLayout::Plane16, bit_depth == 8 ? 1 : 2, 1, bit_depth, 2, 2, false, 0, cfa);
+}
+
+// clang-format off
+constexpr FormatDesc formats[] = {
+    encoded("jpg"),
+    encoded("jpeg"),
+    encoded("png"),
+    encoded("bmp"),
+
+    cvt_color("rgb24",  3, 1, CV_8UC3, 2, cv::COLOR_RGB2BGRA, 1),
+    cvt_color("bgr24",  3, 1, CV_8UC3, 2, cv::COLOR_BGR2BGRA, 1),
+    cvt_color("rgba32", 4, 1, CV_8UC4, 2, cv::COLOR_RGBA2BGRA, 1),
+    cvt_color("bgra32", 4, 1, CV_8UC4, 2, -1, 1),
+    cvt_color("gray",   1, 1, CV_8UC1, 2, cv::COLOR_GRAY2BGRA, 1),
+
+    yuv420sp("nv21", cv::COLOR_YUV2BGRA_NV21),
+    yuv420sp("nv12", cv::COLOR_YUV2BGRA_NV12),
+    yuv420p("i420", cv::COLOR_YUV2BGRA_I420),
+    yuv420p("yv12", cv::COLOR_YUV2BGRA_YV12),
+    cvt_color("uyvy", 2, 1, CV_8UC2, 2, cv::COLOR_YUV2BGRA_UYVY, 2),
+    cvt_color("yuyv", 2, 1, CV_8UC2, 2, cv::COLOR_YUV2BGRA_YUYV, 2),
+    cvt_color("yvyu", 2, 1, CV_8UC2, 2, cv::COLOR_YUV2BGRA_YVYU, 2),
+
+    planar_yuv("i444",    0, 0, false),
+    planar_yuv("yv24",    0, 0, true),
+    planar_yuv("i422h",   1, 0, false),
+    planar_yuv("yv16h",   1, 0, true),
+    planar_yuv("i422v",   0, 1, false),
+    planar_yuv("yv16v",   0, 1, true),
+    planar_yuv("lpi422h", 1, 0, false, true),
+
+    // the "2" variants are the plain ones with each 16-bit word byte swapped
+    packed_yuv422("vyuy",  1, 2, 3, 0),
+    packed_yuv422("uyvy2", 0, 1, 2, 3),
+    packed_yuv422("vyuy2", 0, 3, 2, 1),
+    packed_yuv422("yuyv2", 1, 0, 3, 2),
+    packed_yuv422("yvyu2", 1, 2, 3, 0),
+    packed_yuv444("yvu", 0, 2, 1),
+    packed_yuv444("uvy", 2, 0, 1),
+    packed_yuv444("vuy", 2, 1, 0),
+
+    // high bit depth, little endian unless suffixed by "be"
+    native("p010",    NativeLayout::P01x,    3, 1, 10, 2, 2, false, 6),
+    native("p010be",  NativeLayout::P01x,    3, 1, 10, 2, 2, true, 6),
+    native("p012",    NativeLayout::P01x,    3, 1, 12, 2, 2, false, 4),
+    native("p012be",  NativeLayout::P01x,    3, 1, 12, 2, 2, true, 4),
+    native("p016",    NativeLayout::P01x,    3, 1, 16, 2, 2),
+    native("p016be",  NativeLayout::P01x,    3, 1, 16, 2, 2, true),
+    native("y10",     NativeLayout::Plane16, 2, 1, 10),
+    native("y10be",   NativeLayout::Plane16, 2, 1, 10, 1, 1, true),
+    native("y12",     NativeLayout::Plane16, 2, 1, 12),
+    native("y12be",   NativeLayout::Plane16, 2, 1, 12, 1, 1, true),
+    native("y16",     NativeLayout::Plane16, 2, 1, 16),
+    native("y16be",   NativeLayout::Plane16, 2, 1, 16, 1, 1, true),
+    native("y10p",    NativeLayout::Raw10,   5, 4, 10, 4), // MIPI RAW10
+    native("y12p",    NativeLayout::Raw12,   3, 2, 12, 2), // MIPI RAW12
+    native("rgb48",   NativeLayout::Rgb48,   6, 1, 16),
+    native("rgb48be", NativeLayout::Rgb48,   6, 1, 16, 1, 1, true),
+
+    // Bayer mosaics, 8-bit or 16-bit samples holding 10/12/16 bits
+    bayer("rggb", "rggb", 8), bayer("rggb10", "rggb", 10), bayer("rggb12", "rggb", 12), bayer("rggb16", "rggb", 16),
+    bayer("bggr", "bggr", 8), bayer("bggr10", "bggr", 10), bayer("bggr12", "bggr", 12), bayer("bggr16", "bggr", 16),
+    bayer("grbg", "grbg", 8), bayer("grbg10", "grbg", 10), bayer("grbg12", "grbg", 12), bayer("grbg16", "grbg", 16),
+    bayer("gbrg", "gbrg", 8), bayer("gbrg10", "gbrg", 10), bayer("gbrg12", "gbrg", 12), bayer("gbrg16", "gbrg", 16),
+};
+
+// the planes must add up to the frame size, checked on a 64x64 frame
+constexpr bool planes_match_size()
+{
+    for (const FormatDesc& d : formats)
+    {
+        if (d.kind == FormatKind::Encoded)
+        {
+            continue;
+        }
+        int64_t bytes = 0;
+        for (int p = 0; p < d.plane_count; p++)
+        {
+            bytes += int64_t(64) * d.planes[p].row_num / d.planes[p].row_den * (64 >> d.planes[p].shift_y);
+        }
+        if (bytes != int64_t(64) * 64 * d.size_num / d.size_den)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(planes_match_size(), "plane layout of a format does not add up to its frame size");
+
+class ExtAlias
+{
+public:
+    const char* ext;
+    const char* canonical;
+};
+
+constexpr ExtAlias aliases[] = {
+    {"iyuv", "i420"}, // opencv
+    {"yuv",  "i420"}, // yuvviewer
+    {"y422", "uyvy"}, // opencv
+    {"uynv", "uyvy"}, // opencv
+    {"yunv", "yuyv"}, // opencv
+    {"yuy2", "yuyv"}, // opencv
+    {"grey", "gray"}, // yuvviewer
+};
+// clang-format on
+
+constexpr int format_count = sizeof(formats) / sizeof(formats[0]);
+constexpr int alias_count = sizeof(aliases) / sizeof(aliases[0]);
+constexpr int key_count = format_count + alias_count;
+
+constexpr bool str_equal(const char* a, const char* b)
+{
+    while (*a && *a == *b)
+    {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr int format_index(const char* ext)
+{
+    for (int i = 0; i < format_count; i++)
+    {
+        if (str_equal(formats[i].ext, ext))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// every extension, canonical ones first, mapped to its entry of `formats`
+class ExtKey
+{
+public:
+    const char* ext = "";
+    int format = -1;
+};
+
+constexpr std::array<ExtKey, key_count> make_keys()
+{
+    std::array<ExtKey, key_count> keys{};
+    for (int i = 0; i < format_count; i++)
+    {
+        keys[i].ext = formats[i].ext;
+        keys[i].format = i;
+    }
+    for (int i = 0; i < alias_count; i++)
+    {
+        keys[format_count + i].ext = aliases[i].ext;
+        keys[format_count + i].format = format_index(aliases[i].canonical);
+    }
+    return keys;
+}
+
+constexpr std::array<ExtKey, key_count> keys = make_keys();
+
+constexpr bool aliases_resolve()
+{
+    for (int i = 0; i < key_count; i++)
+    {
+        if (keys[i].format < 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(aliases_resolve(), "an alias refers to a format missing in the table");
+
+// Perfect hash: FNV-1a with a seed, which is searched at compile time so that no two keys share a slot.
+// With ~70 keys in 1024 slots a few seeds have to be tried on average.
+constexpr int slot_bits = 10;
+constexpr int slot_count = 1 << slot_bits;
+constexpr uint8_t empty_slot = 0xff;
+static_assert(key_count < empty_slot, "slot entries are uint8_t");
+
+constexpr uint32_t ext_hash(const char* s, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (; *s; s++)
+    {
+        h = (h ^ static_cast<uint8_t>(*s)) * 16777619u;
+    }
+    return (h ^ (h >> 16)) & (slot_count - 1);
+}
+
+constexpr bool collision_free(uint32_t seed)
+{
+    std::array<bool, slot_count> used{};
+    for (int i = 0; i < key_count; i++)
+    {
+        const uint32_t slot = ext_hash(keys[i].ext, seed);
+        if (used[slot])
+        {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t no_seed = 0xffffffffu;
+
+constexpr uint32_t find_seed()
+{
+    for (uint32_t seed = 0; seed < 256; seed++)
+    {
+        if (collision_free(seed))
+        {
+            return seed;
+        }
+    }
+    return no_seed;
+}
+
+constexpr uint32_t seed = find_seed();
+static_assert(seed != no_seed, "extension hash has collisions for every seed tried; grow slot_bits");
+
+constexpr std::array<uint8_t, slot_count> make_slots()
+{
+    std::array<uint8_t, slot_count> slots{};
+    for (int i = 0; i < slot_count; i++)
+    {
+        slots[i] = empty_slot;
+    }
+    for (int i = 0; i < key_count; i++)
+    {
+        slots[ext_hash(keys[i].ext, seed)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+constexpr std::array<uint8_t, slot_count> slots = make_slots();
+
+} // namespace
+
+const imcmp::FormatDesc* imcmp::find_format(const std::string& ext)
+{
+    const uint8_t k = slots[ext_hash(ext.c_str(), seed)];
+    if (k == empty_slot || ext != keys[k].ext)
+    {
+        return NULL;
+    }
+    return &formats[keys[k].format];
+}
+
+const std::vector<std::string>& imcmp::supported_format_exts()
+{
+    static const std::vector<std::string> exts = [] {
+        std::vector<std::string> v;
+        for (int i = 0; i < key_count; i++)
+        {
+            v.push_back(keys[i].ext);
+        }
+        return v;
+    }();
+    return exts;
+}
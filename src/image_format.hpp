@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace imcmp {
+
+/// how a frame of a format is turned into pixels
+enum class FormatKind
+{
+    Encoded,      // jpg, png, ...: decoded by cv::imread()
+    CvtColor,     // one cv::cvtColor() call on the frame wrapped as a Mat
+    PlanarYuv,    // planar_yuv_to_bgra()
+    PackedYuv422, // packed_yuv422_to_bgra()
+    PackedYuv444, // packed_yuv444_to_bgra()
+    Native,       // unpacked to native samples first, see unpack_fourcc_to_native()
+};
+
+/// sample layout of FormatKind::Native formats
+enum class NativeLayout
+{
+    Plane8,  // one 8-bit plane (Bayer mosaics)
+    Plane16, // one plane of 16-bit samples
+    Raw10,   // MIPI RAW10
+    Raw12,   // MIPI RAW12
+    Rgb48,
+    P01x,    // nv12 with 16-bit samples
+};
+
+/// @brief one plane of a frame: (height >> shift_y) rows of (width * row_num / row_den) bytes
+class PlaneDesc
+{
+public:
+    int row_num = 0;
+    int row_den = 1;
+    int shift_y = 0;
+};
+
+/// @brief everything needed to size, validate and convert one frame of a format
+///
+/// All formats are listed in one constexpr table in image_format.cpp, so
+/// adding a format is adding an entry there.
+class FormatDesc
+{
+public:
+    const char* ext = ""; // canonical extension, lowercase
+    FormatKind kind = FormatKind::Encoded;
+
+    // bytes of one frame are width * height * size_num / size_den
+    int size_num = 0;
+    int size_den = 1;
+    // width and height must be multiples of these
+    int width_align = 1;
+    int height_align = 1;
+    int bit_depth = 8;
+    // planes in file order, e.g. Y then UV for nv12
+    int plane_count = 1;
+    PlaneDesc planes[3];
+
+    // CvtColor: the frame is a (height * src_rows_x2 / 2) x width Mat of src_type, converted with cvt_code (-1: copied)
+    int src_type = 0;
+    int src_rows_x2 = 2;
+    int cvt_code = -1;
+
+    // PlanarYuv
+    int chroma_shift_x = 0;
+    int chroma_shift_y = 0;
+    bool swap_uv = false;     // V plane before U plane
+    bool line_packed = false; // each row holds its Y, U and V
+
+    // PackedYuv422: byte offsets of Y0, U, Y1, V; PackedYuv444: byte offsets of Y, U, V
+    int order[4] = {0, 0, 0, 0};
+
+    // Native
+    NativeLayout layout = NativeLayout::Plane16;
+    bool big_endian = false;
+    int shift = 0;        // right shift of MSB aligned samples
+    const char* cfa = ""; // Bayer pattern, e.g. "rggb"
+};
+
+/// @brief look up a lowercase extension, aliases included (e.g. "yuv" gives i420)
+/// @return NULL if not supported
+const FormatDesc* find_format(const std::string& ext);
+
+/// @brief all supported extensions, aliases included, in table order
+const std::vector<std::string>& supported_format_exts();
+
+} // namespace imcmp
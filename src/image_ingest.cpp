@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#if __linux__ || __APPLE__
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#ifndef STR_IMPLEMENTATION
+#define STR_IMPLEMENTATION 1
+#endif
+#include "image_io.hpp"
+#include "hot_folder.hpp"
+
+static void help(const char* exe_name)
+{
+    printf("Usage: %s [options] watch_dir reference_dir\n", exe_name);
+    printf("  -j N           number of compare workers (default 4)\n");
+    printf("  -t N           tolerance per channel (default 1)\n");
+    printf("  -q N           max pending files (default 64)\n");
+    printf("  -c N           max cached references (default 8)\n");
+    printf("  -l PATH        log file, rolled over to PATH.1 (default ingest.log)\n");
+    printf("  -m BYTES       log size before rolling over (default 16MB)\n");
+    printf("  -p REGEX       pattern matched against new file names (default \"(.*)\")\n");
+    printf("  -r FORMAT      reference name built from the match (default \"$1\")\n");
+    printf("Example: %s -p \"cam0_\\d+_(.*)\" -r \"ref_$1\" dumps refs\n", exe_name);
+}
+
+int main(int argc, char** argv)
+{
+    imcmp::HotFolderIngest::Options options;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "-j") == 0 && has_value) options.num_workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && has_value) options.tolerance = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0 && has_value) options.queue_capacity = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && has_value) options.reference_cache_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0 && has_value) options.log_path = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0 && has_value) options.log_max_bytes = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && has_value) options.match_pattern = argv[++i];
+        else if (strcmp(argv[i], "-r") == 0 && has_value) options.reference_format = argv[++i];
+        else positional.push_back(argv[i]);
+    }
+    if (positional.size() != 2)
+    {
+        help(argv[0]);
+        return 1;
+    }
+    options.watch_dir = positional[0];
+    options.reference_dir = positional[1];
+
+#if __linux__ || __APPLE__
+    // block SIGINT/SIGTERM in every thread, and wait for them here to stop gracefully
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+#endif
+
+    imcmp::HotFolderIngest ingest(options);
+    bool ok = true;
+    std::thread runner([&] {
+        ok = ingest.run();
+#if __linux__ || __APPLE__
+        if (!ok)
+        {
+            kill(getpid(), SIGTERM);
+        }
+#endif
+    });
+
+#if __linux__ || __APPLE__
+    int sig = 0;
+    sigwait(&sigset, &sig);
+    ingest.stop();
+#endif
+    runner.join();
+    printf("processed %lld files\n", (long long)ingest.processed_count());
+
+    return ok ? 0 : 1;
+}
@@ -1,168 +1,563 @@
 #include "image_io.hpp"
+#include "image_convert.hpp"
+#include "jpeg_io.hpp"
+#include "png_io.hpp"
 #include <filesystem>
 #include <opencv2/imgproc.hpp>
 #include <vector>
 
+#if _WIN32
+#include <stdio.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace {
-using namespace imcmp;
 
-class FileInfo
+#if !_WIN32
+bool pread_all(int fd, int64_t offset, int64_t size, void* buf)
+{
+    uchar* dst = static_cast<uchar*>(buf);
+    while (size > 0)
+    {
+        ssize_t n = pread(fd, dst, size, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+        dst += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+#endif
+
+bool read_file_range(const std::string& filename, int64_t offset, int64_t size, void* buf)
+{
+#if _WIN32
+    FILE* fin = fopen(filename.c_str(), "rb");
+    if (fin == NULL)
+    {
+        return false;
+    }
+    bool ok = (_fseeki64(fin, offset, SEEK_SET) == 0) && (fread(buf, 1, size, fin) == size);
+    fclose(fin);
+    return ok;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = pread_all(fd, offset, size, buf);
+    close(fd);
+    return ok;
+#endif
+}
+
+class FileRange
 {
 public:
-    FileInfo()
-    {
-        height = -1;
-        width = -1;
-        head = "";
-        ext = "";
-        valid = true;
-        err_msg = "";
-    }
-    std::string filename;
-    std::string head;
-    std::string raw_ext; // same as file
-    std::string ext; // converted to lowercase, then mapping to identical one
-    int height;
-    int width;
-    bool valid;
-    std::string err_msg;
+    int64_t offset;
+    int64_t size;
+    void* buf;
 };
 
-cv::Mat load_fourcc_and_convert_to_mat(const FileInfo& file_info)
+// read many ranges of one file, opening it only once
+bool read_file_ranges(const std::string& filename, const std::vector<FileRange>& ranges)
 {
-    cv::Mat image;
-    const std::string& ext = file_info.ext;
-    if (ext == "nv21" || ext == "nv12" || ext == "i420" || ext == "yv12" // 3/2
-        || ext == "uyvy" || ext == "yuyv" || ext == "yvyu" // 2
-        )
-    {
-        int height = file_info.height;
-        int width = file_info.width;
-        FILE* fin = fopen(file_info.filename.c_str(), "rb");
-        
-        cv::Size size;
-        size.height = height;
-        size.width = width;
-        image = cv::Mat(size, CV_8UC3);
-
-        if (ext == "nv21") // nv21 => bgr
-        {
-            int buf_size = height * width * 3 / 2;
-            cv::Mat yuv420sp_mat(height * 3 / 2, width, CV_8UC1);
-            uchar* yuv_buf = yuv420sp_mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(yuv420sp_mat, image, cv::COLOR_YUV2BGR_NV21);
-        }
-        else if (ext == "nv12") // nv12 => bgr
-        {
-            int buf_size = height * width * 3 / 2;
-            cv::Mat yuv420sp_mat(height * 3 / 2, width, CV_8UC1);
-            uchar* yuv_buf = yuv420sp_mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(yuv420sp_mat, image, cv::COLOR_YUV2BGR_NV12);
-        }
-        else if (ext == "i420")
-        {
-            int buf_size = height * width * 3 / 2;
-            cv::Mat mat(height * 3 / 2, width, CV_8UC1);
-            uchar* yuv_buf = mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(mat, image, cv::COLOR_YUV2BGR_I420);
-        }
-        else if (ext == "yv12")
-        {
-            int buf_size = height * width * 3 / 2;
-            cv::Mat yuv420p_mat(height * 3 / 2, width, CV_8UC1);
-            uchar* yuv_buf = yuv420p_mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(yuv420p_mat, image, cv::COLOR_YUV2BGR_YV12);
-        }
-        else if (ext == "uyvy")
+#if _WIN32
+    FILE* fin = fopen(filename.c_str(), "rb");
+    if (fin == NULL)
+    {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < ranges.size(); i++)
+    {
+        ok = (_fseeki64(fin, ranges[i].offset, SEEK_SET) == 0) && (fread(ranges[i].buf, 1, ranges[i].size, fin) == ranges[i].size);
+    }
+    fclose(fin);
+    return ok;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < ranges.size(); i++)
+    {
+        ok = pread_all(fd, ranges[i].offset, ranges[i].size, ranges[i].buf);
+    }
+    close(fd);
+    return ok;
+#endif
+}
+
+// read the rows of every plane that belong to luma rows src_luma_row(0 .. rows-1) of a raw frame,
+// into `frame_data` laid out as a frame of the same format that is `rows` rows high
+template <typename RowMap>
+bool read_frame_rows(const imcmp::FileInfo& file_info, int64_t frame_index, int rows, RowMap src_luma_row, std::vector<uchar>& frame_data)
+{
+    const imcmp::FormatDesc* format = file_info.format;
+    frame_data.resize(static_cast<int64_t>(rows) * file_info.width * format->size_num / format->size_den);
+
+    std::vector<FileRange> ranges;
+    int64_t plane_offset = frame_index * file_info.frame_size;
+    uchar* dst = frame_data.data();
+    for (int p = 0; p < format->plane_count; p++)
+    {
+        const imcmp::PlaneDesc& plane = format->planes[p];
+        const int64_t row_bytes = static_cast<int64_t>(file_info.width) * plane.row_num / plane.row_den;
+        const int plane_rows = rows >> plane.shift_y;
+        for (int k = 0; k < plane_rows; k++)
         {
-            int buf_size = height * width * 2;
-            cv::Mat yuv422_mat(height, width, CV_8UC2);
-            uchar* yuv_buf = yuv422_mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(yuv422_mat, image, cv::COLOR_YUV2BGR_UYVY);
+            const int src_row = src_luma_row(k << plane.shift_y) >> plane.shift_y;
+            // consecutive rows are read at once
+            if (!ranges.empty() && static_cast<uchar*>(ranges.back().buf) + ranges.back().size == dst
+                && ranges.back().offset + ranges.back().size == plane_offset + src_row * row_bytes)
+            {
+                ranges.back().size += row_bytes;
+            }
+            else
+            {
+                ranges.push_back({plane_offset + src_row * row_bytes, row_bytes, dst});
+            }
+            dst += row_bytes;
         }
-        else if (ext == "yuyv")
+        plane_offset += (file_info.height >> plane.shift_y) * row_bytes;
+    }
+    return read_file_ranges(file_info.filename, ranges);
+}
+
+} // namespace
+
+bool imcmp::read_fourcc_rows(const FileInfo& file_info, int64_t frame_index, int row_begin, int rows, std::vector<uchar>& frame_data)
+{
+    const FormatDesc* format = file_info.format;
+    if (!format || format->kind == FormatKind::Encoded)
+    {
+        fprintf(stderr, "not supported format %s\n", file_info.ext.c_str());
+        return false;
+    }
+    if (row_begin < 0 || rows <= 0 || row_begin + rows > file_info.height || row_begin % format->height_align != 0 || rows % format->height_align != 0)
+    {
+        fprintf(stderr, "rows [%d, %d) of %s are not whole groups of %d rows\n", row_begin, row_begin + rows, file_info.filename.c_str(), format->height_align);
+        return false;
+    }
+    if (frame_index < 0 || frame_index >= file_info.frame_count)
+    {
+        fprintf(stderr, "frame %lld out of range [0, %lld) in %s\n", (long long)frame_index, (long long)file_info.frame_count, file_info.filename.c_str());
+        return false;
+    }
+    return read_frame_rows(file_info, frame_index, rows, [row_begin](int luma_row) { return row_begin + luma_row; }, frame_data);
+}
+
+bool imcmp::has_native_samples(const FileInfo& file_info)
+{
+    return file_info.format && file_info.format->kind == FormatKind::Native;
+}
+
+bool imcmp::convert_fourcc_to_bgra(const FileInfo& file_info, const uchar* frame_data, cv::Mat& bgra)
+{
+    const FormatDesc* format = file_info.format;
+    const int height = file_info.height;
+    const int width = file_info.width;
+    const int64_t pixels = static_cast<int64_t>(height) * width;
+    if (!format || format->kind == FormatKind::Encoded)
+    {
+        fprintf(stderr, "not supported format %s\n", file_info.ext.c_str());
+        return false;
+    }
+
+    switch (format->kind)
+    {
+    case FormatKind::CvtColor:
+    {
+        // one cvtColor pass from the raw layout straight into BGRA; OpenCV's kernels are vectorized and run in parallel
+        uchar* data = const_cast<uchar*>(frame_data); // only wrapped by a read-only cv::Mat header
+        cv::Mat src(height * format->src_rows_x2 / 2, width, format->src_type, data);
+        // no-op when `bgra` is already allocated with this size, so callers may reuse it across frames
+        bgra.create(height, width, CV_8UC4);
+        if (format->cvt_code >= 0)
         {
-            int buf_size = height * width * 2;
-            cv::Mat yuv422_mat(height, width, CV_8UC2);
-            uchar* yuv_buf = yuv422_mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(yuv422_mat, image, cv::COLOR_YUV2BGR_YUYV);
+            cv::cvtColor(src, bgra, format->cvt_code);
         }
-        else if (ext == "yvyu")
+        else if (src.data != bgra.data)
         {
-            int buf_size = height * width * 2;
-            cv::Mat yuv422_mat(height, width, CV_8UC2);
-            uchar* yuv_buf = yuv422_mat.data;
-            fread(yuv_buf, buf_size, 1, fin);
-            fclose(fin);
-            cv::cvtColor(yuv422_mat, image, cv::COLOR_YUV2BGR_YVYU);
+            src.copyTo(bgra);
         }
+        break;
     }
-    else if (ext == "bgr24" || ext == "rgb24" || ext == "rgba32" || ext == "bgra32" || ext == "gray")
+    case FormatKind::PlanarYuv:
     {
-        int channels = 1; // "gray"
-        if (file_info.ext == "bgr24" || file_info.ext == "rgb24")
+        // layouts cvtColor() has no code for go through our own single-pass kernels
+        const int chroma_width = width >> format->chroma_shift_x;
+        const int64_t chroma_size = pixels >> (format->chroma_shift_x + format->chroma_shift_y);
+        const uchar* y_plane = frame_data;
+        const uchar* p1 = y_plane + pixels;
+        const uchar* p2 = p1 + chroma_size;
+        int y_stride = width;
+        int chroma_stride = chroma_width;
+        if (format->line_packed)
         {
-            channels = 3;
+            // every row holds its Y, then its U, then its V
+            p1 = y_plane + width;
+            p2 = p1 + chroma_width;
+            y_stride = chroma_stride = width + 2 * chroma_width;
         }
-        else if (file_info.ext == "rgba32" || file_info.ext == "bgra32")
+        planar_yuv_to_bgra(y_plane, y_stride, format->swap_uv ? p2 : p1, chroma_stride, format->swap_uv ? p1 : p2, chroma_stride,
+                           width, height, format->chroma_shift_x, format->chroma_shift_y, bgra);
+        break;
+    }
+    case FormatKind::PackedYuv422:
+        packed_yuv422_to_bgra(frame_data, width, height, format->order, bgra);
+        break;
+    case FormatKind::PackedYuv444:
+        packed_yuv444_to_bgra(frame_data, width, height, format->order, bgra);
+        break;
+    case FormatKind::Native:
+    {
+        thread_local cv::Mat native;
+        if (!unpack_fourcc_to_native(file_info, frame_data, native))
         {
-            channels = 4;
+            return false;
         }
+        native_to_bgra(file_info, native, bgra);
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
+}
+
+bool imcmp::unpack_fourcc_to_native(const FileInfo& file_info, const uchar* frame_data, cv::Mat& native)
+{
+    const FormatDesc* format = file_info.format;
+    const int height = file_info.height;
+    const int width = file_info.width;
+    if (!format || format->kind != FormatKind::Native)
+    {
+        fprintf(stderr, "not supported high bit depth format %s\n", file_info.ext.c_str());
+        return false;
+    }
+    const bool big_endian = format->big_endian;
+    const int shift = format->shift;
+
+    switch (format->layout)
+    {
+    case NativeLayout::Plane8:
+        cv::Mat(height, width, CV_8UC1, const_cast<uchar*>(frame_data)).copyTo(native);
+        break;
+    case NativeLayout::Plane16:
+        native.create(height, width, CV_16UC1);
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++)
+            {
+                unpack_u16(frame_data + (size_t)i * width * 2, native.ptr<ushort>(i), width, shift, big_endian);
+            }
+        });
+        break;
+    case NativeLayout::Raw10:
+    case NativeLayout::Raw12:
+    {
+        const bool raw10 = (format->layout == NativeLayout::Raw10);
+        const size_t row_bytes = (size_t)width * format->size_num / format->size_den;
+        native.create(height, width, CV_16UC1);
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++)
+            {
+                if (raw10)
+                    unpack_raw10(frame_data + i * row_bytes, native.ptr<ushort>(i), width);
+                else
+                    unpack_raw12(frame_data + i * row_bytes, native.ptr<ushort>(i), width);
+            }
+        });
+        break;
+    }
+    case NativeLayout::Rgb48:
+        native.create(height, width, CV_16UC3);
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++)
+            {
+                unpack_u16(frame_data + (size_t)i * width * 6, native.ptr<ushort>(i), width * 3, shift, big_endian);
+            }
+        });
+        cv::cvtColor(native, native, cv::COLOR_RGB2BGR);
+        break;
+    case NativeLayout::P01x:
+    {
+        // like nv12 with 16-bit samples; p010 keeps its 10 bits in the high bits of each sample
+        const uchar* uv_plane = frame_data + (size_t)height * width * 2;
+        native.create(height, width, CV_16UC3);
+        cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+            std::vector<ushort> y_row(width);
+            std::vector<ushort> uv_row(width);
+            for (int i = range.start; i < range.end; i++)
+            {
+                unpack_u16(frame_data + (size_t)i * width * 2, y_row.data(), width, shift, big_endian);
+                unpack_u16(uv_plane + (size_t)(i / 2) * width * 2, uv_row.data(), width, shift, big_endian);
+                merge_yuv420sp_row_16u(y_row.data(), uv_row.data(), native.ptr<ushort>(i), width);
+            }
+        });
+        break;
+    }
+    }
+    return true;
+}
 
-        int height = file_info.height;
-        int width = file_info.width;
-        FILE* fin = fopen(file_info.filename.c_str(), "rb");
-        int buf_size = height * width * channels;
-        cv::Size size;
-        size.height = height;
-        size.width = width;
-        image = cv::Mat(size, CV_8UC(channels));
-        fread(image.data, buf_size, 1, fin);
-        fclose(fin);
-
-        if (file_info.ext == "rgb24") // bgr => rgb, inplace
+void imcmp::native_to_bgra(const FileInfo& file_info, const cv::Mat& native, cv::Mat& bgra)
+{
+    thread_local cv::Mat scaled;
+    cv::Mat native8 = native;
+    if (native.depth() != CV_8U)
+    {
+        native.convertTo(scaled, CV_8U, 1.0 / (1 << (file_info.bit_depth - 8)));
+        native8 = scaled;
+    }
+
+    bgra.create(native.size(), CV_8UC4);
+    if (!file_info.cfa_pattern.empty())
+    {
+        // OpenCV names Bayer codes by the 2x2 block starting at the second row and column
+        const std::string& cfa = file_info.cfa_pattern;
+        int code = cv::COLOR_BayerGR2BGRA;
+        if (cfa == "rggb") code = cv::COLOR_BayerBG2BGRA;
+        else if (cfa == "bggr") code = cv::COLOR_BayerRG2BGRA;
+        else if (cfa == "grbg") code = cv::COLOR_BayerGB2BGRA;
+        cv::cvtColor(native8, bgra, code); // bilinear, vectorized
+    }
+    else if (file_info.format->layout == NativeLayout::P01x)
+    {
+        static const int yuv_order[3] = { 0, 1, 2 };
+        packed_yuv444_to_bgra(native8.data, native8.cols, native8.rows, yuv_order, bgra);
+    }
+    else if (native8.channels() == 3)
+    {
+        cv::cvtColor(native8, bgra, cv::COLOR_BGR2BGRA);
+    }
+    else
+    {
+        cv::cvtColor(native8, bgra, cv::COLOR_GRAY2BGRA);
+    }
+}
+
+cv::Mat imcmp::load_native_frame(const FileInfo& file_info, int64_t frame_index)
+{
+    if (!has_native_samples(file_info))
+    {
+        fprintf(stderr, "%s has no native high bit depth or Bayer samples\n", file_info.filename.c_str());
+        return cv::Mat();
+    }
+    if (frame_index < 0 || frame_index >= file_info.frame_count)
+    {
+        fprintf(stderr, "frame %lld out of range [0, %lld) in %s\n", (long long)frame_index, (long long)file_info.frame_count, file_info.filename.c_str());
+        return cv::Mat();
+    }
+
+    thread_local std::vector<uchar> frame_data;
+    frame_data.resize(file_info.frame_size);
+    if (!read_file_range(file_info.filename, frame_index * file_info.frame_size, file_info.frame_size, frame_data.data()))
+    {
+        fprintf(stderr, "failed to read frame %lld of %s\n", (long long)frame_index, file_info.filename.c_str());
+        return cv::Mat();
+    }
+    cv::Mat native;
+    if (!unpack_fourcc_to_native(file_info, frame_data.data(), native))
+    {
+        return cv::Mat();
+    }
+    return native;
+}
+
+cv::Mat imcmp::load_fourcc_and_convert_to_mat(const FileInfo& file_info, int64_t frame_index)
+{
+    if (frame_index < 0 || frame_index >= file_info.frame_count)
+    {
+        fprintf(stderr, "frame %lld out of range [0, %lld) in %s\n", (long long)frame_index, (long long)file_info.frame_count, file_info.filename.c_str());
+        return cv::Mat();
+    }
+    const int64_t offset = frame_index * file_info.frame_size;
+
+    // the only full-frame allocation of a load
+    cv::Mat image(file_info.height, file_info.width, CV_8UC4);
+    if (file_info.format && file_info.format->kind == FormatKind::CvtColor && file_info.format->src_type == CV_8UC4)
+    {
+        // already 4 bytes per pixel: read straight into the output and swap in place if needed
+        if (!read_file_range(file_info.filename, offset, file_info.frame_size, image.data))
         {
-            cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+            fprintf(stderr, "failed to read frame %lld of %s\n", (long long)frame_index, file_info.filename.c_str());
+            return cv::Mat();
         }
-        else if (file_info.ext == "rgba32")
+        convert_fourcc_to_bgra(file_info, image.data, image);
+        return image;
+    }
+
+    // raw bytes go to a per-thread staging buffer, which is reused by later loads
+    thread_local std::vector<uchar> frame_data;
+    frame_data.resize(file_info.frame_size);
+    if (!read_file_range(file_info.filename, offset, file_info.frame_size, frame_data.data()))
+    {
+        fprintf(stderr, "failed to read frame %lld of %s\n", (long long)frame_index, file_info.filename.c_str());
+        return cv::Mat();
+    }
+    if (!convert_fourcc_to_bgra(file_info, frame_data.data(), image))
+    {
+        return cv::Mat();
+    }
+    return image;
+}
+
+cv::Mat imcmp::load_fourcc_preview(const FileInfo& file_info, int reduction, int64_t frame_index)
+{
+    const FormatDesc* format = file_info.format;
+    if (!format || format->kind == FormatKind::Encoded)
+    {
+        fprintf(stderr, "not supported format %s\n", file_info.ext.c_str());
+        return cv::Mat();
+    }
+    // rows are sampled in groups of height_align rows, so chroma rows and CFA phases stay paired with their luma rows
+    const int align = format->height_align;
+    const int height = file_info.height / (align * reduction) * align;
+    if (reduction <= 1 || height == 0)
+    {
+        return load_fourcc_and_convert_to_mat(file_info, frame_index);
+    }
+    if (frame_index < 0 || frame_index >= file_info.frame_count)
+    {
+        fprintf(stderr, "frame %lld out of range [0, %lld) in %s\n", (long long)frame_index, (long long)file_info.frame_count, file_info.filename.c_str());
+        return cv::Mat();
+    }
+
+    // a frame of the same format holding only the sampled rows of every plane
+    FileInfo reduced = file_info;
+    reduced.height = height;
+    thread_local std::vector<uchar> frame_data;
+    const auto sampled_row = [&](int luma_row) { return luma_row / align * align * reduction + luma_row % align; };
+    if (!read_frame_rows(file_info, frame_index, height, sampled_row, frame_data))
+    {
+        fprintf(stderr, "failed to read frame %lld of %s\n", (long long)frame_index, file_info.filename.c_str());
+        return cv::Mat();
+    }
+
+    // only the sampled rows are converted; columns are then picked by nearest neighbour
+    thread_local cv::Mat rows_bgra;
+    if (!convert_fourcc_to_bgra(reduced, frame_data.data(), rows_bgra))
+    {
+        return cv::Mat();
+    }
+    cv::Mat preview;
+    cv::resize(rows_bgra, preview, cv::Size(std::max(1, file_info.width / reduction), height), 0, 0, cv::INTER_NEAREST);
+    return preview;
+}
+
+namespace {
+using namespace imcmp;
+
+// smaller files decode faster than a thread pool spins up
+const int64_t parallel_decode_min_bytes = 4 << 20;
+
+// decode large JPEG and PNG files on several threads, if their streams allow it
+bool decode_in_parallel(const FileInfo& file_info, cv::Mat& image)
+{
+    if (get_file_size(file_info.filename.c_str()) < parallel_decode_min_bytes)
+    {
+        return false;
+    }
+    if (file_info.ext == "jpg" || file_info.ext == "jpeg")
+    {
+        return decode_jpeg_parallel(file_info.filename, image);
+    }
+    if (file_info.ext == "png")
+    {
+        return decode_png_pipelined(file_info.filename, image);
+    }
+    return false;
+}
+
+cv::Mat read_image(const FileInfo& file_info, int64_t frame_index)
+{
+    cv::Mat image;
+    if (file_info.format->kind == FormatKind::Encoded)
+    {
+        if (!decode_in_parallel(file_info, image))
         {
-            cv::cvtColor(image, image, cv::COLOR_RGBA2BGRA);
+            image = cv::imread(file_info.filename, cv::IMREAD_UNCHANGED);
         }
     }
     else
     {
-        fprintf(stderr, "not supported format %s\n", file_info.ext.c_str());
+        image = load_fourcc_and_convert_to_mat(file_info, frame_index);
     }
     return image;
 }
 
-cv::Mat read_image(const FileInfo& file_info)
+// JPEG is scaled by the decoder (IDCT scaling) by 1/2, 1/4 or 1/8; any remainder is resized. Other formats gain
+// nothing from the reduced imread flags, which also drop alpha, so they are decoded in full like read_image() and
+// resized. EXIF orientation is ignored, like IMREAD_UNCHANGED does for the full image.
+cv::Mat read_encoded_preview(const FileInfo& file_info, int reduction)
 {
     cv::Mat image;
-    if (file_info.ext == "bmp" || file_info.ext == "jpg" || file_info.ext == ".jpeg" || file_info.ext == "png")
+    int decoded_reduction = 1;
+    if (file_info.ext == "jpg" || file_info.ext == "jpeg")
     {
-        image = cv::imread(file_info.filename, cv::IMREAD_UNCHANGED);
+        int flag = cv::IMREAD_COLOR;
+        if (reduction >= 8)
+        {
+            flag = cv::IMREAD_REDUCED_COLOR_8;
+            decoded_reduction = 8;
+        }
+        else if (reduction >= 4)
+        {
+            flag = cv::IMREAD_REDUCED_COLOR_4;
+            decoded_reduction = 4;
+        }
+        else if (reduction >= 2)
+        {
+            flag = cv::IMREAD_REDUCED_COLOR_2;
+            decoded_reduction = 2;
+        }
+        image = cv::imread(file_info.filename, flag | cv::IMREAD_IGNORE_ORIENTATION);
     }
     else
     {
-        image = load_fourcc_and_convert_to_mat(file_info);
+        image = read_image(file_info, 0);
+    }
+    if (image.empty())
+    {
+        return image;
+    }
+    if (reduction > decoded_reduction)
+    {
+        cv::Size size(std::max(1, image.cols * decoded_reduction / reduction), std::max(1, image.rows * decoded_reduction / reduction));
+        cv::resize(image, image, size, 0, 0, cv::INTER_AREA);
+    }
+    if (image.depth() == CV_16U)
+    {
+        // previews stay 8-bit, as the reduced flags decode them
+        image.convertTo(image, CV_8U, 1.0 / 257);
+    }
+    switch (image.channels())
+    {
+    case 1:
+        cv::cvtColor(image, image, cv::COLOR_GRAY2BGRA);
+        break;
+    case 3:
+        cv::cvtColor(image, image, cv::COLOR_BGR2BGRA);
+        break;
+    default:
+        break;
     }
     return image;
 }
 
-FileInfo get_meta_info(const std::string& filename)
+} // namespace
+
+FileInfo imcmp::get_meta_info(const std::string& filename)
 {
     FileInfo file_info;
     file_info.filename = filename;
@@ -197,45 +592,16 @@ FileInfo get_meta_info(const std::string& filename)
                 ext[i] = tolower(ext[i]);
             }
         }
-        // convert raw extension (lowercase) to identical extention
-        bool do_opencv_identical_ext_mapping = true;
-        if (do_opencv_identical_ext_mapping)
-        {
-            if (ext == "yuv" || ext == "iyuv")
-            {
-                ext = "i420";
-            }
-            else if (ext == "y422" || ext == "uynv")
-            {
-                ext = "uyvy";
-            }
-        }
-
-        bool do_yuvviewer_identical_ext_mapping = true;
-        if (do_yuvviewer_identical_ext_mapping)
-        {
-            if (ext == "grey")
-            {
-                ext = "gray";
-            }
-        }
+        /// validate filename's ext; aliases such as "yuv" map to their canonical format, e.g. "i420"
+        const FormatDesc* format = find_format(ext);
         file_info.head = head;
-        file_info.ext = ext;
-
-        /// validate filename's ext
-        bool found = false;
-        std::vector<std::string> valid_ext = get_supported_image_file_exts();
-        for (int i = 0; i < valid_ext.size(); i++)
-        {
-            if (valid_ext[i] == ext)
-            {
-                found = true;
-            }
-        }
-        if (!found)
+        file_info.ext = format ? format->ext : ext;
+        file_info.format = format;
+        if (!format)
         {
             file_info.valid = false;
             file_info.err_msg = "invalid filename extension! Currently only supports these: (case insensitive) ";
+            const std::vector<std::string>& valid_ext = get_supported_image_file_exts();
             for (int i = 0; i < valid_ext.size(); i++)
             {
                 file_info.err_msg = file_info.err_msg + " " + valid_ext[i];
@@ -244,10 +610,12 @@ FileInfo get_meta_info(const std::string& filename)
         }
 
         // validate filename's head
-        if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp")
+        if (format->kind == FormatKind::Encoded)
         {
             break;
         }
+        file_info.bit_depth = format->bit_depth;
+        file_info.cfa_pattern = format->cfa;
 
         // (ext=="nv21" || ext=="nv12" || ext=="bgr24" || ext=="rgb24")
         // valid format for head:
@@ -296,59 +664,50 @@ FileInfo get_meta_info(const std::string& filename)
         file_info.height = height;
         file_info.width = width;
 
-        int actual_size = imcmp::get_file_size(filename);
-        int expected_size = -1;
-        if (ext == "nv21" || ext == "nv12" || ext == "i420" || ext == "yv12")
-        {
-            expected_size = height * width * 3 / 2;
-        }
-        else if (ext == "rgb24" || ext == "bgr24")
-        {
-            expected_size = height * width * 3;
-        }
-        else if (ext == "rgba32" || ext == "bgra32")
-        {
-            expected_size = height * width * 4;
-        }
-        else if (ext == "gray")
+        const int64_t actual_size = imcmp::get_file_size(filename);
+        if (actual_size < 0)
         {
-            expected_size = height * width;
-        }
-        else if (ext == "uyvy" || ext == "yuyv" || ext == "yvyu")
-        {
-            expected_size = height * width * 2;
+            file_info.valid = false;
+            file_info.err_msg = "file " + filename + " does not exist or can't be read";
+            break;
         }
+        const int64_t expected_size = static_cast<int64_t>(height) * width * format->size_num / format->size_den; // of one frame
 
-        if (expected_size != actual_size)
+        // a raw file may hold a sequence of same-sized frames
+        if (expected_size <= 0 || actual_size == 0 || actual_size % expected_size != 0)
         {
             file_info.valid = false;
             file_info.err_msg = "invalid file size, filename described different that actual";
             break;
         }
+        file_info.frame_size = expected_size;
+        file_info.frame_count = actual_size / expected_size;
 
-        if (ext == "nv21" || ext == "nv12" || ext == "i420" || ext == "uyvy" || ext == "yuyv" || ext == "yv12" || ext == "yvyu")
+        if (width % format->width_align != 0 || height % format->height_align != 0)
         {
-            if (height % 2 != 0 || width % 2 != 0)
-            {
-                file_info.valid = false;
-                file_info.err_msg = "file dimension invalid. both height and width should be even number";
-                break;
-            }
+            file_info.valid = false;
+            file_info.err_msg = cv::format("file dimension invalid. width should be multiple of %d and height multiple of %d", format->width_align, format->height_align);
+            break;
         }
     } while (0);
 
     return file_info;
 }
 
-} // namespace
-
-int imcmp::get_file_size(const Str256& filepath)
+int64_t imcmp::get_file_size(const Str256& filepath)
 {
-    std::filesystem::path p{filepath.c_str()};
-    return std::filesystem::file_size(p);
+    // the error_code overload, so a file removed or not yet readable is reported rather than thrown
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(std::filesystem::path{filepath.c_str()}, ec);
+    return ec ? -1 : static_cast<int64_t>(size);
 }
 
 cv::Mat imcmp::load_image(const std::string& image_path)
+{
+    return load_image_frame(image_path, 0);
+}
+
+cv::Mat imcmp::load_image_frame(const std::string& image_path, int64_t frame_index)
 {
     /// check if file exist or not
     if (!imcmp::file_exist(image_path))
@@ -366,11 +725,140 @@ cv::Mat imcmp::load_image(const std::string& image_path)
     else
     {
         printf("reading file %s\n", image_path.c_str());
-        cv::Mat image = read_image(file_info);
+        cv::Mat image = read_image(file_info, frame_index);
         return image;
     }
 }
 
+cv::Mat imcmp::load_image_preview(const std::string& image_path, int reduction, int64_t frame_index)
+{
+    if (reduction <= 1)
+    {
+        return load_image_frame(image_path, frame_index);
+    }
+    if (!imcmp::file_exist(image_path))
+    {
+        fprintf(stderr, "file %s does not exist\n", image_path.c_str());
+        return cv::Mat();
+    }
+
+    FileInfo file_info = get_meta_info(image_path);
+    if (!file_info.valid)
+    {
+        fprintf(stderr, "%s\n", file_info.err_msg.c_str());
+        return cv::Mat();
+    }
+    if (file_info.format->kind == FormatKind::Encoded)
+    {
+        return read_encoded_preview(file_info, reduction);
+    }
+    return load_fourcc_preview(file_info, reduction, frame_index);
+}
+
+imcmp::RawSequence::RawSequence()
+    : fd(-1), fp(NULL)
+{
+}
+
+imcmp::RawSequence::~RawSequence()
+{
+    close();
+}
+
+bool imcmp::RawSequence::open(const std::string& filepath)
+{
+    close();
+    if (!file_exist(filepath))
+    {
+        fprintf(stderr, "file %s does not exist\n", filepath.c_str());
+        return false;
+    }
+    file_info = get_meta_info(filepath);
+    if (!file_info.valid)
+    {
+        fprintf(stderr, "%s\n", file_info.err_msg.c_str());
+        return false;
+    }
+    if (file_info.frame_size <= 0)
+    {
+        fprintf(stderr, "%s is not a raw (fourcc) file\n", filepath.c_str());
+        return false;
+    }
+#if _WIN32
+    fp = fopen(filepath.c_str(), "rb");
+    return fp != NULL;
+#else
+    fd = ::open(filepath.c_str(), O_RDONLY);
+    return fd >= 0;
+#endif
+}
+
+void imcmp::RawSequence::close()
+{
+#if _WIN32
+    if (fp)
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+#else
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+bool imcmp::RawSequence::is_open() const
+{
+    return fd >= 0 || fp != NULL;
+}
+
+const imcmp::FileInfo& imcmp::RawSequence::info() const
+{
+    return file_info;
+}
+
+int64_t imcmp::RawSequence::frame_count() const
+{
+    return is_open() ? file_info.frame_count : 0;
+}
+
+bool imcmp::RawSequence::read_frame(int64_t index, void* buf) const
+{
+    if (!is_open() || index < 0 || index >= file_info.frame_count)
+    {
+        return false;
+    }
+    const int64_t offset = index * file_info.frame_size;
+#if _WIN32
+    std::lock_guard<std::mutex> lock(mutex);
+    return (_fseeki64(fp, offset, SEEK_SET) == 0) && (fread(buf, 1, file_info.frame_size, fp) == file_info.frame_size);
+#else
+    return pread_all(fd, offset, file_info.frame_size, buf);
+#endif
+}
+
+cv::Mat imcmp::RawSequence::load_frame(int64_t index) const
+{
+    cv::Mat bgra;
+    load_frame(index, bgra);
+    return bgra;
+}
+
+bool imcmp::RawSequence::load_frame(int64_t index, cv::Mat& bgra) const
+{
+    thread_local std::vector<uchar> frame_data;
+    frame_data.resize(file_info.frame_size);
+    if (!read_frame(index, frame_data.data()))
+    {
+        fprintf(stderr, "failed to read frame %lld of %s\n", (long long)index, file_info.filename.c_str());
+        return false;
+    }
+    return convert_fourcc_to_bgra(file_info, frame_data.data(), bgra);
+}
+
 /// @brief check if file exist
 /// @retval true file exist
 /// @retval false file not exist
@@ -395,54 +883,8 @@ bool imcmp::file_exist(const std::string& filename)
 
 std::vector<std::string> imcmp::get_supported_image_file_exts()
 {
-    static std::vector<std::string> exts = {
-        "jpg",
-        "jpeg",
-        "png",
-        "bmp",
-
-        "rgb24",
-        "bgr24",
-        "rgba32",
-        "bgra32",
-        "gray", "grey",
-
-        "nv21", // yuv420sp
-        "nv12",
-        "i420", 
-            "iyuv", // opencv
-            "yuv",  // yuvviewer
-
-        "uyvy",
-            "y422", // opencv
-            "uynv", // opencv
-
-        "yuyv",
-            "yunv", // opencv
-            "yuy2", // opencv
-
-        "yv12",  // yuv420p
-        "yvyu",
-
-        // not supported yet
-        "i444",
-        "yv24",
-        "uyvy2",
-        "vyuy",
-        "vyuy2",
-        "yuyv2",
-        "i422h",
-        "yv16h",
-        "i422v",
-        "yv16v",
-        "lpi422h",
-        "yvu",
-        "uvy",
-        "vuy",
-    };
-
     // YUVviewer supported:
     // I444, YV24, NV12, NV21, I420, YV12, UYVY, UYVY2, VYUY, VYUY2, YUYV, YUYV2, YVYU, YVYU2, I422H, YV16H, I422V, YV16V, LPI422H, YUV, YVU, UVY, VUY, Gray, Grey
 
-    return exts;
+    return supported_format_exts();
 }
\ No newline at end of file
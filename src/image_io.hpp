@@ -1,16 +1,118 @@
 #pragma once
 
 #include "Str.h"
+#include "image_format.hpp"
+#include <mutex>
+#include <stdint.h>
 #include <opencv2/opencv.hpp>
 
 namespace imcmp {
 
-int get_file_size(const Str256& filepath);
+class FileInfo
+{
+public:
+    FileInfo()
+    {
+        height = -1;
+        width = -1;
+        head = "";
+        ext = "";
+        valid = true;
+        err_msg = "";
+        frame_size = 0;
+        frame_count = 1;
+        bit_depth = 8;
+        cfa_pattern = "";
+        format = NULL;
+    }
+    std::string filename;
+    std::string head;
+    std::string raw_ext; // same as file
+    std::string ext; // converted to lowercase, then mapping to identical one
+    int height;
+    int width;
+    bool valid;
+    std::string err_msg;
+    int64_t frame_size; // bytes of one frame, raw (fourcc) formats only
+    int64_t frame_count; // raw files may hold a sequence of frames
+    int bit_depth; // of the samples; > 8 for p010, y10, rgb48 etc., which also load in native units
+    std::string cfa_pattern; // Bayer mosaic layout, e.g. "rggb"; empty if not a Bayer format
+    const FormatDesc* format; // of `ext`, NULL if not supported
+};
+
+/// @brief high bit depth and Bayer formats can be loaded in native units, i.e. undemosaiced and unscaled
+bool has_native_samples(const FileInfo& file_info);
+
+/// @return -1 if the file does not exist or can't be read
+int64_t get_file_size(const Str256& filepath);
 bool file_exist(const char* filename);
 bool file_exist(const std::string& filename);
 
 std::vector<std::string> get_supported_image_file_exts();
 cv::Mat load_image(const std::string& image_path);
+/// @brief load frame `frame_index` of a raw sequence; same as load_image() for other formats and frame 0
+cv::Mat load_image_frame(const std::string& image_path, int64_t frame_index);
+/// @brief load an image at about 1/`reduction` of its width and height, e.g. for previews and thumbnails
+/// JPEG is downscaled while decoding; other encoded formats are decoded in full and resized, keeping alpha; raw
+/// formats only read and convert every `reduction`-th group of rows and keep every `reduction`-th column. EXIF
+/// orientation is ignored, as in the full image. Returns 8-bit BGRA; `reduction` <= 1 is the same as load_image_frame().
+cv::Mat load_image_preview(const std::string& image_path, int reduction, int64_t frame_index = 0);
+
+/// @brief parse and validate extension, dimension (from `[prefix]_[width]x[height].[ext]`) and file size
+FileInfo get_meta_info(const std::string& filename);
+/// @brief load a raw (fourcc) image described by `file_info`, convert to BGRA
+cv::Mat load_fourcc_and_convert_to_mat(const FileInfo& file_info, int64_t frame_index = 0);
+/// @brief load_fourcc_and_convert_to_mat() at about 1/`reduction` of the size, see load_image_preview()
+cv::Mat load_fourcc_preview(const FileInfo& file_info, int reduction, int64_t frame_index = 0);
+/// @brief read rows [row_begin, row_begin + rows) of every plane of a raw frame, laid out as a frame of `rows` rows
+/// `row_begin` and `rows` are multiples of the format's height_align; convert the result with
+/// convert_fourcc_to_bgra() given a FileInfo whose height is `rows`
+bool read_fourcc_rows(const FileInfo& file_info, int64_t frame_index, int row_begin, int rows, std::vector<uchar>& frame_data);
+/// @brief convert one frame of raw (fourcc) bytes to BGRA in a single pass
+/// `bgra` is only (re)allocated if it does not already have the frame's size and CV_8UC4 type
+bool convert_fourcc_to_bgra(const FileInfo& file_info, const uchar* frame_data, cv::Mat& bgra);
+
+/// @brief unpack one frame of a format with has_native_samples() to LSB aligned samples
+/// CV_16UC1 for gray formats, CV_16UC3 BGR for rgb48, CV_16UC3 YUV (chroma upsampled) for p010/p016,
+/// and the mosaic itself for Bayer formats: CV_8UC1 for 8-bit, otherwise CV_16UC1
+bool unpack_fourcc_to_native(const FileInfo& file_info, const uchar* frame_data, cv::Mat& native);
+/// @brief load a frame in native units, see unpack_fourcc_to_native()
+cv::Mat load_native_frame(const FileInfo& file_info, int64_t frame_index = 0);
+/// @brief scale native samples down to 8 bits (demosaic Bayer ones) and convert to BGRA for display
+void native_to_bgra(const FileInfo& file_info, const cv::Mat& native, cv::Mat& bgra);
+
+/// @brief random access to the frames of a raw (fourcc) file
+///
+/// The file stays open, and frame k is read at offset k * frame_size with pread(),
+/// so frames can be loaded in any order and from several threads at once.
+class RawSequence
+{
+public:
+    RawSequence();
+    ~RawSequence();
+    RawSequence(const RawSequence&) = delete;
+    RawSequence& operator=(const RawSequence&) = delete;
+
+    bool open(const std::string& filepath);
+    void close();
+    bool is_open() const;
+
+    const FileInfo& info() const;
+    int64_t frame_count() const;
+
+    /// @brief read the raw bytes of frame `index` into `buf`, which holds info().frame_size bytes
+    bool read_frame(int64_t index, void* buf) const;
+    /// @brief read and convert frame `index` to BGRA, like load_image_frame()
+    cv::Mat load_frame(int64_t index) const;
+    /// @brief same as above, but reuses `bgra` if it already has the right size
+    bool load_frame(int64_t index, cv::Mat& bgra) const;
+
+private:
+    FileInfo file_info;
+    int fd;
+    FILE* fp; // _WIN32 has no pread(), so reads are serialized on fp
+    mutable std::mutex mutex;
+};
 
 
 } // namespace imcmp
\ No newline at end of file
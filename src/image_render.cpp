@@ -68,12 +68,43 @@ GLuint imcmp::getTextureFromImage(const cv::Mat& image)
 
 namespace imcmp {
 
-void RichImage::load_from_file(const Str256& filepath)
+DecodedImage decode_image_file(const std::string& path, int64_t _frame_index, int _reduction)
 {
-    //cv::Mat mat = cv::imread(filepath.c_str(), cv::IMREAD_UNCHANGED);
-    std::string imagepath = filepath.c_str();
-    cv::Mat mat = load_image(imagepath);
-    if (mat.empty()) return;
+    DecodedImage decoded;
+    decoded.path = path;
+    if (!file_exist(path))
+    {
+        fprintf(stderr, "file %s does not exist\n", path.c_str());
+        return decoded;
+    }
+    FileInfo file_info = get_meta_info(path);
+    decoded.frame_count = file_info.valid ? file_info.frame_count : 1;
+    decoded.frame_index = std::min(std::max<int64_t>(_frame_index, 0), decoded.frame_count - 1);
+    cv::Mat mat;
+    if (_reduction > 1)
+    {
+        // a preview has no native samples; they are loaded with the full decode
+        mat = load_image_preview(path, _reduction, decoded.frame_index);
+    }
+    else if (file_info.valid && has_native_samples(file_info))
+    {
+        // keep the native samples for compare, and show them scaled down to 8 bits and demosaiced
+        decoded.native = load_native_frame(file_info, decoded.frame_index);
+        if (decoded.native.empty()) return decoded;
+        native_to_bgra(file_info, decoded.native, mat);
+    }
+    else
+    {
+        mat = load_image_frame(path, decoded.frame_index);
+    }
+    if (mat.empty())
+    {
+        decoded.native.release();
+        return decoded;
+    }
+    decoded.reduction = std::max(_reduction, 1);
+    decoded.bit_depth = decoded.native.empty() ? 8 : file_info.bit_depth;
+    decoded.cfa_pattern = decoded.native.empty() ? "" : file_info.cfa_pattern;
     switch (mat.channels())
     {
     case 1:
@@ -88,16 +119,52 @@ void RichImage::load_from_file(const Str256& filepath)
     default:
         printf("only support 1, 3, 4 channels\n"); // TODO: fix me. consider encapsulate cv::imread(), support 2 channels.
     }
-    load_mat(mat);
-    set_name(filepath);
-    filesize = imcmp::get_file_size(filepath);
+    decoded.mat = mat;
+    return decoded;
+}
+
+void RichImage::load_from_file(const Str256& filepath, int64_t _frame_index, int _reduction)
+{
+    //cv::Mat mat = cv::imread(filepath.c_str(), cv::IMREAD_UNCHANGED);
+    DecodedImage decoded = decode_image_file(filepath.c_str(), _frame_index, _reduction);
+    load_decoded(decoded);
+}
+
+void RichImage::load_decoded(DecodedImage& decoded)
+{
+    if (decoded.mat.empty()) return;
+    frame_count = decoded.frame_count;
+    frame_index = decoded.frame_index;
+    native = decoded.native;
+    reduction = decoded.reduction;
+    bit_depth = decoded.bit_depth;
+    cfa_pattern = decoded.cfa_pattern;
+    load_mat(decoded.mat);
+    set_name(decoded.path.c_str());
+    filesize = std::max<int64_t>(imcmp::get_file_size(decoded.path.c_str()), 0);
 }
 
 void RichImage::reload()
 {
     if (name.length() > 0)
     {
-        load_from_file(name.c_str());
+        load_from_file(name.c_str(), frame_index, reduction);
+    }
+}
+
+void RichImage::load_full()
+{
+    if (name.length() > 0 && reduction > 1)
+    {
+        load_from_file(name.c_str(), frame_index);
+    }
+}
+
+void RichImage::load_frame(int64_t _frame_index)
+{
+    if (name.length() > 0 && _frame_index != frame_index)
+    {
+        load_from_file(name.c_str(), _frame_index, reduction);
     }
 }
 
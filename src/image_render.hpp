@@ -8,6 +8,22 @@ namespace imcmp {
 
 GLuint getTextureFromImage(const cv::Mat& image);
 
+// the pixels RichImage::load_from_file() decodes, before any texture is made, so they can be decoded on a worker thread
+class DecodedImage
+{
+public:
+    std::string path;
+    cv::Mat mat; // BGRA, empty if the decode failed
+    cv::Mat native;
+    int bit_depth = 8;
+    std::string cfa_pattern;
+    int64_t frame_index = 0;
+    int64_t frame_count = 1;
+    int reduction = 1;
+};
+
+DecodedImage decode_image_file(const std::string& path, int64_t frame_index = 0, int reduction = 1);
+
 class RichImage
 {
 public:
@@ -15,16 +31,29 @@ public:
     cv::Mat mat;
     bool open;
     std::string name;
-    int filesize;
+    int64_t filesize;
+    int64_t frame_index; // of a raw sequence
+    int64_t frame_count;
+    cv::Mat native; // high bit depth samples in native units, or a Bayer mosaic; empty for other formats
+    int bit_depth;
+    std::string cfa_pattern; // of a Bayer mosaic
+    int reduction; // 1 if `mat` is full resolution, else it is a preview of about 1/reduction the width and height
 
 public:
     RichImage()
-        : texture(0), open(false)
+        : texture(0), open(false), filesize(0), frame_index(0), frame_count(1), bit_depth(8), reduction(1)
     {
     }
 
-    void load_from_file(const Str256& filepath);
+    // `reduction` > 1 loads a quick preview, see load_image_preview()
+    void load_from_file(const Str256& filepath, int64_t frame_index = 0, int reduction = 1);
+    // show what decode_image_file() returned; ignored if it failed
+    void load_decoded(DecodedImage& decoded);
     void reload();
+    // replace a preview by the full resolution image
+    void load_full();
+    // load another frame of the same raw sequence
+    void load_frame(int64_t frame_index);
     void load_mat(cv::Mat& frame);
     void update_mat(cv::Mat& frame, bool change_color_order = false);
     // clear texture and realease all memory associated with it
@@ -0,0 +1,474 @@
+#include "jpeg_io.hpp"
+#include <opencv2/imgproc.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if IMCMP_WITH_LIBJPEG
+#include <atomic>
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+bool imcmp::is_jpeg_file(const std::string& path)
+{
+    FILE* fin = fopen(path.c_str(), "rb");
+    if (fin == NULL)
+    {
+        return false;
+    }
+    unsigned char magic[3] = {0, 0, 0};
+    const bool ok = fread(magic, 1, 3, fin) == 3;
+    fclose(fin);
+    return ok && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF;
+}
+
+#if IMCMP_WITH_LIBJPEG
+
+namespace {
+
+class JpegErrorManager
+{
+public:
+    jpeg_error_mgr pub; // must be first, libjpeg only sees this
+    jmp_buf jump;
+};
+
+void on_jpeg_error(j_common_ptr cinfo)
+{
+    longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+void on_jpeg_message(j_common_ptr cinfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    fprintf(stderr, "libjpeg: %s\n", message);
+}
+
+// libjpeg errors longjmp() to `err.jump`, which the caller sets before every libjpeg call
+class JpegDecompressor
+{
+public:
+    JpegDecompressor()
+    {
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = on_jpeg_error;
+        err.pub.output_message = on_jpeg_message;
+        jpeg_create_decompress(&cinfo);
+    }
+    ~JpegDecompressor()
+    {
+        jpeg_destroy_decompress(&cinfo);
+    }
+    JpegDecompressor(const JpegDecompressor&) = delete;
+    JpegDecompressor& operator=(const JpegDecompressor&) = delete;
+
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager err;
+};
+
+// entropy decodes a whole file to its DCT coefficients, which libjpeg keeps in memory
+class JpegCoefficientReader : public JpegDecompressor
+{
+public:
+    JpegCoefficientReader() = default;
+    ~JpegCoefficientReader()
+    {
+        if (fin)
+        {
+            fclose(fin);
+        }
+    }
+
+    bool read(const std::string& path)
+    {
+        fin = fopen(path.c_str(), "rb");
+        if (fin == NULL)
+        {
+            return false;
+        }
+        if (setjmp(err.jump))
+        {
+            return false;
+        }
+        jpeg_stdio_src(&cinfo, fin);
+        jpeg_read_header(&cinfo, TRUE);
+        coefficients = jpeg_read_coefficients(&cinfo);
+        return coefficients != NULL;
+    }
+
+    // one row of blocks of component `c`
+    JBLOCKROW block_row(int c, int row)
+    {
+        return cinfo.mem->access_virt_barray(reinterpret_cast<j_common_ptr>(&cinfo), coefficients[c], row, 1, FALSE)[0];
+    }
+
+    FILE* fin = NULL;
+    jvirt_barray_ptr* coefficients = NULL;
+};
+
+// same geometry, sampling, color transform and quantization, so equal coefficients mean equal pixels
+bool same_layout(const jpeg_decompress_struct& a, const jpeg_decompress_struct& b)
+{
+    if (a.image_width != b.image_width || a.image_height != b.image_height
+        || a.num_components != b.num_components || a.jpeg_color_space != b.jpeg_color_space
+        || a.saw_Adobe_marker != b.saw_Adobe_marker || a.Adobe_transform != b.Adobe_transform
+        || a.max_h_samp_factor != b.max_h_samp_factor || a.max_v_samp_factor != b.max_v_samp_factor)
+    {
+        return false;
+    }
+    for (int c = 0; c < a.num_components; c++)
+    {
+        const jpeg_component_info& ca = a.comp_info[c];
+        const jpeg_component_info& cb = b.comp_info[c];
+        if (ca.h_samp_factor != cb.h_samp_factor || ca.v_samp_factor != cb.v_samp_factor
+            || ca.quant_table == NULL || cb.quant_table == NULL
+            || memcmp(ca.quant_table->quantval, cb.quant_table->quantval, sizeof(ca.quant_table->quantval)) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// where a sequential JPEG keeps its one scan, and the restart markers cutting it into intervals
+class JpegScanLayout
+{
+public:
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    int mcu_width = 8;
+    int mcu_height = 8;
+    int restart_interval = 0; // in MCUs
+    size_t sof_height_pos = 0; // of the 2 byte image height in SOF
+    size_t scan_begin = 0;     // first byte of entropy coded data
+    size_t scan_end = 0;       // the EOI marker
+    std::vector<size_t> restarts; // RSTn markers in the scan
+
+    size_t interval_begin(int k) const
+    {
+        return k == 0 ? scan_begin : restarts[k - 1] + 2;
+    }
+    size_t interval_end(int k) const
+    {
+        return k == static_cast<int>(restarts.size()) ? scan_end : restarts[k];
+    }
+};
+
+bool parse_scan_layout(const std::vector<uchar>& data, JpegScanLayout& layout)
+{
+    if (data.size() < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return false;
+    }
+    int max_h = 1;
+    int max_v = 1;
+    size_t pos = 2;
+    while (pos + 4 <= data.size())
+    {
+        if (data[pos] != 0xFF)
+        {
+            return false;
+        }
+        const int marker = data[pos + 1];
+        if (marker == 0xFF)
+        {
+            pos++; // fill byte
+            continue;
+        }
+        const size_t length = (data[pos + 2] << 8) | data[pos + 3];
+        const uchar* segment = data.data() + pos + 4;
+        if (length < 2 || pos + 2 + length > data.size())
+        {
+            return false;
+        }
+        if (marker == 0xC0 || marker == 0xC1)
+        {
+            // baseline or extended sequential Huffman; 8-bit samples only
+            if (length < 8 || segment[0] != 8)
+            {
+                return false;
+            }
+            layout.sof_height_pos = pos + 5;
+            layout.height = (segment[1] << 8) | segment[2];
+            layout.width = (segment[3] << 8) | segment[4];
+            layout.components = segment[5];
+            if (length < 8 + 3 * static_cast<size_t>(layout.components))
+            {
+                return false;
+            }
+            for (int c = 0; c < layout.components; c++)
+            {
+                max_h = std::max(max_h, segment[7 + 3 * c] >> 4);
+                max_v = std::max(max_v, segment[7 + 3 * c] & 15);
+            }
+        }
+        else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            return false; // progressive, lossless or arithmetic coded
+        }
+        else if (marker == 0xDD && length == 4)
+        {
+            layout.restart_interval = (segment[0] << 8) | segment[1];
+        }
+        else if (marker == 0xDA)
+        {
+            // one interleaved scan of all components
+            if (layout.height == 0 || segment[0] != layout.components)
+            {
+                return false;
+            }
+            layout.scan_begin = pos + 2 + length;
+            break;
+        }
+        pos += 2 + length;
+    }
+    if (layout.scan_begin == 0 || (layout.components != 1 && layout.components != 3))
+    {
+        return false;
+    }
+    if (layout.components == 3)
+    {
+        layout.mcu_width = 8 * max_h;
+        layout.mcu_height = 8 * max_v;
+    }
+
+    // stuffed 0xFF00 bytes are data, and RSTn markers can't be followed by anything but another interval
+    const uchar* base = data.data();
+    size_t i = layout.scan_begin;
+    while (true)
+    {
+        const uchar* p = static_cast<const uchar*>(memchr(base + i, 0xFF, data.size() - i));
+        if (p == NULL || p + 1 >= base + data.size())
+        {
+            return false;
+        }
+        i = p - base;
+        const uchar next = p[1];
+        if (next == 0x00)
+        {
+            i += 2;
+        }
+        else if (next >= 0xD0 && next <= 0xD7)
+        {
+            layout.restarts.push_back(i);
+            i += 2;
+        }
+        else if (next == 0xFF)
+        {
+            i += 1;
+        }
+        else
+        {
+            layout.scan_end = i;
+            return next == 0xD9; // another scan or DNL can't be sliced
+        }
+    }
+}
+
+// a JPEG of its own holding MCU rows [mcu_begin, mcu_end), coded by intervals [first, last]: the headers, the height patched, and those intervals
+void make_slice_stream(const std::vector<uchar>& data, const JpegScanLayout& layout, int mcu_begin, int mcu_end, int first, int last, std::vector<uchar>& stream)
+{
+    const int height = std::min(mcu_end * layout.mcu_height, layout.height) - mcu_begin * layout.mcu_height;
+    const size_t begin = layout.interval_begin(first);
+    const size_t end = layout.interval_end(last);
+
+    stream.assign(data.begin(), data.begin() + layout.scan_begin);
+    stream[layout.sof_height_pos] = static_cast<uchar>(height >> 8);
+    stream[layout.sof_height_pos + 1] = static_cast<uchar>(height & 255);
+    stream.insert(stream.end(), data.begin() + begin, data.begin() + end);
+    // the decoder expects RST0, RST1, ... from the start of the scan
+    for (int k = first; k < last; k++)
+    {
+        stream[layout.scan_begin + (layout.restarts[k] - begin) + 1] = static_cast<uchar>(0xD0 + ((k - first) & 7));
+    }
+    stream.push_back(0xFF);
+    stream.push_back(0xD9);
+}
+
+// decode `stream` whose first row is row `first_row` of `image`, keeping rows [keep_begin, keep_end)
+bool decode_slice(const std::vector<uchar>& stream, int first_row, int keep_begin, int keep_end, cv::Mat& image)
+{
+    JpegDecompressor jpeg;
+    std::vector<uchar> context_row(image.cols * image.channels());
+    if (setjmp(jpeg.err.jump))
+    {
+        return false;
+    }
+    jpeg_mem_src(&jpeg.cinfo, const_cast<uchar*>(stream.data()), stream.size());
+    jpeg_read_header(&jpeg.cinfo, TRUE);
+#ifdef JCS_EXTENSIONS
+    jpeg.cinfo.out_color_space = (image.channels() == 1) ? JCS_GRAYSCALE : JCS_EXT_BGR;
+#else
+    // IJG libjpeg has no BGR output; kept rows are swapped from RGB below
+    jpeg.cinfo.out_color_space = (image.channels() == 1) ? JCS_GRAYSCALE : JCS_RGB;
+#endif
+    jpeg_start_decompress(&jpeg.cinfo);
+    while (jpeg.cinfo.output_scanline < jpeg.cinfo.output_height)
+    {
+        const int row = first_row + jpeg.cinfo.output_scanline;
+        const bool keep = (row >= keep_begin && row < keep_end);
+        JSAMPROW dst = keep ? image.ptr(row) : context_row.data();
+        jpeg_read_scanlines(&jpeg.cinfo, &dst, 1);
+#ifndef JCS_EXTENSIONS
+        if (keep && image.channels() == 3)
+        {
+            for (int x = 0; x < image.cols; x++)
+            {
+                std::swap(dst[3 * x], dst[3 * x + 2]);
+            }
+        }
+#endif
+    }
+    jpeg_finish_decompress(&jpeg.cinfo);
+    return true;
+}
+
+} // namespace
+
+bool imcmp::decode_jpeg_parallel(const std::string& path, cv::Mat& image, int slice_count)
+{
+    std::vector<uchar> data;
+    FILE* fin = fopen(path.c_str(), "rb");
+    if (fin == NULL)
+    {
+        return false;
+    }
+    fseek(fin, 0, SEEK_END);
+    data.resize(ftell(fin));
+    fseek(fin, 0, SEEK_SET);
+    const bool read_ok = fread(data.data(), 1, data.size(), fin) == data.size();
+    fclose(fin);
+
+    JpegScanLayout layout;
+    if (!read_ok || !parse_scan_layout(data, layout))
+    {
+        return false;
+    }
+    // slices are cut where both an MCU row and a restart interval start: every `unit_rows` MCU rows, `unit_intervals` intervals
+    const int mcus_per_row = (layout.width + layout.mcu_width - 1) / layout.mcu_width;
+    const int mcu_rows = (layout.height + layout.mcu_height - 1) / layout.mcu_height;
+    const int interval = layout.restart_interval;
+    int unit_rows = 0;
+    int unit_intervals = 0;
+    if (interval > 0 && mcus_per_row % interval == 0)
+    {
+        unit_rows = 1;
+        unit_intervals = mcus_per_row / interval;
+    }
+    else if (interval > 0 && interval % mcus_per_row == 0)
+    {
+        unit_rows = interval / mcus_per_row;
+        unit_intervals = 1;
+    }
+    const int64_t total_mcus = static_cast<int64_t>(mcus_per_row) * mcu_rows;
+    if (unit_rows == 0 || static_cast<int64_t>(layout.restarts.size()) + 1 != (total_mcus + interval - 1) / interval)
+    {
+        return false;
+    }
+    const int units = (mcu_rows + unit_rows - 1) / unit_rows;
+    const int last_interval = static_cast<int>(layout.restarts.size());
+
+    if (slice_count <= 0)
+    {
+        slice_count = cv::getNumThreads();
+    }
+    slice_count = std::max(1, std::min(slice_count, units));
+    image.create(layout.height, layout.width, layout.components == 1 ? CV_8UC1 : CV_8UC3);
+
+    std::atomic<bool> ok(true);
+    cv::parallel_for_(cv::Range(0, slice_count), [&](const cv::Range& range) {
+        std::vector<uchar> stream;
+        for (int s = range.start; s < range.end && ok; s++)
+        {
+            const int unit_begin = static_cast<int>(static_cast<int64_t>(units) * s / slice_count);
+            const int unit_end = static_cast<int>(static_cast<int64_t>(units) * (s + 1) / slice_count);
+            // one unit of context on either side, so upsampling at the slice edges sees the same neighbours as a full decode
+            const int context_begin = std::max(unit_begin - 1, 0);
+            const int context_end = std::min(unit_end + 1, units);
+            make_slice_stream(data, layout, context_begin * unit_rows, std::min(context_end * unit_rows, mcu_rows),
+                              context_begin * unit_intervals, std::min(context_end * unit_intervals - 1, last_interval), stream);
+            const int keep_begin = unit_begin * unit_rows * layout.mcu_height;
+            const int keep_end = std::min(unit_end * unit_rows * layout.mcu_height, layout.height);
+            if (!decode_slice(stream, context_begin * unit_rows * layout.mcu_height, keep_begin, keep_end, image))
+            {
+                ok = false;
+            }
+        }
+    });
+    return ok;
+}
+
+imcmp::JpegCompare imcmp::compare_jpeg_coefficients(const std::string& left_path, const std::string& right_path, cv::Mat& block_map)
+{
+    JpegCoefficientReader left;
+    JpegCoefficientReader right;
+    if (!left.read(left_path) || !right.read(right_path) || !same_layout(left.cinfo, right.cinfo))
+    {
+        return JpegCompare::Undecided;
+    }
+    // access_virt_barray() may fail too
+    if (setjmp(left.err.jump))
+    {
+        return JpegCompare::Undecided;
+    }
+    if (setjmp(right.err.jump))
+    {
+        return JpegCompare::Undecided;
+    }
+
+    const int map_rows = (left.cinfo.image_height + DCTSIZE - 1) / DCTSIZE;
+    const int map_cols = (left.cinfo.image_width + DCTSIZE - 1) / DCTSIZE;
+    block_map.create(map_rows, map_cols, CV_8UC1);
+    block_map = cv::Scalar(0);
+    bool identical = true;
+    bool subsampled = false;
+    for (int c = 0; c < left.cinfo.num_components; c++)
+    {
+        const jpeg_component_info& comp = left.cinfo.comp_info[c];
+        subsampled |= (comp.h_samp_factor != left.cinfo.max_h_samp_factor || comp.v_samp_factor != left.cinfo.max_v_samp_factor);
+        // a block of a subsampled component covers scale_x x scale_y pixel blocks
+        const int scale_x = left.cinfo.max_h_samp_factor / comp.h_samp_factor;
+        const int scale_y = left.cinfo.max_v_samp_factor / comp.v_samp_factor;
+        for (int row = 0; row < static_cast<int>(comp.height_in_blocks); row++)
+        {
+            JBLOCKROW lrow = left.block_row(c, row);
+            JBLOCKROW rrow = right.block_row(c, row);
+            for (int col = 0; col < static_cast<int>(comp.width_in_blocks); col++)
+            {
+                if (memcmp(lrow[col], rrow[col], sizeof(JBLOCK)) == 0)
+                {
+                    continue;
+                }
+                identical = false;
+                const cv::Rect blocks = cv::Rect(col * scale_x, row * scale_y, scale_x, scale_y) & cv::Rect(0, 0, map_cols, map_rows);
+                block_map(blocks) = cv::Scalar(255);
+            }
+        }
+    }
+    if (!identical && subsampled)
+    {
+        // fancy upsampling interpolates chroma across block edges, so a changed chroma block also changes the edge
+        // pixels of the neighboring blocks; one MCU on each side covers them
+        const int mcu_x = left.cinfo.max_h_samp_factor;
+        const int mcu_y = left.cinfo.max_v_samp_factor;
+        cv::dilate(block_map, block_map, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * mcu_x + 1, 2 * mcu_y + 1)));
+    }
+    return identical ? JpegCompare::Identical : JpegCompare::Different;
+}
+
+#else
+
+bool imcmp::decode_jpeg_parallel(const std::string& path, cv::Mat& image, int slice_count)
+{
+    return false;
+}
+
+imcmp::JpegCompare imcmp::compare_jpeg_coefficients(const std::string& left_path, const std::string& right_path, cv::Mat& block_map)
+{
+    return JpegCompare::Undecided;
+}
+
+#endif // IMCMP_WITH_LIBJPEG
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+
+namespace imcmp {
+
+/// result of compare_jpeg_coefficients()
+enum class JpegCompare
+{
+    Identical, // same quantization tables and DCT coefficients, so the decoded pixels are identical too
+    Different, // same layout and tables, but some coefficients differ
+    Undecided, // not comparable in the DCT domain (or built without libjpeg); compare decoded pixels instead
+};
+
+/// @brief true if the file starts with a JPEG SOI marker
+bool is_jpeg_file(const std::string& path);
+
+/// @brief compare two JPEG files by their quantized DCT coefficients, without IDCT or color conversion
+/// Files that only differ in metadata (EXIF, comments, ...) are Identical. For Different, `block_map`
+/// is a CV_8UC1 with one element per 8x8 pixel block of the image, 255 where any component's coefficients
+/// differ, widened by one MCU on each side if chroma is subsampled, since upsampling spreads a changed chroma
+/// block into the edge pixels of its neighbors; for Identical it is all 0. Sizes, sampling factors, color spaces or quantization tables that
+/// differ give Undecided, as the pixels may then differ anywhere.
+JpegCompare compare_jpeg_coefficients(const std::string& left_path, const std::string& right_path, cv::Mat& block_map);
+
+/// @brief decode a large sequential JPEG on several threads into `image`, the same as cv::imread(IMREAD_UNCHANGED)
+/// The scan is cut at restart markers into `slice_count` bands of MCU rows (0: one per thread), and each band
+/// is decoded as a JPEG of its own, with one MCU row of context on either side so chroma upsampling matches a
+/// full decode. `image` (CV_8UC1 or BGR CV_8UC3) is only (re)allocated if it does not already have the right size.
+/// @return false if the file has no restart marker at every MCU row, is progressive, or is not a JPEG
+bool decode_jpeg_parallel(const std::string& path, cv::Mat& image, int slice_count = 0);
+
+} // namespace imcmp
@@ -0,0 +1,202 @@
+#include "noise_model.hpp"
+#include "image_compare.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+namespace {
+
+// `n` samples of one row into the sums and envelopes
+void accumulate_row(const uchar* x, ushort* sum, unsigned* sqr_sum, uchar* lo, uchar* hi, int n)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    const int half = cv::v_uint16::nlanes;
+    const int quarter = cv::v_uint32::nlanes;
+    for (; j + step <= n; j += step)
+    {
+        const cv::v_uint8 v = cv::vx_load(x + j);
+        cv::v_store(lo + j, cv::v_min(cv::vx_load(lo + j), v));
+        cv::v_store(hi + j, cv::v_max(cv::vx_load(hi + j), v));
+        cv::v_uint16 a, b;
+        cv::v_expand(v, a, b);
+        cv::v_store(sum + j, cv::vx_load(sum + j) + a);
+        cv::v_store(sum + j + half, cv::vx_load(sum + j + half) + b);
+        cv::v_uint32 q0, q1, q2, q3;
+        cv::v_mul_expand(a, a, q0, q1);
+        cv::v_mul_expand(b, b, q2, q3);
+        cv::v_store(sqr_sum + j, cv::vx_load(sqr_sum + j) + q0);
+        cv::v_store(sqr_sum + j + quarter, cv::vx_load(sqr_sum + j + quarter) + q1);
+        cv::v_store(sqr_sum + j + 2 * quarter, cv::vx_load(sqr_sum + j + 2 * quarter) + q2);
+        cv::v_store(sqr_sum + j + 3 * quarter, cv::vx_load(sqr_sum + j + 3 * quarter) + q3);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < n; j++)
+    {
+        lo[j] = std::min(lo[j], x[j]);
+        hi[j] = std::max(hi[j], x[j]);
+        sum[j] += x[j];
+        sqr_sum[j] += x[j] * x[j];
+    }
+}
+
+// per pixel max over the channels of how far a BGRA sample is outside [lo, hi]
+void excess_row(const uchar* x, const uchar* lo, const uchar* hi, uchar* delta, int cols)
+{
+    int j = 0;
+#if CV_SIMD
+    const int step = cv::v_uint8::nlanes;
+    for (; j + step <= cols; j += step)
+    {
+        cv::v_uint8 x0, x1, x2, x3, l0, l1, l2, l3, h0, h1, h2, h3;
+        cv::v_load_deinterleave(x + j * 4, x0, x1, x2, x3);
+        cv::v_load_deinterleave(lo + j * 4, l0, l1, l2, l3);
+        cv::v_load_deinterleave(hi + j * 4, h0, h1, h2, h3);
+        // saturating, so at most one side of each max is non zero
+        const cv::v_uint8 e01 = cv::v_max(cv::v_max(l0 - x0, x0 - h0), cv::v_max(l1 - x1, x1 - h1));
+        const cv::v_uint8 e23 = cv::v_max(cv::v_max(l2 - x2, x2 - h2), cv::v_max(l3 - x3, x3 - h3));
+        cv::v_store(delta + j, cv::v_max(e01, e23));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; j < cols; j++)
+    {
+        int e = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            const int v = x[j * 4 + k];
+            e = std::max(e, std::max(lo[j * 4 + k] - v, v - hi[j * 4 + k]));
+        }
+        delta[j] = static_cast<uchar>(e);
+    }
+}
+
+} // namespace
+
+bool imcmp::NoiseModel::add(const cv::Mat& frame)
+{
+    if (frame.empty() || frame.depth() != CV_8U || (frames > 0 && frame.size() != sum.size()))
+    {
+        fprintf(stderr, "noise model references must be 8-bit images of the same size\n");
+        return false;
+    }
+    if (frames >= max_frames)
+    {
+        fprintf(stderr, "noise model holds at most %d references\n", max_frames);
+        return false;
+    }
+
+    cv::Mat bgra = frame;
+    if (frame.channels() == 1)
+    {
+        cv::cvtColor(frame, bgra, cv::COLOR_GRAY2BGRA);
+    }
+    else if (frame.channels() == 3)
+    {
+        cv::cvtColor(frame, bgra, cv::COLOR_BGR2BGRA);
+    }
+    if (frames == 0)
+    {
+        sum.create(bgra.size(), CV_16UC4);
+        sum = cv::Scalar::all(0);
+        sqr_sum.create(bgra.size(), CV_32SC4);
+        sqr_sum = cv::Scalar::all(0);
+        min_envelope = bgra.clone();
+        max_envelope = bgra.clone();
+    }
+
+    const int n = bgra.cols * 4;
+    cv::parallel_for_(cv::Range(0, bgra.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            accumulate_row(bgra.ptr<uchar>(i), sum.ptr<ushort>(i), sqr_sum.ptr<unsigned>(i), min_envelope.ptr<uchar>(i), max_envelope.ptr<uchar>(i), n);
+        }
+    });
+    frames++;
+    return true;
+}
+
+void imcmp::NoiseModel::reset()
+{
+    frames = 0;
+    sum.release();
+    sqr_sum.release();
+    min_envelope.release();
+    max_envelope.release();
+}
+
+int imcmp::NoiseModel::frame_count() const
+{
+    return frames;
+}
+
+cv::Size imcmp::NoiseModel::size() const
+{
+    return sum.size();
+}
+
+void imcmp::NoiseModel::bounds(NoiseBound bound, float sigmas, int margin, cv::Mat& low, cv::Mat& high) const
+{
+    if (frames == 0)
+    {
+        low.release();
+        high.release();
+        return;
+    }
+    if (bound == NoiseBound::Envelope)
+    {
+        // saturating, so the bounds stay within [0, 255]
+        cv::subtract(min_envelope, cv::Scalar::all(margin), low);
+        cv::add(max_envelope, cv::Scalar::all(margin), high);
+        return;
+    }
+
+    low.create(sum.size(), CV_8UC4);
+    high.create(sum.size(), CV_8UC4);
+    const int64_t n = frames;
+    const int samples = sum.cols * 4;
+    cv::parallel_for_(cv::Range(0, sum.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            const ushort* s = sum.ptr<ushort>(i);
+            const unsigned* q = sqr_sum.ptr<unsigned>(i);
+            uchar* lo = low.ptr<uchar>(i);
+            uchar* hi = high.ptr<uchar>(i);
+            for (int j = 0; j < samples; j++)
+            {
+                // n * q - s * s is exact in 64 bits, so the variance of a constant sample is exactly 0
+                const double mean = static_cast<double>(s[j]) / n;
+                const double variance = (n > 1) ? static_cast<double>(n * q[j] - static_cast<int64_t>(s[j]) * s[j]) / (n * (n - 1)) : 0.0;
+                const double tolerance = sigmas * std::sqrt(variance) + margin;
+                lo[j] = cv::saturate_cast<uchar>(cvCeil(mean - tolerance - 1e-6));
+                hi[j] = cv::saturate_cast<uchar>(cvFloor(mean + tolerance + 1e-6));
+            }
+        }
+    });
+}
+
+cv::Mat imcmp::compare_to_noise_model(const cv::Mat& candidate, const cv::Mat& low, const cv::Mat& high, bool& is_within, int64_t& outside_pixels)
+{
+    if (candidate.type() != CV_8UC4 || low.type() != CV_8UC4 || high.type() != CV_8UC4 || candidate.size() != low.size() || candidate.size() != high.size())
+    {
+        fprintf(stderr, "noise model compare requires a BGRA candidate of the size of the references\n");
+        return cv::Mat();
+    }
+
+    cv::Mat delta(candidate.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, candidate.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            excess_row(candidate.ptr<uchar>(i), low.ptr<uchar>(i), high.ptr<uchar>(i), delta.ptr<uchar>(i), candidate.cols);
+        }
+    });
+    outside_pixels = cv::countNonZero(delta);
+    is_within = (outside_pixels == 0);
+
+    cv::Mat diff;
+    render_delta(delta, candidate, 0, diff);
+    return diff;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+namespace imcmp {
+
+enum class NoiseBound
+{
+    Sigma,    // mean +- sigmas * standard deviation
+    Envelope, // min to max of the references
+};
+
+/// @brief per sample noise floor of N reference captures of the same scene
+///
+/// References are added one at a time and only folded into running per sample moments and min/max envelopes,
+/// so building the model keeps one frame in memory whatever N is. The moments are exact integer sums: a 16-bit
+/// sum and a 32-bit sum of squares, which for 8-bit samples have none of the cancellation Welford's update
+/// avoids in floating point, in 6 bytes per sample. Accumulation is vectorized and runs rows in parallel.
+class NoiseModel
+{
+public:
+    static const int max_frames = 257; // 16-bit sums of 8-bit samples can't overflow
+
+    /// @brief fold in one 8-bit gray, BGR or BGRA capture, of the size of the first one
+    /// @retval false if the size or depth differs, or the model is full
+    bool add(const cv::Mat& frame);
+    void reset();
+    int frame_count() const;
+    cv::Size size() const;
+
+    /// @brief per sample CV_8UC4 range [low, high] a candidate sample may take, widened by `margin` on each side
+    /// `sigmas` is only used for NoiseBound::Sigma.
+    void bounds(NoiseBound bound, float sigmas, int margin, cv::Mat& low, cv::Mat& high) const;
+
+private:
+    int frames = 0;
+    cv::Mat sum;     // CV_16UC4
+    cv::Mat sqr_sum; // CV_32SC4
+    cv::Mat min_envelope;
+    cv::Mat max_envelope;
+};
+
+/// @brief compare a BGRA candidate to the per sample bounds of a NoiseModel
+/// @return diff image like compare_two_mat(), with the pixels having any channel outside the bounds in red;
+///         empty if sizes or types differ
+cv::Mat compare_to_noise_model(const cv::Mat& candidate, const cv::Mat& low, const cv::Mat& high, bool& is_within, int64_t& outside_pixels);
+
+} // namespace imcmp
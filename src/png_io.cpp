@@ -0,0 +1,536 @@
+#include "png_io.hpp"
+#include <opencv2/imgproc.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if IMCMP_WITH_ZLIB
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+#endif
+
+#if IMCMP_WITH_ZLIB
+
+namespace {
+
+uint32_t read_be32(const uchar* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+class PngLayout
+{
+public:
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<std::pair<const uchar*, uint32_t>> idat; // compressed data, in file order
+};
+
+bool parse_png_layout(const std::vector<uchar>& data, PngLayout& layout)
+{
+    static const uchar signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (data.size() < 8 || memcmp(data.data(), signature, 8) != 0)
+    {
+        return false;
+    }
+    size_t pos = 8;
+    while (pos + 12 <= data.size())
+    {
+        const uint32_t length = read_be32(&data[pos]);
+        const uchar* type = &data[pos + 4];
+        const uchar* chunk = &data[pos + 8];
+        if (length > data.size() - pos - 12)
+        {
+            return false;
+        }
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            // 8-bit, deflate, adaptive filtering, not interlaced
+            if (length != 13 || chunk[8] != 8 || chunk[10] != 0 || chunk[11] != 0 || chunk[12] != 0)
+            {
+                return false;
+            }
+            layout.width = static_cast<int>(read_be32(chunk));
+            layout.height = static_cast<int>(read_be32(chunk + 4));
+            const int color_type = chunk[9];
+            layout.channels = (color_type == 0) ? 1 : (color_type == 2) ? 3 : (color_type == 6) ? 4 : 0;
+            if (layout.channels == 0 || layout.width <= 0 || layout.height <= 0)
+            {
+                return false;
+            }
+        }
+        else if (memcmp(type, "tRNS", 4) == 0)
+        {
+            return false; // would add an alpha channel
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            layout.idat.emplace_back(chunk, length);
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            return layout.channels != 0 && !layout.idat.empty();
+        }
+        pos += 12 + length;
+    }
+    return false;
+}
+
+// undo the PNG filter of one row in place; `prev` is the previous unfiltered row, all zeros for the first one
+bool unfilter_row(int filter, uchar* row, const uchar* prev, int length, int bpp)
+{
+    switch (filter)
+    {
+    case 0:
+        break;
+    case 1:
+        for (int i = bpp; i < length; i++)
+        {
+            row[i] = static_cast<uchar>(row[i] + row[i - bpp]);
+        }
+        break;
+    case 2:
+        for (int i = 0; i < length; i++)
+        {
+            row[i] = static_cast<uchar>(row[i] + prev[i]);
+        }
+        break;
+    case 3:
+        for (int i = 0; i < bpp; i++)
+        {
+            row[i] = static_cast<uchar>(row[i] + (prev[i] >> 1));
+        }
+        for (int i = bpp; i < length; i++)
+        {
+            row[i] = static_cast<uchar>(row[i] + ((row[i - bpp] + prev[i]) >> 1));
+        }
+        break;
+    case 4:
+        for (int i = 0; i < bpp; i++)
+        {
+            row[i] = static_cast<uchar>(row[i] + prev[i]);
+        }
+        for (int i = bpp; i < length; i++)
+        {
+            const int a = row[i - bpp];
+            const int b = prev[i];
+            const int c = prev[i - bpp];
+            const int pa = std::abs(b - c);
+            const int pb = std::abs(a - c);
+            const int pc = std::abs(a + b - 2 * c);
+            const int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+            row[i] = static_cast<uchar>(row[i] + predictor);
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// bands of filtered rows handed from the inflating thread to the unfiltering one
+class BandRing
+{
+public:
+    static const int band_count = 4;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<uchar> bands[band_count];
+    int produced = 0;
+    int consumed = 0;
+    bool failed = false;
+};
+
+} // namespace
+
+bool imcmp::decode_png_pipelined(const std::string& path, cv::Mat& image)
+{
+    std::vector<uchar> data;
+    FILE* fin = fopen(path.c_str(), "rb");
+    if (fin == NULL)
+    {
+        return false;
+    }
+    fseek(fin, 0, SEEK_END);
+    data.resize(ftell(fin));
+    fseek(fin, 0, SEEK_SET);
+    const bool read_ok = fread(data.data(), 1, data.size(), fin) == data.size();
+    fclose(fin);
+
+    PngLayout layout;
+    if (!read_ok || !parse_png_layout(data, layout))
+    {
+        return false;
+    }
+    const int row_bytes = layout.width * layout.channels;
+    const int filtered_row_bytes = row_bytes + 1; // leading filter type byte
+    // about 256 KB per band
+    const int band_rows = std::max(1, std::min(layout.height, (256 << 10) / filtered_row_bytes));
+    const int band_total = (layout.height + band_rows - 1) / band_rows;
+
+    BandRing ring;
+    for (int k = 0; k < BandRing::band_count; k++)
+    {
+        ring.bands[k].resize(static_cast<size_t>(band_rows) * filtered_row_bytes);
+    }
+
+    std::thread inflater([&] {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        bool ok = inflateInit(&zs) == Z_OK;
+        if (!ok)
+        {
+            // the consumer waits for the first band, so tell it there won't be any
+            std::lock_guard<std::mutex> lock(ring.mutex);
+            ring.failed = true;
+            ring.changed.notify_all();
+            return;
+        }
+        size_t next_chunk = 0;
+        for (int b = 0; ok && b < band_total; b++)
+        {
+            {
+                std::unique_lock<std::mutex> lock(ring.mutex);
+                ring.changed.wait(lock, [&] { return b - ring.consumed < BandRing::band_count || ring.failed; });
+                if (ring.failed)
+                {
+                    break;
+                }
+            }
+            const int rows = std::min(band_rows, layout.height - b * band_rows);
+            zs.next_out = ring.bands[b % BandRing::band_count].data();
+            zs.avail_out = static_cast<uInt>(rows) * filtered_row_bytes;
+            while (ok && zs.avail_out > 0)
+            {
+                if (zs.avail_in == 0)
+                {
+                    if (next_chunk == layout.idat.size())
+                    {
+                        ok = false; // truncated
+                        break;
+                    }
+                    zs.next_in = const_cast<Bytef*>(layout.idat[next_chunk].first);
+                    zs.avail_in = layout.idat[next_chunk].second;
+                    next_chunk++;
+                }
+                const int ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END)
+                {
+                    ok = (zs.avail_out == 0);
+                    break;
+                }
+                ok = (ret == Z_OK) || (ret == Z_BUF_ERROR && zs.avail_in == 0);
+            }
+            std::lock_guard<std::mutex> lock(ring.mutex);
+            if (ok)
+            {
+                ring.produced = b + 1;
+            }
+            else
+            {
+                ring.failed = true;
+            }
+            ring.changed.notify_all();
+        }
+        inflateEnd(&zs);
+    });
+
+    image.create(layout.height, layout.width, CV_8UC(layout.channels));
+    std::vector<uchar> prev_row(row_bytes, 0);
+    bool ok = true;
+    for (int b = 0; ok && b < band_total; b++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(ring.mutex);
+            ring.changed.wait(lock, [&] { return ring.produced > b || ring.failed; });
+            if (ring.failed)
+            {
+                ok = false;
+                break;
+            }
+        }
+        uchar* band = ring.bands[b % BandRing::band_count].data();
+        const int rows = std::min(band_rows, layout.height - b * band_rows);
+        const uchar* prev = prev_row.data();
+        for (int i = 0; ok && i < rows; i++)
+        {
+            uchar* row = band + static_cast<size_t>(i) * filtered_row_bytes;
+            ok = unfilter_row(row[0], row + 1, prev, row_bytes, layout.channels);
+            prev = row + 1;
+        }
+        if (ok)
+        {
+            // the next band may land in this slot, so keep its last row for the Up, Average and Paeth filters
+            memcpy(prev_row.data(), prev, row_bytes);
+            cv::Mat src(rows, layout.width, CV_8UC(layout.channels), band + 1, filtered_row_bytes);
+            cv::Mat dst = image.rowRange(b * band_rows, b * band_rows + rows);
+            if (layout.channels == 3)
+            {
+                cv::cvtColor(src, dst, cv::COLOR_RGB2BGR);
+            }
+            else if (layout.channels == 4)
+            {
+                cv::cvtColor(src, dst, cv::COLOR_RGBA2BGRA);
+            }
+            else
+            {
+                src.copyTo(dst);
+            }
+        }
+        std::lock_guard<std::mutex> lock(ring.mutex);
+        ring.consumed = b + 1;
+        ring.failed |= !ok;
+        ring.changed.notify_all();
+    }
+    inflater.join();
+    return ok && !ring.failed;
+}
+
+class imcmp::PngRowReader::State
+{
+public:
+    ~State()
+    {
+        if (zs_ready)
+        {
+            inflateEnd(&zs);
+        }
+        if (fin)
+        {
+            fclose(fin);
+        }
+    }
+
+    // read the header of the next chunk
+    bool next_chunk(uint32_t& length, char type[4])
+    {
+        uchar header[8];
+        if (fread(header, 1, 8, fin) != 8)
+        {
+            return false;
+        }
+        length = read_be32(header);
+        memcpy(type, header + 4, 4);
+        return true;
+    }
+
+    // refill zlib's input from the current IDAT chunk, moving on to the next one at its end
+    bool fill_input()
+    {
+        while (idat_left == 0)
+        {
+            uint32_t length;
+            char type[4];
+            if (fseek(fin, 4, SEEK_CUR) != 0 || !next_chunk(length, type) || memcmp(type, "IDAT", 4) != 0)
+            {
+                return false; // image data ended early
+            }
+            idat_left = length;
+        }
+        const size_t n = fread(input.data(), 1, std::min<size_t>(idat_left, input.size()), fin);
+        if (n == 0)
+        {
+            return false;
+        }
+        idat_left -= static_cast<uint32_t>(n);
+        zs.next_in = input.data();
+        zs.avail_in = static_cast<uInt>(n);
+        return true;
+    }
+
+    FILE* fin = NULL;
+    z_stream zs;
+    bool zs_ready = false;
+    std::vector<uchar> input = std::vector<uchar>(64 << 10);
+    uint32_t idat_left = 0; // bytes of the current IDAT chunk not read yet
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    int rows_read = 0;
+    std::vector<uchar> filtered;
+    std::vector<uchar> prev_row;
+};
+
+bool imcmp::PngRowReader::open(const std::string& path)
+{
+    state.reset(new State());
+    State& st = *state;
+    st.fin = fopen(path.c_str(), "rb");
+    uchar signature[8];
+    static const uchar png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (st.fin == NULL || fread(signature, 1, 8, st.fin) != 8 || memcmp(signature, png_signature, 8) != 0)
+    {
+        return false;
+    }
+
+    // header chunks up to the first IDAT
+    uint32_t length;
+    char type[4];
+    while (st.next_chunk(length, type))
+    {
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            uchar chunk[13];
+            if (length != 13 || fread(chunk, 1, 13, st.fin) != 13 || fseek(st.fin, 4, SEEK_CUR) != 0)
+            {
+                return false;
+            }
+            if (chunk[8] != 8 || chunk[10] != 0 || chunk[11] != 0 || chunk[12] != 0)
+            {
+                return false;
+            }
+            st.width = static_cast<int>(read_be32(chunk));
+            st.height = static_cast<int>(read_be32(chunk + 4));
+            st.channels = (chunk[9] == 0) ? 1 : (chunk[9] == 2) ? 3 : (chunk[9] == 6) ? 4 : 0;
+        }
+        else if (memcmp(type, "tRNS", 4) == 0 || memcmp(type, "IEND", 4) == 0)
+        {
+            return false;
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            if (st.channels == 0 || st.width <= 0 || st.height <= 0)
+            {
+                return false;
+            }
+            st.idat_left = length;
+            memset(&st.zs, 0, sizeof(st.zs));
+            st.zs_ready = inflateInit(&st.zs) == Z_OK;
+            st.prev_row.assign(static_cast<size_t>(st.width) * st.channels, 0);
+            return st.zs_ready;
+        }
+        else if (fseek(st.fin, length + 4, SEEK_CUR) != 0)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+int imcmp::PngRowReader::width() const
+{
+    return state ? state->width : 0;
+}
+
+int imcmp::PngRowReader::height() const
+{
+    return state ? state->height : 0;
+}
+
+int imcmp::PngRowReader::channels() const
+{
+    return state ? state->channels : 0;
+}
+
+bool imcmp::PngRowReader::read_rows(int rows, cv::Mat& strip)
+{
+    if (!state || !state->zs_ready)
+    {
+        return false;
+    }
+    State& st = *state;
+    rows = std::min(rows, st.height - st.rows_read);
+    if (rows <= 0)
+    {
+        return false;
+    }
+    const int row_bytes = st.width * st.channels;
+    const int filtered_row_bytes = row_bytes + 1;
+    st.filtered.resize(static_cast<size_t>(rows) * filtered_row_bytes);
+    st.zs.next_out = st.filtered.data();
+    st.zs.avail_out = static_cast<uInt>(st.filtered.size());
+    while (st.zs.avail_out > 0)
+    {
+        if (st.zs.avail_in == 0 && !st.fill_input())
+        {
+            return false;
+        }
+        const int ret = inflate(&st.zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+        {
+            if (st.zs.avail_out != 0)
+            {
+                return false;
+            }
+            break;
+        }
+        if (ret != Z_OK && !(ret == Z_BUF_ERROR && st.zs.avail_in == 0))
+        {
+            return false;
+        }
+    }
+
+    const uchar* prev = st.prev_row.data();
+    for (int i = 0; i < rows; i++)
+    {
+        uchar* row = st.filtered.data() + static_cast<size_t>(i) * filtered_row_bytes;
+        if (!unfilter_row(row[0], row + 1, prev, row_bytes, st.channels))
+        {
+            return false;
+        }
+        prev = row + 1;
+    }
+    memcpy(st.prev_row.data(), prev, row_bytes);
+    st.rows_read += rows;
+
+    cv::Mat src(rows, st.width, CV_8UC(st.channels), st.filtered.data() + 1, filtered_row_bytes);
+    if (st.channels == 3)
+    {
+        cv::cvtColor(src, strip, cv::COLOR_RGB2BGR);
+    }
+    else if (st.channels == 4)
+    {
+        cv::cvtColor(src, strip, cv::COLOR_RGBA2BGRA);
+    }
+    else
+    {
+        src.copyTo(strip);
+    }
+    return true;
+}
+
+#else
+
+bool imcmp::decode_png_pipelined(const std::string& path, cv::Mat& image)
+{
+    return false;
+}
+
+class imcmp::PngRowReader::State
+{
+};
+
+bool imcmp::PngRowReader::open(const std::string& path)
+{
+    return false;
+}
+
+int imcmp::PngRowReader::width() const
+{
+    return 0;
+}
+
+int imcmp::PngRowReader::height() const
+{
+    return 0;
+}
+
+int imcmp::PngRowReader::channels() const
+{
+    return 0;
+}
+
+bool imcmp::PngRowReader::read_rows(int rows, cv::Mat& strip)
+{
+    return false;
+}
+
+#endif // IMCMP_WITH_ZLIB
+
+imcmp::PngRowReader::PngRowReader() = default;
+
+imcmp::PngRowReader::~PngRowReader() = default;
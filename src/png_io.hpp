@@ -0,0 +1,41 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+
+namespace imcmp {
+
+/// @brief decode a large PNG into `image`, the same as cv::imread(IMREAD_UNCHANGED), with inflate and unfiltering overlapped
+///
+/// Deflate streams can't be inflated in parallel in general, so one thread inflates the IDAT stream into a ring of
+/// row bands while the calling thread unfilters each band and swaps it to BGR(A) straight into `image`. Handles
+/// non-interlaced 8-bit gray, RGB and RGBA; `image` is only (re)allocated if it does not already have the right size.
+/// @return false for other PNGs (palette, 16-bit, interlaced, ...), corrupt ones or if built without zlib
+bool decode_png_pipelined(const std::string& path, cv::Mat& image);
+
+/// @brief read a PNG strip by strip, for images too large to decode at once
+///
+/// Memory is bounded by one strip of rows plus a small input buffer, whatever the image size.
+/// Handles the same PNGs as decode_png_pipelined().
+class PngRowReader
+{
+public:
+    PngRowReader();
+    ~PngRowReader();
+    PngRowReader(const PngRowReader&) = delete;
+    PngRowReader& operator=(const PngRowReader&) = delete;
+
+    bool open(const std::string& path);
+    int width() const;
+    int height() const;
+    int channels() const;
+    /// @brief decode the next `rows` rows (fewer at the bottom) into `strip`, as gray, BGR or BGRA
+    bool read_rows(int rows, cv::Mat& strip);
+
+private:
+    class State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace imcmp
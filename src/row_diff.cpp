@@ -0,0 +1,247 @@
+#include "row_diff.hpp"
+#include <algorithm>
+
+namespace {
+
+using imcmp::RowOp;
+using imcmp::RowRun;
+
+void push_run(std::vector<RowRun>& runs, RowOp op, int left_row, int right_row, int rows)
+{
+    if (rows <= 0)
+    {
+        return;
+    }
+    RowRun run;
+    run.op = op;
+    run.left_row = left_row;
+    run.right_row = right_row;
+    run.rows = rows;
+    runs.push_back(run);
+}
+
+// Myers' greedy search of the furthest reaching paths, where trace[d][k + d] is the furthest x on diagonal k
+// (x - y) after d edits, then a walk back from (n, m). Runs are appended in reverse order.
+bool myers_script(const uint64_t* a, int n, const uint64_t* b, int m, int max_edits, int left_base, int right_base, std::vector<RowRun>& reversed)
+{
+    const int max_d = std::min(n + m, max_edits);
+    const int offset = max_d + 1;
+    std::vector<int> v(2 * max_d + 3, 0);
+    std::vector<std::vector<int>> trace;
+    int edits = -1;
+    for (int d = 0; d <= max_d && edits < 0; d++)
+    {
+        for (int k = -d; k <= d; k += 2)
+        {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y])
+            {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m)
+            {
+                edits = d;
+                break;
+            }
+        }
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+    }
+    if (edits < 0)
+    {
+        return false;
+    }
+
+    int x = n;
+    int y = m;
+    for (int d = edits; d > 0; d--)
+    {
+        const std::vector<int>& prev = trace[d - 1];
+        const int k = x - y;
+        const bool down = (k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1]));
+        const int prev_k = down ? k + 1 : k - 1;
+        const int prev_x = prev[prev_k + d - 1];
+        const int prev_y = prev_x - prev_k;
+        const int mid_x = down ? prev_x : prev_x + 1;
+        push_run(reversed, RowOp::Same, left_base + mid_x, right_base + mid_x - k, x - mid_x);
+        push_run(reversed, down ? RowOp::Inserted : RowOp::Removed, left_base + prev_x, right_base + prev_y, 1);
+        x = prev_x;
+        y = prev_y;
+    }
+    push_run(reversed, RowOp::Same, left_base, right_base, x);
+    return true;
+}
+
+// merges adjacent runs of the same op, and pairs removals with the insertions next to them
+std::vector<RowRun> pair_runs(const std::vector<RowRun>& runs)
+{
+    std::vector<RowRun> merged;
+    for (const RowRun& run : runs)
+    {
+        if (!merged.empty() && merged.back().op == run.op)
+        {
+            merged.back().rows += run.rows;
+        }
+        else
+        {
+            merged.push_back(run);
+        }
+    }
+
+    std::vector<RowRun> paired;
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        const RowRun& run = merged[i];
+        const bool edit = (run.op == RowOp::Removed || run.op == RowOp::Inserted);
+        if (!edit || i + 1 == merged.size() || merged[i + 1].op == run.op || merged[i + 1].op == RowOp::Same)
+        {
+            push_run(paired, run.op, run.left_row, run.right_row, run.rows);
+            continue;
+        }
+        const RowRun& removed = (run.op == RowOp::Removed) ? run : merged[i + 1];
+        const RowRun& inserted = (run.op == RowOp::Inserted) ? run : merged[i + 1];
+        const int changed = std::min(removed.rows, inserted.rows);
+        push_run(paired, RowOp::Changed, removed.left_row, inserted.right_row, changed);
+        push_run(paired, RowOp::Removed, removed.left_row + changed, inserted.right_row + changed, removed.rows - changed);
+        push_run(paired, RowOp::Inserted, removed.left_row + changed, inserted.right_row + changed, inserted.rows - changed);
+        i++;
+    }
+    return paired;
+}
+
+// gray rendering of BGRA `src` into `dst`; removed and inserted bands are halved and tinted
+void render_band(const cv::Mat& src, cv::Mat& dst, RowOp op)
+{
+    cv::Mat gray;
+    cv::cvtColor(src, gray, cv::COLOR_BGRA2GRAY);
+    cv::cvtColor(gray, dst, cv::COLOR_GRAY2BGRA);
+    if (op == RowOp::Removed || op == RowOp::Inserted)
+    {
+        dst.convertTo(dst, -1, 0.5);
+        dst += (op == RowOp::Removed) ? cv::Scalar(0, 0, 128, 255) : cv::Scalar(0, 128, 0, 255);
+    }
+}
+
+} // namespace
+
+std::vector<imcmp::RowRun> imcmp::diff_hash_sequences(const std::vector<uint64_t>& left, const std::vector<uint64_t>& right, int max_edits)
+{
+    // common head and tail rows are the usual case, and keep the search small
+    const int n = static_cast<int>(left.size());
+    const int m = static_cast<int>(right.size());
+    int head = 0;
+    while (head < n && head < m && left[head] == right[head])
+    {
+        head++;
+    }
+    int tail = 0;
+    while (tail < n - head && tail < m - head && left[n - 1 - tail] == right[m - 1 - tail])
+    {
+        tail++;
+    }
+
+    std::vector<RowRun> runs;
+    push_run(runs, RowOp::Same, n - tail, m - tail, tail);
+    if (!myers_script(left.data() + head, n - head - tail, right.data() + head, m - head - tail, max_edits, head, head, runs))
+    {
+        // too different to be worth aligning, pair rows by position
+        const int middle_n = n - head - tail;
+        const int middle_m = m - head - tail;
+        const int changed = std::min(middle_n, middle_m);
+        push_run(runs, RowOp::Inserted, head + changed, head + changed, middle_m - changed);
+        push_run(runs, RowOp::Removed, head + changed, head + changed, middle_n - changed);
+        push_run(runs, RowOp::Changed, head, head, changed);
+    }
+    push_run(runs, RowOp::Same, 0, 0, head);
+    std::reverse(runs.begin(), runs.end());
+    return pair_runs(runs);
+}
+
+std::vector<uint64_t> imcmp::hash_rows(const cv::Mat& image)
+{
+    std::vector<uint64_t> hashes(image.rows);
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            hashes[i] = hash_region(image, cv::Rect(0, i, image.cols, 1));
+        }
+    });
+    return hashes;
+}
+
+cv::Mat imcmp::compare_structural(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool columns, bool& is_exactly_same, StructuralDiff& structure, DiffStats& stats)
+{
+    structure = StructuralDiff();
+    const bool aligned_axis = columns ? (image_left.rows == image_right.rows) : (image_left.cols == image_right.cols);
+    if (image_left.type() != CV_8UC4 || image_right.type() != CV_8UC4 || image_left.empty() || image_right.empty() || !aligned_axis)
+    {
+        return compare_two_mat(image_left, image_right, toleranceThresh, is_exactly_same, stats);
+    }
+
+    // columns are aligned as the rows of the transposed images
+    cv::Mat left = image_left;
+    cv::Mat right = image_right;
+    if (columns)
+    {
+        cv::transpose(image_left, left);
+        cv::transpose(image_right, right);
+    }
+    structure.columns = columns;
+    structure.runs = diff_hash_sequences(hash_rows(left), hash_rows(right));
+
+    int rows = 0;
+    for (const RowRun& run : structure.runs)
+    {
+        rows += run.rows;
+    }
+    cv::Mat diff(rows, left.cols, CV_8UC4);
+    stats = DiffStats();
+    stats.channels = 4;
+    int row = 0;
+    for (const RowRun& run : structure.runs)
+    {
+        cv::Mat band = diff.rowRange(row, row + run.rows);
+        row += run.rows;
+        const cv::Mat left_band = (run.op == RowOp::Inserted) ? cv::Mat() : left.rowRange(run.left_row, run.left_row + run.rows);
+        const cv::Mat right_band = (run.op == RowOp::Removed) ? cv::Mat() : right.rowRange(run.right_row, run.right_row + run.rows);
+        switch (run.op)
+        {
+        case RowOp::Same:
+        {
+            const int64_t pixels = static_cast<int64_t>(run.rows) * left.cols;
+            stats.pixels += pixels;
+            stats.histogram[0] += pixels;
+            render_band(left_band, band, run.op);
+            break;
+        }
+        case RowOp::Changed:
+        {
+            bool band_same = false;
+            DiffStats band_stats;
+            compare_two_mat(left_band, right_band, toleranceThresh, band_same, band_stats).copyTo(band);
+            stats.merge(band_stats);
+            structure.changed += run.rows;
+            break;
+        }
+        case RowOp::Removed:
+            render_band(left_band, band, run.op);
+            structure.removed += run.rows;
+            break;
+        case RowOp::Inserted:
+            render_band(right_band, band, run.op);
+            structure.inserted += run.rows;
+            break;
+        }
+    }
+    is_exactly_same = (structure.removed == 0 && structure.inserted == 0 && stats.max_delta == 0);
+
+    if (columns)
+    {
+        cv::Mat transposed;
+        cv::transpose(diff, transposed);
+        return transposed;
+    }
+    return diff;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "image_compare.hpp"
+#include <vector>
+
+namespace imcmp {
+
+enum class RowOp
+{
+    Same,     // identical rows
+    Changed,  // rows at the same place of the edit script, pixel diffed
+    Removed,  // only in the left image
+    Inserted, // only in the right image
+};
+
+class RowRun
+{
+public:
+    RowOp op = RowOp::Same;
+    int left_row = 0;  // first row in the left image, for all but Inserted
+    int right_row = 0; // first row in the right image, for all but Removed
+    int rows = 0;
+};
+
+/// @brief shortest edit script between two hash sequences, by Myers' O((N + D) D) diff
+///
+/// Runs of removals next to runs of insertions are paired into Changed runs. If more than `max_edits`
+/// edits are needed, the sequences are paired by position instead.
+std::vector<RowRun> diff_hash_sequences(const std::vector<uint64_t>& left, const std::vector<uint64_t>& right, int max_edits = 1024);
+
+/// @brief hash of every row of an image, in parallel
+std::vector<uint64_t> hash_rows(const cv::Mat& image);
+
+class StructuralDiff
+{
+public:
+    bool columns = false; // runs are of columns instead of rows
+    std::vector<RowRun> runs;
+    int removed = 0;
+    int inserted = 0;
+    int changed = 0;
+};
+
+/// @brief compare two same-width BGRA images after aligning their rows, for content that gained or lost rows
+///
+/// Rows are hashed and matched by diff_hash_sequences(), so rows shifted by an insertion above them still pair
+/// with their counterparts; only the Changed rows are pixel diffed, like compare_two_mat(). With `columns`,
+/// columns of same-height images are aligned instead. The diff image has one row per run row: removed rows
+/// are tinted red and inserted ones green.
+cv::Mat compare_structural(const cv::Mat& image_left, const cv::Mat& image_right, int toleranceThresh, bool columns, bool& is_exactly_same, StructuralDiff& structure, DiffStats& stats);
+
+} // namespace imcmp
@@ -0,0 +1,153 @@
+#include "sequence_compare.hpp"
+#include "image_compare.hpp"
+
+namespace imcmp {
+
+FramePrefetcher::FramePrefetcher(const RawSequence& _sequence, int64_t _frame_count, int _depth)
+    : sequence(_sequence), frame_count(_frame_count), depth(std::max(1, _depth)), stopping(false), finished(false)
+{
+    reader = std::thread(&FramePrefetcher::reader_loop, this);
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    stop();
+    reader.join();
+}
+
+void FramePrefetcher::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    not_empty.notify_all();
+    not_full.notify_all();
+}
+
+bool FramePrefetcher::next(cv::Mat& frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this] { return stopping || finished || !frames.empty(); });
+    if (stopping || frames.empty())
+    {
+        return false;
+    }
+    frame = frames.front();
+    frames.pop_front();
+    not_full.notify_one();
+    return true;
+}
+
+void FramePrefetcher::reader_loop()
+{
+    for (int64_t k = 0; k < frame_count; k++)
+    {
+        // decode without holding the lock, so the consumer keeps taking buffered frames meanwhile
+        cv::Mat frame = sequence.load_frame(k);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return stopping || frames.size() < depth; });
+        if (stopping)
+        {
+            break;
+        }
+        frames.push_back(frame);
+        not_empty.notify_one();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    not_empty.notify_all();
+}
+
+SequenceComparer::SequenceComparer()
+    : running(false), cancelled(false)
+{
+}
+
+SequenceComparer::~SequenceComparer()
+{
+    cancel();
+}
+
+bool SequenceComparer::open(const std::string& left_path, const std::string& right_path)
+{
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(timeline_mutex);
+        metrics.clear();
+    }
+    return left.open(left_path) && right.open(right_path);
+}
+
+void SequenceComparer::start(int tolerance, int prefetch_depth)
+{
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(timeline_mutex);
+        metrics.clear();
+        metrics.reserve(frame_count());
+    }
+    cancelled = false;
+    running = true;
+    worker = std::thread(&SequenceComparer::compare_loop, this, tolerance, prefetch_depth);
+}
+
+void SequenceComparer::cancel()
+{
+    cancelled = true;
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+    running = false;
+}
+
+bool SequenceComparer::is_running() const
+{
+    return running;
+}
+
+int64_t SequenceComparer::frame_count() const
+{
+    return std::min(left.frame_count(), right.frame_count());
+}
+
+std::vector<FrameMetrics> SequenceComparer::timeline() const
+{
+    std::lock_guard<std::mutex> lock(timeline_mutex);
+    return metrics;
+}
+
+void SequenceComparer::compare_loop(int tolerance, int prefetch_depth)
+{
+    const int64_t count = frame_count();
+    FramePrefetcher left_frames(left, count, prefetch_depth);
+    FramePrefetcher right_frames(right, count, prefetch_depth);
+
+    for (int64_t k = 0; k < count && !cancelled; k++)
+    {
+        cv::Mat left_frame;
+        cv::Mat right_frame;
+        if (!left_frames.next(left_frame) || !right_frames.next(right_frame))
+        {
+            break;
+        }
+
+        FrameMetrics frame_metrics;
+        if (left_frame.empty() || right_frame.empty() || left_frame.size() != right_frame.size() || left_frame.type() != right_frame.type())
+        {
+            // unreadable, or a different layout: count every pixel as different
+            frame_metrics.diff_pixels = std::max(left_frame.total(), right_frame.total());
+            frame_metrics.max_delta = 255;
+        }
+        else
+        {
+            compute_diff_metrics(left_frame, right_frame, tolerance, frame_metrics.diff_pixels, frame_metrics.max_delta, frame_metrics.psnr);
+        }
+
+        std::lock_guard<std::mutex> lock(timeline_mutex);
+        metrics.push_back(frame_metrics);
+    }
+    running = false;
+}
+
+} // namespace imcmp
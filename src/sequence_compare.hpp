@@ -0,0 +1,86 @@
+#pragma once
+
+#include "image_io.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace imcmp {
+
+/// @brief decode frames of a RawSequence ahead of the consumer on a background thread
+///
+/// At most `depth` decoded frames are buffered; the reader waits when the buffer is full.
+class FramePrefetcher
+{
+public:
+    FramePrefetcher(const RawSequence& sequence, int64_t frame_count, int depth);
+    ~FramePrefetcher();
+    FramePrefetcher(const FramePrefetcher&) = delete;
+    FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+
+    /// @brief take the next frame in order
+    /// @retval false when all frames were taken, or after stop()
+    bool next(cv::Mat& frame);
+    void stop();
+
+private:
+    void reader_loop();
+
+    const RawSequence& sequence;
+    const int64_t frame_count;
+    const int depth;
+    bool stopping;
+    bool finished;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<cv::Mat> frames;
+    std::thread reader;
+};
+
+class FrameMetrics
+{
+public:
+    int64_t diff_pixels = 0;
+    int max_delta = 0;
+    double psnr = 0; // infinity if identical
+};
+
+/// @brief compare two raw sequences frame by frame in the background
+///
+/// Both sides are decoded ahead by a FramePrefetcher while the current pair is
+/// compared, and the per-frame metrics are appended to a timeline which can be
+/// read while the compare is still running.
+class SequenceComparer
+{
+public:
+    SequenceComparer();
+    ~SequenceComparer();
+
+    bool open(const std::string& left_path, const std::string& right_path);
+    /// @brief start comparing with `tolerance` on a background thread; a running compare is cancelled first
+    void start(int tolerance, int prefetch_depth = 4);
+    void cancel();
+
+    bool is_running() const;
+    /// number of frames to compare, i.e. the shorter of both sequences
+    int64_t frame_count() const;
+    /// @brief copy of the metrics of the frames compared so far
+    std::vector<FrameMetrics> timeline() const;
+
+private:
+    void compare_loop(int tolerance, int prefetch_depth);
+
+    RawSequence left;
+    RawSequence right;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<bool> cancelled;
+    mutable std::mutex timeline_mutex;
+    std::vector<FrameMetrics> metrics;
+};
+
+} // namespace imcmp
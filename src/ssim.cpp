@@ -0,0 +1,209 @@
+#include "ssim.hpp"
+#include "image_compare.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <stdio.h>
+
+namespace {
+
+const int window_size = 7;
+const int band_rows = 64;
+const float C1 = (0.01f * 255) * (0.01f * 255);
+const float C2 = (0.03f * 255) * (0.03f * 255);
+
+// Wang, Simoncelli, Bovik, "Multiscale structural similarity for image quality assessment"
+const int max_scales = 5;
+const double scale_weights[max_scales] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+
+void window_mean(const cv::Mat& src, cv::Mat& dst)
+{
+    cv::boxFilter(src, dst, CV_32F, cv::Size(window_size, window_size), cv::Point(-1, -1), true, cv::BORDER_REFLECT_101 | cv::BORDER_ISOLATED);
+}
+
+// per pixel SSIM from the window means, summed along with its contrast-structure term
+void combine_row(const float* mu1, const float* mu2, const float* s11, const float* s22, const float* s12, float* ssim, int cols, double& ssim_sum, double& cs_sum)
+{
+    int j = 0;
+    float row_ssim = 0;
+    float row_cs = 0;
+#if CV_SIMD
+    const int step = cv::v_float32::nlanes;
+    const cv::v_float32 c1 = cv::vx_setall_f32(C1);
+    const cv::v_float32 c2 = cv::vx_setall_f32(C2);
+    const cv::v_float32 two = cv::vx_setall_f32(2.f);
+    cv::v_float32 ssim_acc = cv::vx_setzero_f32();
+    cv::v_float32 cs_acc = cv::vx_setzero_f32();
+    for (; j + step <= cols; j += step)
+    {
+        const cv::v_float32 m1 = cv::vx_load(mu1 + j);
+        const cv::v_float32 m2 = cv::vx_load(mu2 + j);
+        const cv::v_float32 m12 = m1 * m2;
+        const cv::v_float32 m11 = m1 * m1;
+        const cv::v_float32 m22 = m2 * m2;
+        const cv::v_float32 cs = (two * (cv::vx_load(s12 + j) - m12) + c2) / (cv::vx_load(s11 + j) - m11 + cv::vx_load(s22 + j) - m22 + c2);
+        const cv::v_float32 s = (two * m12 + c1) / (m11 + m22 + c1) * cs;
+        if (ssim)
+        {
+            cv::v_store(ssim + j, s);
+        }
+        ssim_acc += s;
+        cs_acc += cs;
+    }
+    row_ssim = cv::v_reduce_sum(ssim_acc);
+    row_cs = cv::v_reduce_sum(cs_acc);
+    cv::vx_cleanup();
+#endif
+    for (; j < cols; j++)
+    {
+        const float m12 = mu1[j] * mu2[j];
+        const float m11 = mu1[j] * mu1[j];
+        const float m22 = mu2[j] * mu2[j];
+        const float cs = (2.f * (s12[j] - m12) + C2) / (s11[j] - m11 + s22[j] - m22 + C2);
+        const float s = (2.f * m12 + C1) / (m11 + m22 + C1) * cs;
+        if (ssim)
+        {
+            ssim[j] = s;
+        }
+        row_ssim += s;
+        row_cs += cs;
+    }
+    ssim_sum += row_ssim;
+    cs_sum += row_cs;
+}
+
+// mean SSIM and contrast-structure of one scale; bands are filtered with `radius` rows of context, so they match a whole image filter
+void ssim_scale(const cv::Mat& luma1, const cv::Mat& luma2, cv::Mat* map, double& ssim_mean, double& cs_mean)
+{
+    const int rows = luma1.rows;
+    const int cols = luma1.cols;
+    const int radius = window_size / 2;
+    const int band_count = (rows + band_rows - 1) / band_rows;
+    if (map)
+    {
+        map->create(luma1.size(), CV_32FC1);
+    }
+
+    std::mutex mutex;
+    double total_ssim = 0;
+    double total_cs = 0;
+    cv::parallel_for_(cv::Range(0, band_count), [&](const cv::Range& range) {
+        cv::Mat aa, bb, ab, mu1, mu2, s11, s22, s12;
+        double local_ssim = 0;
+        double local_cs = 0;
+        for (int band = range.start; band < range.end; band++)
+        {
+            const int y0 = band * band_rows;
+            const int y1 = std::min(rows, y0 + band_rows);
+            const int ext_y0 = std::max(0, y0 - radius);
+            const int ext_y1 = std::min(rows, y1 + radius);
+            const cv::Mat a = luma1.rowRange(ext_y0, ext_y1);
+            const cv::Mat b = luma2.rowRange(ext_y0, ext_y1);
+            cv::multiply(a, a, aa);
+            cv::multiply(b, b, bb);
+            cv::multiply(a, b, ab);
+            window_mean(a, mu1);
+            window_mean(b, mu2);
+            window_mean(aa, s11);
+            window_mean(bb, s22);
+            window_mean(ab, s12);
+            for (int i = y0; i < y1; i++)
+            {
+                const int k = i - ext_y0;
+                combine_row(mu1.ptr<float>(k), mu2.ptr<float>(k), s11.ptr<float>(k), s22.ptr<float>(k), s12.ptr<float>(k),
+                            map ? map->ptr<float>(i) : NULL, cols, local_ssim, local_cs);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        total_ssim += local_ssim;
+        total_cs += local_cs;
+    });
+
+    const double pixels = static_cast<double>(rows) * cols;
+    ssim_mean = (pixels > 0) ? total_ssim / pixels : 1;
+    cs_mean = (pixels > 0) ? total_cs / pixels : 1;
+}
+
+// the first scale is the plain SSIM, so both scores share it
+double ms_ssim(const cv::Mat& luma1, const cv::Mat& luma2, cv::Mat* map, double& ssim)
+{
+    double cs[max_scales];
+    double last_ssim = 1;
+    int scales = 0;
+    cv::Mat a = luma1;
+    cv::Mat b = luma2;
+    for (; scales < max_scales; scales++)
+    {
+        if (scales > 0)
+        {
+            if (std::min(a.rows, a.cols) < 2 * window_size)
+            {
+                break;
+            }
+            cv::resize(a, a, cv::Size(a.cols / 2, a.rows / 2), 0, 0, cv::INTER_AREA);
+            cv::resize(b, b, cv::Size(b.cols / 2, b.rows / 2), 0, 0, cv::INTER_AREA);
+        }
+        ssim_scale(a, b, (scales == 0) ? map : NULL, last_ssim, cs[scales]);
+        if (scales == 0)
+        {
+            ssim = last_ssim;
+        }
+    }
+
+    double weight_sum = 0;
+    for (int s = 0; s < scales; s++)
+    {
+        weight_sum += scale_weights[s];
+    }
+    // negative terms would make fractional powers undefined
+    double result = std::pow(std::max(0.0, last_ssim), scale_weights[scales - 1] / weight_sum);
+    for (int s = 0; s + 1 < scales; s++)
+    {
+        result *= std::pow(std::max(0.0, cs[s]), scale_weights[s] / weight_sum);
+    }
+    return result;
+}
+
+} // namespace
+
+double imcmp::compute_ssim(const cv::Mat& luma1, const cv::Mat& luma2, cv::Mat* map)
+{
+    CV_Assert(luma1.size() == luma2.size() && luma1.type() == CV_32FC1 && luma2.type() == CV_32FC1);
+    double ssim = 1;
+    double cs = 1;
+    ssim_scale(luma1, luma2, map, ssim, cs);
+    return ssim;
+}
+
+double imcmp::compute_ms_ssim(const cv::Mat& luma1, const cv::Mat& luma2)
+{
+    CV_Assert(luma1.size() == luma2.size() && luma1.type() == CV_32FC1 && luma2.type() == CV_32FC1);
+    double ssim = 1;
+    return ms_ssim(luma1, luma2, NULL, ssim);
+}
+
+cv::Mat imcmp::compare_ssim(const cv::Mat& image_left, const cv::Mat& image_right, SsimScores& scores)
+{
+    if (image_left.empty() || image_left.size() != image_right.size() || image_left.type() != image_right.type() || image_left.depth() != CV_8U)
+    {
+        fprintf(stderr, "SSIM compare requires 8-bit images of same size and format\n");
+        return cv::Mat();
+    }
+
+    cv::Mat luma1;
+    cv::Mat luma2;
+    convert_to_luma(image_left, luma1);
+    convert_to_luma(image_right, luma2);
+    cv::Mat map;
+    scores.ms_ssim = ms_ssim(luma1, luma2, &map, scores.ssim);
+
+    // 1 - SSIM, saturated at 1, through a perceptual colormap
+    cv::Mat dissimilarity;
+    map.convertTo(dissimilarity, CV_8U, -255.0, 255.0);
+    cv::Mat heatmap;
+    cv::applyColorMap(dissimilarity, heatmap, cv::COLORMAP_INFERNO);
+    cv::cvtColor(heatmap, heatmap, cv::COLOR_BGR2BGRA);
+    return heatmap;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+namespace imcmp {
+
+class SsimScores
+{
+public:
+    double ssim = 1;
+    double ms_ssim = 1;
+};
+
+/// @brief mean SSIM of two CV_32FC1 luma planes of the same size, in [0, 255] units
+///
+/// Uses a 7x7 uniform window; window sums are separable box filters over row bands, processed in parallel.
+/// If `map` is not NULL, it receives the per pixel SSIM (CV_32FC1).
+double compute_ssim(const cv::Mat& luma1, const cv::Mat& luma2, cv::Mat* map = NULL);
+
+/// @brief multi-scale SSIM of two CV_32FC1 luma planes, over up to 5 scales with the weights of Wang et al.
+/// Scales smaller than the window are dropped and the weights of the rest renormalized.
+double compute_ms_ssim(const cv::Mat& luma1, const cv::Mat& luma2);
+
+/// @brief SSIM and MS-SSIM of two same-sized 8-bit gray, BGR or BGRA images, compared by luma
+/// @return BGRA heatmap of the SSIM map, dark where similar and bright where not; empty if sizes or types differ
+cv::Mat compare_ssim(const cv::Mat& image_left, const cv::Mat& image_right, SsimScores& scores);
+
+} // namespace imcmp
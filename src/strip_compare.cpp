@@ -0,0 +1,218 @@
+#include "strip_compare.hpp"
+#include "png_io.hpp"
+#include "image_compare.hpp"
+#include <opencv2/imgproc.hpp>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+using namespace imcmp;
+
+// rows straight from the file offsets of every plane, so only one strip is ever in memory
+class RawStripReader : public StripReader
+{
+public:
+    explicit RawStripReader(const FileInfo& _file_info)
+        : file_info(_file_info)
+    {
+        size = cv::Size(file_info.width, file_info.height);
+    }
+
+    int row_align() const override
+    {
+        return file_info.format->height_align;
+    }
+
+    bool read(int rows, cv::Mat& bgra) override
+    {
+        rows = std::min(rows, size.height - next_row);
+        if (rows <= 0 || !read_fourcc_rows(file_info, 0, next_row, rows, frame_data))
+        {
+            return false;
+        }
+        FileInfo strip_info = file_info;
+        strip_info.height = rows;
+        next_row += rows;
+        return convert_fourcc_to_bgra(strip_info, frame_data.data(), bgra);
+    }
+
+private:
+    FileInfo file_info;
+    int next_row = 0;
+    std::vector<uchar> frame_data;
+};
+
+class PngStripReader : public StripReader
+{
+public:
+    bool open(const std::string& path)
+    {
+        if (!png.open(path))
+        {
+            return false;
+        }
+        size = cv::Size(png.width(), png.height());
+        return true;
+    }
+
+    bool read(int rows, cv::Mat& bgra) override
+    {
+        if (!png.read_rows(rows, strip))
+        {
+            return false;
+        }
+        switch (strip.channels())
+        {
+        case 1:
+            cv::cvtColor(strip, bgra, cv::COLOR_GRAY2BGRA);
+            break;
+        case 3:
+            cv::cvtColor(strip, bgra, cv::COLOR_BGR2BGRA);
+            break;
+        default:
+            strip.copyTo(bgra);
+            break;
+        }
+        return true;
+    }
+
+private:
+    PngRowReader png;
+    cv::Mat strip;
+};
+
+// like compute_diff_stats(), plus the bits of differing pixels
+void compare_strip(const cv::Mat& left, const cv::Mat& right, int thresh, uchar* mask, int mask_row_bytes, DiffStats& stats)
+{
+    std::mutex mutex;
+    cv::parallel_for_(cv::Range(0, left.rows), [&](const cv::Range& range) {
+        DiffStats local;
+        local.channels = 4;
+        local.pixels = static_cast<int64_t>(range.end - range.start) * left.cols;
+        for (int i = range.start; i < range.end; i++)
+        {
+            const uchar* p1 = left.ptr(i);
+            const uchar* p2 = right.ptr(i);
+            uchar* bits = mask ? mask + static_cast<size_t>(i) * mask_row_bytes : NULL;
+            if (bits)
+            {
+                memset(bits, 0, mask_row_bytes);
+            }
+            for (int j = 0; j < left.cols; j++)
+            {
+                int pixel_max = 0;
+                for (int k = 0; k < 4; k++)
+                {
+                    const int d = std::abs(p1[k] - p2[k]);
+                    pixel_max = std::max(pixel_max, d);
+                    local.abs_sum[k] += d;
+                    local.sqr_sum[k] += d * d;
+                    local.channel_max[k] = std::max(local.channel_max[k], d);
+                }
+                local.histogram[pixel_max]++;
+                local.max_delta = std::max(local.max_delta, pixel_max);
+                if (pixel_max > thresh)
+                {
+                    local.diff_pixels++;
+                    if (bits)
+                    {
+                        bits[j >> 3] |= static_cast<uchar>(0x80 >> (j & 7));
+                    }
+                }
+                p1 += 4;
+                p2 += 4;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.merge(local);
+    });
+}
+
+} // namespace
+
+std::unique_ptr<imcmp::StripReader> imcmp::open_strip_reader(const std::string& path)
+{
+    FileInfo file_info = get_meta_info(path);
+    if (!file_info.valid)
+    {
+        fprintf(stderr, "%s\n", file_info.err_msg.c_str());
+        return nullptr;
+    }
+    if (file_info.format->kind != FormatKind::Encoded)
+    {
+        return std::unique_ptr<StripReader>(new RawStripReader(file_info));
+    }
+    if (file_info.ext == "png")
+    {
+        std::unique_ptr<PngStripReader> reader(new PngStripReader());
+        if (reader->open(path))
+        {
+            return std::unique_ptr<StripReader>(reader.release());
+        }
+    }
+    fprintf(stderr, "%s can't be read in strips\n", path.c_str());
+    return nullptr;
+}
+
+bool imcmp::compare_in_strips(const std::string& left_path, const std::string& right_path, int thresh, int strip_rows, const std::string& mask_path, StripCompareResult& result)
+{
+    std::unique_ptr<StripReader> left = open_strip_reader(left_path);
+    std::unique_ptr<StripReader> right = open_strip_reader(right_path);
+    if (!left || !right)
+    {
+        return false;
+    }
+    if (left->width() != right->width() || left->height() != right->height())
+    {
+        fprintf(stderr, "%s and %s differ in size\n", left_path.c_str(), right_path.c_str());
+        return false;
+    }
+    result = StripCompareResult();
+    result.width = left->width();
+    result.height = left->height();
+
+    // alignments are 1 or 2, so the larger one suits both sides
+    const int align = std::max(left->row_align(), right->row_align());
+    strip_rows = std::max(align, (strip_rows + align - 1) / align * align);
+
+    FILE* mask_file = NULL;
+    const int mask_row_bytes = (result.width + 7) / 8;
+    std::vector<uchar> mask;
+    if (!mask_path.empty())
+    {
+        mask_file = fopen(mask_path.c_str(), "wb");
+        if (mask_file == NULL)
+        {
+            fprintf(stderr, "failed to open %s\n", mask_path.c_str());
+            return false;
+        }
+        fprintf(mask_file, "P4\n%d %d\n", result.width, result.height);
+        mask.resize(static_cast<size_t>(strip_rows) * mask_row_bytes);
+    }
+
+    bool ok = true;
+    cv::Mat left_strip;
+    cv::Mat right_strip;
+    for (int row = 0; ok && row < result.height; row += left_strip.rows)
+    {
+        const int rows = std::min(strip_rows, result.height - row);
+        if (!left->read(rows, left_strip) || !right->read(rows, right_strip) || left_strip.rows != rows || right_strip.rows != rows)
+        {
+            fprintf(stderr, "failed to read rows [%d, %d)\n", row, row + rows);
+            ok = false;
+            break;
+        }
+        compare_strip(left_strip, right_strip, thresh, mask_file ? mask.data() : NULL, mask_row_bytes, result.stats);
+        if (mask_file && fwrite(mask.data(), mask_row_bytes, rows, mask_file) != static_cast<size_t>(rows))
+        {
+            fprintf(stderr, "failed to write %s\n", mask_path.c_str());
+            ok = false;
+        }
+    }
+    if (mask_file)
+    {
+        fclose(mask_file);
+    }
+    return ok;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "image_io.hpp"
+#include "image_compare.hpp"
+#include <memory>
+
+namespace imcmp {
+
+/// @brief reads an image top to bottom, a strip of rows at a time, converted to BGRA
+class StripReader
+{
+public:
+    virtual ~StripReader() {}
+
+    int width() const { return size.width; }
+    int height() const { return size.height; }
+    /// strips must be a multiple of this many rows, e.g. 2 for nv12
+    virtual int row_align() const { return 1; }
+    /// @brief read the next `rows` rows (fewer at the bottom) as BGRA
+    virtual bool read(int rows, cv::Mat& bgra) = 0;
+
+protected:
+    cv::Size size;
+};
+
+/// @brief a StripReader for raw (fourcc) frames, read at file offsets, and for PNG
+/// @return NULL for formats without a strip decoder, e.g. JPEG and BMP, or invalid files
+std::unique_ptr<StripReader> open_strip_reader(const std::string& path);
+
+class StripCompareResult
+{
+public:
+    int width = 0;
+    int height = 0;
+    DiffStats stats;
+};
+
+/// @brief compare two images of the same size strip by strip, for images larger than memory
+///
+/// At most `strip_rows` rows of each side are held at once, so peak memory does not grow with the
+/// image height. Statistics accumulate strip by strip, like compute_diff_stats() over the whole
+/// image. If `mask_path` is not empty, the pixels above `thresh` are written there, strip by strip,
+/// as a 1 bit per pixel PBM (P4) mask, 1 (black) for differing.
+bool compare_in_strips(const std::string& left_path, const std::string& right_path, int thresh, int strip_rows, const std::string& mask_path, StripCompareResult& result);
+
+} // namespace imcmp
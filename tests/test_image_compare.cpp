@@ -1,6 +1,14 @@
 #include "gtest/gtest.h"
 #include "image_io.hpp"
 #include "image_compare.hpp"
+#include "ssim.hpp"
+#include "delta_e.hpp"
+#include "row_diff.hpp"
+#include "noise_model.hpp"
+#include "compare_mask.hpp"
+#include "diff_blobs.hpp"
+#include "diff_pyramid.hpp"
+#include "jpeg_io.hpp"
 
 TEST(simple, simple)
 {
@@ -8,4 +16,546 @@ TEST(simple, simple)
     EXPECT_TRUE(1 == 1);
 
     printf("TODO: add test cases here\n");
-}
\ No newline at end of file
+}
+
+TEST(native_compare, tolerance_in_native_units)
+{
+    // 10-bit samples which differ by 3, i.e. less than one 8-bit step
+    cv::Mat left(2, 40, CV_16UC3, cv::Scalar(512, 512, 512));
+    cv::Mat right = left.clone();
+    right.at<cv::Vec3w>(1, 37)[2] += 3;
+    cv::Mat display(left.size(), CV_8UC4, cv::Scalar(128, 128, 128, 255));
+
+    cv::Mat delta;
+    imcmp::max_channel_absdiff_16u(left, right, delta);
+    EXPECT_EQ(cv::countNonZero(delta), 1);
+    EXPECT_EQ(delta.at<ushort>(1, 37), 3);
+
+    bool is_exactly_same = true;
+    cv::Mat diff = imcmp::compare_native_mat(left, right, display, 2, is_exactly_same);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(diff.at<cv::Vec4b>(1, 37), cv::Vec4b(0, 0, 205, 255));
+    EXPECT_EQ(diff.at<cv::Vec4b>(0, 0), cv::Vec4b(128, 128, 128, 255));
+
+    diff = imcmp::compare_native_mat(left, right, display, 3, is_exactly_same);
+    EXPECT_EQ(diff.at<cv::Vec4b>(1, 37), cv::Vec4b(205, 0, 0, 255));
+
+    imcmp::CompareMask mask(left.size());
+    mask.ignore_rect(cv::Rect(36, 0, 2, 2));
+    diff = imcmp::compare_native_mat(left, right, display, 2, is_exactly_same, &mask);
+    EXPECT_TRUE(is_exactly_same);
+    EXPECT_EQ(diff.at<cv::Vec4b>(1, 37), cv::Vec4b(48, 48, 48, 255));
+}
+
+TEST(mosaic_compare, per_cfa_site)
+{
+    cv::Mat left(4, 6, CV_16UC1, cv::Scalar(100));
+    cv::Mat right = left.clone();
+    right.at<ushort>(2, 3) = 110; // Gr site of rggb
+    right.at<ushort>(3, 3) = 101; // B site, within tolerance
+    cv::Mat display(left.size(), CV_8UC4, cv::Scalar(0, 0, 0, 255));
+
+    bool is_exactly_same = true;
+    imcmp::CfaDiffStats stats;
+    cv::Mat diff = imcmp::compare_mosaic(left, right, display, 2, is_exactly_same, stats);
+    ASSERT_EQ(diff.size(), left.size());
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(stats.diff_pixels[1], 1); // row 2 is even, column 3 is odd
+    EXPECT_EQ(stats.max_delta[1], 10);
+    EXPECT_EQ(stats.diff_pixels[3], 0);
+    EXPECT_EQ(stats.max_delta[3], 1);
+    EXPECT_EQ(stats.max_delta[0], 0);
+
+    // a masked sample counts as equal
+    imcmp::CompareMask mask(left.size());
+    mask.ignore_rect(cv::Rect(3, 2, 1, 1));
+    imcmp::compare_mosaic(left, right, display, 2, is_exactly_same, stats, &mask);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(stats.diff_pixels[1], 0);
+    EXPECT_EQ(stats.max_delta[1], 0);
+    EXPECT_EQ(stats.max_delta[3], 1);
+}
+
+TEST(diff_stats, fused_with_diff_image)
+{
+    cv::Mat left(3, 5, CV_8UC4, cv::Scalar(10, 20, 30, 255));
+    cv::Mat right = left.clone();
+    right.at<cv::Vec4b>(0, 1) = cv::Vec4b(13, 20, 30, 255); // below tolerance
+    right.at<cv::Vec4b>(2, 4) = cv::Vec4b(10, 20, 90, 255);
+
+    bool is_exactly_same = true;
+    imcmp::DiffStats stats;
+    cv::Mat diff = imcmp::compare_two_mat(left, right, 5, is_exactly_same, stats);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(stats.pixels, 15);
+    EXPECT_EQ(stats.diff_pixels, 1);
+    EXPECT_EQ(stats.max_delta, 60);
+    EXPECT_EQ(stats.channel_max[0], 3);
+    EXPECT_EQ(stats.channel_max[2], 60);
+    EXPECT_EQ(stats.histogram[0], 13);
+    EXPECT_EQ(stats.histogram[3], 1);
+    EXPECT_EQ(stats.histogram[60], 1);
+    EXPECT_DOUBLE_EQ(stats.mse(2), 3600.0 / 15);
+    EXPECT_DOUBLE_EQ(stats.mae(), 63.0 / 45);
+
+    cv::Mat expected;
+    imcmp::getDiffImage(left, right, expected, 5, cv::Scalar(205, 0, 0), cv::Scalar(0, 0, 205));
+    EXPECT_EQ(cv::norm(diff, expected, cv::NORM_INF), 0);
+
+    // sums of large images must not wrap
+    cv::Mat black(4096, 4096, CV_8UC3, cv::Scalar(0, 0, 0));
+    cv::Mat white(4096, 4096, CV_8UC3, cv::Scalar(255, 255, 255));
+    imcmp::compute_diff_stats(black, white, 0, stats);
+    EXPECT_EQ(stats.sqr_sum[1], 4096LL * 4096 * 255 * 255);
+    EXPECT_DOUBLE_EQ(stats.psnr(), 0.0);
+}
+
+TEST(ssim, scores_and_heatmap)
+{
+    cv::Mat left(96, 128, CV_8UC4);
+    cv::randu(left, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat right = left.clone();
+
+    imcmp::SsimScores scores;
+    cv::Mat heatmap = imcmp::compare_ssim(left, right, scores);
+    ASSERT_EQ(heatmap.size(), left.size());
+    EXPECT_EQ(heatmap.type(), CV_8UC4);
+    EXPECT_NEAR(scores.ssim, 1.0, 1e-6);
+    EXPECT_NEAR(scores.ms_ssim, 1.0, 1e-6);
+
+    // a noisy block lowers the score there only
+    cv::Mat block = right(cv::Rect(80, 40, 32, 32));
+    cv::randu(block, cv::Scalar::all(0), cv::Scalar::all(256));
+    heatmap = imcmp::compare_ssim(left, right, scores);
+    EXPECT_LT(scores.ssim, 0.99);
+    EXPECT_LT(scores.ms_ssim, 1.0);
+
+    cv::Mat luma1, luma2, map;
+    cv::cvtColor(left, luma1, cv::COLOR_BGRA2GRAY);
+    cv::cvtColor(right, luma2, cv::COLOR_BGRA2GRAY);
+    luma1.convertTo(luma1, CV_32F);
+    luma2.convertTo(luma2, CV_32F);
+    EXPECT_NEAR(imcmp::compute_ssim(luma1, luma2, &map), scores.ssim, 1e-9);
+    EXPECT_NEAR(map.at<float>(0, 0), 1.0f, 1e-4);
+    EXPECT_LT(map.at<float>(56, 96), 0.5f);
+}
+
+TEST(delta_e, formulas_and_map)
+{
+    // Sharma et al. test pairs
+    EXPECT_NEAR(imcmp::delta_e(cv::Vec3f(50, 2.6772f, -79.7751f), cv::Vec3f(50, 0, -82.7485f), imcmp::DeltaEFormula::Ciede2000), 2.0425, 1e-3);
+    EXPECT_NEAR(imcmp::delta_e(cv::Vec3f(50, 2.5f, 0), cv::Vec3f(73, 25, -18), imcmp::DeltaEFormula::Ciede2000), 27.1492, 1e-3);
+    EXPECT_NEAR(imcmp::delta_e(cv::Vec3f(50, 2.5f, 0), cv::Vec3f(73, 25, -18), imcmp::DeltaEFormula::Cie76), std::sqrt(23.f * 23 + 22.5f * 22.5f + 18 * 18), 1e-3);
+
+    const uchar white[3] = {255, 255, 255};
+    const uchar red[3] = {0, 0, 255};
+    EXPECT_NEAR(imcmp::bgr_to_lab(white)[0], 100.f, 1e-3);
+    EXPECT_NEAR(imcmp::bgr_to_lab(red)[0], 53.24f, 1e-2);
+    EXPECT_NEAR(imcmp::bgr_to_lab(red)[1], 80.09f, 1e-2);
+
+    // the vectorized and cached row kernels match the scalar formulas
+    cv::Mat left(7, 37, CV_8UC4);
+    cv::randu(left, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat right = left.clone();
+    cv::Mat changed = right(cv::Rect(3, 2, 30, 4));
+    changed += cv::Scalar(9, 0, 3, 0);
+    const imcmp::DeltaEFormula formulas[3] = {imcmp::DeltaEFormula::Cie76, imcmp::DeltaEFormula::Cie94, imcmp::DeltaEFormula::Ciede2000};
+    for (imcmp::DeltaEFormula formula : formulas)
+    {
+        cv::Mat map;
+        imcmp::compute_delta_e(left, right, formula, map);
+        for (int i = 0; i < left.rows; i++)
+        {
+            for (int j = 0; j < left.cols; j++)
+            {
+                const float expected = imcmp::delta_e(imcmp::bgr_to_lab(left.ptr(i, j)), imcmp::bgr_to_lab(right.ptr(i, j)), formula);
+                EXPECT_NEAR(map.at<float>(i, j), expected, 1e-3);
+            }
+        }
+        EXPECT_EQ(map.at<float>(0, 0), 0.f);
+    }
+
+    imcmp::DeltaEComparer comparer;
+    bool is_exactly_same = true;
+    imcmp::DeltaEStats stats;
+    cv::Mat diff = comparer.compare(left, right, imcmp::DeltaEFormula::Ciede2000, 0.f, is_exactly_same, stats);
+    ASSERT_EQ(diff.size(), left.size());
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_GT(stats.diff_pixels, 0);
+    // re-thresholding the kept map
+    comparer.compare(left, right, imcmp::DeltaEFormula::Ciede2000, stats.max_delta_e, is_exactly_same, stats);
+    EXPECT_EQ(stats.diff_pixels, 0);
+}
+
+TEST(neighborhood_compare, forgives_shifted_edges)
+{
+    // a vertical edge, moved right by one pixel on the right side
+    cv::Mat left(8, 40, CV_8UC4, cv::Scalar(0, 0, 0, 255));
+    cv::Mat right = left.clone();
+    left.colRange(20, 40).setTo(cv::Scalar(255, 255, 255, 255));
+    right.colRange(21, 40).setTo(cv::Scalar(255, 255, 255, 255));
+
+    bool is_exactly_same = true;
+    int64_t diff_pixels = 0;
+    cv::Mat diff = imcmp::compare_neighborhood(left, right, 1, 0, is_exactly_same, diff_pixels);
+    ASSERT_EQ(diff.size(), left.size());
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(diff_pixels, 0);
+
+    diff = imcmp::compare_neighborhood(left, right, 0, 0, is_exactly_same, diff_pixels);
+    EXPECT_EQ(diff_pixels, 8);
+
+    // a dot missing on one side is still found, whichever side has it
+    right.at<cv::Vec4b>(4, 5) = cv::Vec4b(200, 200, 200, 255);
+    diff = imcmp::compare_neighborhood(left, right, 2, 10, is_exactly_same, diff_pixels);
+    EXPECT_EQ(diff_pixels, 1);
+    EXPECT_EQ(diff.at<cv::Vec4b>(4, 5), cv::Vec4b(0, 0, 205, 255));
+}
+
+TEST(aligned_compare, phase_correlation_offset)
+{
+    cv::Mat scene(1200, 1500, CV_8UC4);
+    cv::randu(scene, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(scene, scene, cv::Size(5, 5), 0);
+    const cv::Mat left = scene(cv::Rect(20, 30, 1400, 1100)).clone();
+    const cv::Mat right = scene(cv::Rect(27, 25, 1400, 1100)).clone();
+
+    // left(x, y) is scene(x + 20, y + 30), which is right(x - 7, y + 5)
+    cv::Point offset;
+    ASSERT_TRUE(imcmp::estimate_translation(left, right, offset));
+    EXPECT_EQ(offset, cv::Point(-7, 5));
+
+    bool is_exactly_same = true;
+    imcmp::DiffStats stats;
+    cv::Mat diff = imcmp::compare_aligned(left, right, 0, is_exactly_same, offset, stats);
+    ASSERT_EQ(diff.size(), left.size());
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(stats.pixels, (1400 - 7) * (1100 - 5));
+    EXPECT_EQ(stats.diff_pixels, 0);
+}
+
+TEST(structural_compare, inserted_rows)
+{
+    const std::vector<uint64_t> a = {1, 2, 3, 4};
+    const std::vector<uint64_t> b = {1, 3, 4, 5};
+    std::vector<imcmp::RowRun> runs = imcmp::diff_hash_sequences(a, b);
+    ASSERT_EQ(runs.size(), 4u);
+    EXPECT_EQ(runs[1].op, imcmp::RowOp::Removed);
+    EXPECT_EQ(runs[1].left_row, 1);
+    EXPECT_EQ(runs[3].op, imcmp::RowOp::Inserted);
+    EXPECT_EQ(runs[3].right_row, 3);
+
+    // 5 rows inserted at row 20, and one pixel changed further down
+    cv::Mat left(60, 32, CV_8UC4);
+    cv::randu(left, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat inserted(5, 32, CV_8UC4, cv::Scalar(255, 255, 255, 255));
+    cv::Mat right;
+    cv::vconcat(std::vector<cv::Mat>{left.rowRange(0, 20), inserted, left.rowRange(20, 60)}, right);
+    right.at<cv::Vec4b>(50, 3)[1] ^= 0x10;
+
+    bool is_exactly_same = true;
+    imcmp::StructuralDiff structure;
+    imcmp::DiffStats stats;
+    cv::Mat diff = imcmp::compare_structural(left, right, 0, false, is_exactly_same, structure, stats);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(diff.size(), right.size());
+    EXPECT_EQ(structure.inserted, 5);
+    EXPECT_EQ(structure.removed, 0);
+    EXPECT_EQ(structure.changed, 1);
+    EXPECT_EQ(stats.pixels, 60 * 32);
+    EXPECT_EQ(stats.diff_pixels, 1);
+
+    // the same as columns
+    cv::Mat left_t;
+    cv::Mat right_t;
+    cv::transpose(left, left_t);
+    cv::transpose(right, right_t);
+    diff = imcmp::compare_structural(left_t, right_t, 0, true, is_exactly_same, structure, stats);
+    EXPECT_EQ(diff.size(), right_t.size());
+    EXPECT_EQ(structure.inserted, 5);
+    EXPECT_EQ(stats.diff_pixels, 1);
+}
+
+TEST(resampled_compare, two_times_export)
+{
+    cv::Mat left(30, 40, CV_8UC4);
+    cv::randu(left, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat right;
+    cv::resize(left, right, cv::Size(80, 60), 0, 0, cv::INTER_NEAREST);
+
+    imcmp::ResampledComparer comparer;
+    bool is_exactly_same = true;
+    imcmp::DiffStats stats;
+    cv::Mat diff = comparer.compare(left, right, imcmp::ResampleFilter::Area, 0, is_exactly_same, stats);
+    EXPECT_EQ(diff.size(), left.size());
+    EXPECT_FALSE(is_exactly_same); // sizes differ
+    EXPECT_EQ(stats.pixels, 30 * 40);
+    EXPECT_EQ(stats.max_delta, 0);
+
+    right.at<cv::Vec4b>(10, 10)[0] ^= 0x80;
+    comparer.compare(left, right, imcmp::ResampleFilter::Area, 0, is_exactly_same, stats);
+    EXPECT_EQ(stats.diff_pixels, 1);
+}
+
+TEST(noise_model, per_pixel_tolerance)
+{
+    cv::Mat base(24, 40, CV_8UC4);
+    cv::randu(base, cv::Scalar::all(10), cv::Scalar::all(240));
+    imcmp::NoiseModel model;
+    cv::Mat first;
+    for (int k = 0; k < 8; k++)
+    {
+        cv::Mat noise(base.size(), CV_8UC4);
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(5));
+        cv::Mat reference = base + noise;
+        ASSERT_TRUE(model.add(reference));
+        if (k == 0)
+            first = reference;
+    }
+    EXPECT_EQ(model.frame_count(), 8);
+    EXPECT_FALSE(model.add(cv::Mat(12, 40, CV_8UC4)));
+
+    // no sample of 8 is more than 2.47 sample standard deviations from their mean
+    cv::Mat low;
+    cv::Mat high;
+    bool is_within = false;
+    int64_t outside_pixels = -1;
+    model.bounds(imcmp::NoiseBound::Sigma, 3.0f, 0, low, high);
+    cv::Mat diff = imcmp::compare_to_noise_model(first, low, high, is_within, outside_pixels);
+    EXPECT_EQ(diff.size(), base.size());
+    EXPECT_TRUE(is_within);
+    EXPECT_EQ(outside_pixels, 0);
+
+    cv::Mat candidate = first.clone();
+    candidate.at<cv::Vec4b>(5, 7)[2] += 50;
+    imcmp::compare_to_noise_model(candidate, low, high, is_within, outside_pixels);
+    EXPECT_FALSE(is_within);
+    EXPECT_EQ(outside_pixels, 1);
+
+    model.bounds(imcmp::NoiseBound::Envelope, 0.0f, 0, low, high);
+    imcmp::compare_to_noise_model(first, low, high, is_within, outside_pixels);
+    EXPECT_TRUE(is_within);
+    imcmp::compare_to_noise_model(candidate, low, high, is_within, outside_pixels);
+    EXPECT_EQ(outside_pixels, 1);
+}
+
+TEST(masked_compare, ignored_region_and_roi)
+{
+    cv::Mat left(70, 100, CV_8UC4);
+    cv::randu(left, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat right = left.clone();
+    right(cv::Rect(80, 60, 10, 5)).setTo(cv::Scalar(255, 255, 255, 255)); // a timestamp
+    right.at<cv::Vec4b>(5, 5)[0] ^= 0x40;
+
+    imcmp::CompareMask mask(left.size());
+    mask.ignore_rect(cv::Rect(78, 58, 20, 10));
+    bool is_exactly_same = true;
+    imcmp::DiffStats stats;
+    cv::Mat diff = imcmp::compare_masked(left, right, mask, 0, is_exactly_same, stats);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(stats.pixels, 100 * 70 - 20 * 10);
+    EXPECT_EQ(stats.diff_pixels, 1);
+    EXPECT_EQ(diff.at<cv::Vec4b>(60, 80), cv::Vec4b(48, 48, 48, 255));
+
+    // a region of interest ignores whole tiles, and survives a PBM round trip
+    mask = imcmp::CompareMask(left.size());
+    mask.keep_only({cv::Rect(0, 0, 64, 64)});
+    ASSERT_TRUE(imcmp::save_compare_mask("roi_mask.pbm", mask));
+    imcmp::CompareMask loaded;
+    ASSERT_TRUE(imcmp::load_compare_mask("roi_mask.pbm", left.size(), loaded));
+    EXPECT_EQ(loaded.ignored_pixels(), 100 * 70 - 64 * 64);
+    EXPECT_TRUE(loaded.is_fully_ignored(cv::Rect(64, 0, 36, 64)));
+    imcmp::compare_masked(left, right, loaded, 0, is_exactly_same, stats);
+    EXPECT_EQ(stats.pixels, 64 * 64);
+    EXPECT_EQ(stats.diff_pixels, 1);
+
+    // a mask that doesn't fit leaves the loaded one in place
+    EXPECT_FALSE(imcmp::load_compare_mask("roi_mask.pbm", cv::Size(50, 70), loaded));
+    EXPECT_EQ(loaded.size(), left.size());
+    EXPECT_EQ(loaded.ignored_pixels(), 100 * 70 - 64 * 64);
+}
+
+TEST(diff_blobs, labeled_across_bands)
+{
+    cv::Mat left(150, 200, CV_8UC4, cv::Scalar(20, 40, 60, 255));
+    cv::Mat right = left.clone();
+    right(cv::Rect(10, 10, 3, 3)).setTo(cv::Scalar(70, 40, 60, 255));
+    // a diagonal line, only 8-connected, across the boundary of two row bands
+    for (int k = 0; k < 8; k++)
+    {
+        right.at<cv::Vec4b>(60 + k, 100 + k)[1] = 60;
+    }
+    right.at<cv::Vec4b>(140, 5)[2] = 61; // within the tolerance
+    right.at<cv::Vec4b>(140, 190)[2] = 80;
+
+    std::vector<imcmp::DiffBlob> blobs = imcmp::find_diff_blobs(left, right, 1);
+    ASSERT_EQ(blobs.size(), 3u);
+    EXPECT_EQ(blobs[0].bounds, cv::Rect(10, 10, 3, 3));
+    EXPECT_EQ(blobs[0].pixels, 9);
+    EXPECT_EQ(blobs[0].max_delta, 50);
+    EXPECT_EQ(blobs[1].bounds, cv::Rect(100, 60, 8, 8));
+    EXPECT_EQ(blobs[1].pixels, 8);
+    EXPECT_EQ(blobs[1].max_delta, 20);
+    EXPECT_EQ(blobs[2].bounds, cv::Rect(190, 140, 1, 1));
+
+    imcmp::CompareMask mask(left.size());
+    mask.ignore_rect(cv::Rect(0, 0, 50, 50));
+    imcmp::DiffPyramid pyramid;
+    blobs = imcmp::find_diff_blobs(left, right, 1, &mask, &pyramid);
+    ASSERT_EQ(blobs.size(), 2u);
+    EXPECT_EQ(blobs[0].max_delta, 20);
+
+    // the pyramid of the same pass matches a separate build
+    imcmp::DiffPyramid built;
+    ASSERT_TRUE(built.build(left, right, 1, &mask));
+    ASSERT_EQ(pyramid.levels(), built.levels());
+    for (int level = 0; level < built.levels(); level++)
+    {
+        const cv::Size size = built.level_size(level);
+        ASSERT_EQ(pyramid.level_size(level), size);
+        for (int y = 0; y < size.height; y++)
+        {
+            for (int x = 0; x < size.width; x++)
+            {
+                EXPECT_EQ(pyramid.max_delta(level, cv::Point(x, y)), built.max_delta(level, cv::Point(x, y)));
+                EXPECT_EQ(pyramid.diff_pixels(level, cv::Point(x, y)), built.diff_pixels(level, cv::Point(x, y)));
+            }
+        }
+    }
+    EXPECT_EQ(pyramid.diff_pixels(built.levels() - 1, cv::Point(0, 0)), 9);
+}
+
+TEST(diff_pyramid, next_difference_in_z_order)
+{
+    cv::Mat left(200, 300, CV_8UC4, cv::Scalar(20, 40, 60, 255));
+    cv::Mat right = left.clone();
+    right.at<cv::Vec4b>(150, 10)[0] = 30; // cell (0, 9)
+    right.at<cv::Vec4b>(5, 290)[0] = 90;  // cell (18, 0)
+    right.at<cv::Vec4b>(6, 291)[0] = 25;  // same cell
+    right.at<cv::Vec4b>(20, 20)[2] = 61;  // within the tolerance
+
+    imcmp::DiffPyramid pyramid;
+    ASSERT_TRUE(pyramid.build(left, right, 1));
+    const int top = pyramid.levels() - 1;
+    EXPECT_EQ(pyramid.level_size(0), cv::Size(19, 13));
+    EXPECT_EQ(pyramid.level_size(top), cv::Size(1, 1));
+    EXPECT_EQ(pyramid.diff_pixels(top, cv::Point(0, 0)), 3);
+    EXPECT_EQ(pyramid.max_delta(top, cv::Point(0, 0)), 70);
+    EXPECT_EQ(pyramid.diff_pixels(0, cv::Point(18, 0)), 2);
+    EXPECT_EQ(pyramid.cell_rect(0, cv::Point(18, 0)), cv::Rect(288, 0, 12, 16));
+
+    // (0, 9) interleaves to 130, (18, 0) to 260
+    cv::Point cell;
+    ASSERT_TRUE(pyramid.next_difference(cv::Point(-1, -1), cell));
+    EXPECT_EQ(cell, cv::Point(0, 9));
+    ASSERT_TRUE(pyramid.next_difference(cell, cell));
+    EXPECT_EQ(cell, cv::Point(18, 0));
+    EXPECT_FALSE(pyramid.next_difference(cell, cell));
+}
+
+TEST(compare_verdict, budget_and_hard_cap)
+{
+    cv::Mat left(256, 64, CV_8UC4, cv::Scalar(20, 40, 60, 255));
+    cv::Mat right = left.clone();
+    for (int k = 0; k < 10; k++)
+    {
+        right.at<cv::Vec4b>(k * 25, k)[0] = 30;
+    }
+    right.at<cv::Vec4b>(100, 50)[1] = 90;
+
+    imcmp::CompareVerdict verdict = imcmp::compare_verdict(left, right, 1, 11, -1);
+    EXPECT_TRUE(verdict.passed);
+    EXPECT_FALSE(verdict.stopped_early);
+    EXPECT_EQ(verdict.diff_pixels, 11);
+    EXPECT_EQ(verdict.max_delta, 50);
+
+    verdict = imcmp::compare_verdict(left, right, 1, 10, -1);
+    EXPECT_FALSE(verdict.passed);
+    verdict = imcmp::compare_verdict(left, right, 1, 100, 49);
+    EXPECT_FALSE(verdict.passed);
+    EXPECT_TRUE(imcmp::compare_verdict(left, right, 1, 100, 50).passed);
+    EXPECT_TRUE(imcmp::compare_verdict(left, right, 50, 0, -1).passed);
+
+    // ignored pixels count toward neither the budget nor the cap
+    imcmp::CompareMask mask(left.size());
+    mask.ignore_rect(cv::Rect(40, 90, 24, 20));
+    mask.ignore_rect(cv::Rect(0, 0, 2, 30));
+    verdict = imcmp::compare_verdict(left, right, 1, 8, 10, &mask);
+    EXPECT_TRUE(verdict.passed);
+    EXPECT_EQ(verdict.diff_pixels, 8);
+    EXPECT_EQ(verdict.max_delta, 10);
+    EXPECT_FALSE(imcmp::compare_verdict(left, right, 1, 7, -1, &mask).passed);
+}
+
+#if IMCMP_WITH_LIBJPEG
+TEST(jpeg_compare, marked_blocks_match_full_decode_420)
+{
+    // 4:2:0 is the default sampling of the encoder; smooth content, so upsampling spreads chroma visibly
+    cv::Mat image(64, 64, CV_8UC3);
+    cv::randu(image, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(9, 9), 0);
+    cv::imwrite("chroma_a.jpg", image, {cv::IMWRITE_JPEG_QUALITY, 95});
+    image(cv::Rect(18, 18, 12, 12)) = cv::Scalar(30, 200, 90);
+    cv::imwrite("chroma_b.jpg", image, {cv::IMWRITE_JPEG_QUALITY, 95});
+
+    cv::Mat block_map;
+    ASSERT_EQ(imcmp::compare_jpeg_coefficients("chroma_a.jpg", "chroma_b.jpg", block_map), imcmp::JpegCompare::Different);
+    cv::Mat left;
+    cv::Mat right;
+    cv::cvtColor(cv::imread("chroma_a.jpg"), left, cv::COLOR_BGR2BGRA);
+    cv::cvtColor(cv::imread("chroma_b.jpg"), right, cv::COLOR_BGR2BGRA);
+
+    bool is_exactly_same = true;
+    imcmp::DiffStats marked;
+    imcmp::compare_marked_blocks(left, right, block_map, 8, 0, is_exactly_same, marked);
+    imcmp::DiffStats full;
+    imcmp::compute_diff_stats(left, right, 0, full);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_EQ(marked.diff_pixels, full.diff_pixels);
+    EXPECT_EQ(marked.max_delta, full.max_delta);
+    for (int k = 0; k < 4; k++)
+    {
+        EXPECT_EQ(marked.abs_sum[k], full.abs_sum[k]);
+    }
+}
+
+TEST(jpeg_compare, masked_pair)
+{
+    cv::Mat image(64, 64, CV_8UC3);
+    cv::randu(image, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(9, 9), 0);
+    cv::imwrite("masked_a.jpg", image, {cv::IMWRITE_JPEG_QUALITY, 95});
+    image(cv::Rect(18, 18, 12, 12)) = cv::Scalar(30, 200, 90);
+    cv::imwrite("masked_b.jpg", image, {cv::IMWRITE_JPEG_QUALITY, 95});
+
+    cv::Mat block_map;
+    ASSERT_EQ(imcmp::compare_jpeg_coefficients("masked_a.jpg", "masked_b.jpg", block_map), imcmp::JpegCompare::Different);
+    cv::Mat left;
+    cv::Mat right;
+    cv::cvtColor(cv::imread("masked_a.jpg"), left, cv::COLOR_BGR2BGRA);
+    cv::cvtColor(cv::imread("masked_b.jpg"), right, cv::COLOR_BGR2BGRA);
+
+    // a mask over part of the change gives the stats of the masked full compare
+    imcmp::CompareMask mask(left.size());
+    mask.ignore_rect(cv::Rect(0, 0, 24, 64));
+    bool is_exactly_same = true;
+    imcmp::DiffStats marked;
+    cv::Mat diff = imcmp::compare_marked_blocks(left, right, block_map, 8, 0, is_exactly_same, marked, &mask);
+    bool masked_same = true;
+    imcmp::DiffStats masked;
+    imcmp::compare_masked(left, right, mask, 0, masked_same, masked);
+    EXPECT_FALSE(is_exactly_same);
+    EXPECT_FALSE(masked_same);
+    EXPECT_EQ(marked.pixels, masked.pixels);
+    EXPECT_EQ(marked.diff_pixels, masked.diff_pixels);
+    EXPECT_EQ(marked.max_delta, masked.max_delta);
+    EXPECT_EQ(diff.at<cv::Vec4b>(20, 20), cv::Vec4b(48, 48, 48, 255));
+
+    // a mask over the whole change leaves nothing to report
+    mask.ignore_rect(cv::Rect(0, 0, 48, 48));
+    imcmp::compare_marked_blocks(left, right, block_map, 8, 0, is_exactly_same, marked, &mask);
+    EXPECT_TRUE(is_exactly_same);
+    EXPECT_EQ(marked.diff_pixels, 0);
+    EXPECT_EQ(marked.pixels, static_cast<int64_t>(left.total()) - mask.ignored_pixels());
+}
+#endif
@@ -0,0 +1,402 @@
+#include "gtest/gtest.h"
+
+#define STR_IMPLEMENTATION
+#include "image_io.hpp"
+#include "jpeg_io.hpp"
+#include "png_io.hpp"
+#include "test_util.hpp"
+
+TEST(raw_sequence, frame_count_from_file_size)
+{
+    std::vector<uchar> data(4 * 2 * 3);
+    for (int i = 0; i < data.size(); i++)
+    {
+        data[i] = i;
+    }
+    write_file("seq_4x2.gray", data);
+
+    imcmp::FileInfo file_info = imcmp::get_meta_info("seq_4x2.gray");
+    EXPECT_TRUE(file_info.valid);
+    EXPECT_EQ(file_info.frame_size, 8);
+    EXPECT_EQ(file_info.frame_count, 3);
+
+    // not a whole number of frames
+    data.push_back(0);
+    write_file("bad_4x2.gray", data);
+    EXPECT_FALSE(imcmp::get_meta_info("bad_4x2.gray").valid);
+}
+
+TEST(raw_sequence, random_frame_access)
+{
+    std::vector<uchar> data(4 * 2 * 3);
+    for (int i = 0; i < data.size(); i++)
+    {
+        data[i] = i;
+    }
+    write_file("seq_4x2.gray", data);
+
+    imcmp::RawSequence sequence;
+    ASSERT_TRUE(sequence.open("seq_4x2.gray"));
+    EXPECT_EQ(sequence.frame_count(), 3);
+
+    cv::Mat frame2 = sequence.load_frame(2);
+    ASSERT_EQ(frame2.size(), cv::Size(4, 2));
+    EXPECT_EQ(frame2.at<cv::Vec4b>(0, 0)[0], 16);
+    EXPECT_EQ(frame2.at<cv::Vec4b>(1, 3)[2], 23);
+
+    cv::Mat frame0 = imcmp::load_image_frame("seq_4x2.gray", 0);
+    EXPECT_EQ(frame0.at<cv::Vec4b>(1, 3)[1], 7);
+
+    EXPECT_TRUE(sequence.load_frame(3).empty());
+}
+
+TEST(raw_convert, direct_to_bgra)
+{
+    // 2x2 rgb24: red, green, blue, white
+    std::vector<uchar> data = {255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255};
+    write_file("rgb_2x2.rgb24", data);
+
+    cv::Mat image = imcmp::load_image("rgb_2x2.rgb24");
+    ASSERT_EQ(image.type(), CV_8UC4);
+    EXPECT_EQ(image.at<cv::Vec4b>(0, 0), cv::Vec4b(0, 0, 255, 255));
+    EXPECT_EQ(image.at<cv::Vec4b>(1, 0), cv::Vec4b(255, 0, 0, 255));
+
+    // rgba32 is read straight into the output
+    data = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    write_file("rgba_2x2.rgba32", data);
+    image = imcmp::load_image("rgba_2x2.rgba32");
+    ASSERT_EQ(image.type(), CV_8UC4);
+    EXPECT_EQ(image.at<cv::Vec4b>(1, 1), cv::Vec4b(15, 14, 13, 16));
+}
+
+TEST(raw_convert, yuv422_layouts_match_opencv)
+{
+    // wide enough for the vectorized path plus a scalar tail; chroma is shared by 2x2 blocks, so every subsampling
+    // describes the same pixels, and all layouts must decode like cvtColor() decodes yuyv
+    const int width = 70;
+    const int height = 4;
+    cv::Mat y(height, width, CV_8UC1);
+    cv::Mat u(height / 2, width / 2, CV_8UC1);
+    cv::Mat v(height / 2, width / 2, CV_8UC1);
+    cv::randu(y, 0, 256);
+    cv::randu(u, 0, 256);
+    cv::randu(v, 0, 256);
+    const auto sample = [&](char c, int i, int j) -> uchar {
+        return c == 'y' ? y.at<uchar>(i, j) : (c == 'u' ? u : v).at<uchar>(i / 2, j / 2);
+    };
+
+    // packed 4:2:2, bytes in the order of the name; the "2" variants swap the bytes of each 16-bit word
+    const auto packed_422 = [&](const std::string& order, bool swapped) {
+        std::vector<uchar> data;
+        for (int i = 0; i < height; i++)
+        {
+            for (int j = 0; j < width; j += 2)
+            {
+                uchar group[4];
+                int luma = 0;
+                for (int k = 0; k < 4; k++)
+                {
+                    group[k] = sample(order[k], i, order[k] == 'y' ? j + luma++ : j);
+                }
+                if (swapped)
+                {
+                    std::swap(group[0], group[1]);
+                    std::swap(group[2], group[3]);
+                }
+                data.insert(data.end(), group, group + 4);
+            }
+        }
+        return data;
+    };
+    // packed 4:4:4, bytes in the order of the name
+    const auto packed_444 = [&](const std::string& order) {
+        std::vector<uchar> data;
+        for (int i = 0; i < height; i++)
+        {
+            for (int j = 0; j < width; j++)
+            {
+                for (char c : order)
+                    data.push_back(sample(c, i, j));
+            }
+        }
+        return data;
+    };
+    // planar: Y, then U and V (V first if `swap_uv`) subsampled by 1 << shift; line packed rows hold their Y, U and V
+    const auto planar = [&](int shift_x, int shift_y, bool swap_uv, bool line_packed) {
+        std::vector<uchar> data;
+        const char chroma[2] = {swap_uv ? 'v' : 'u', swap_uv ? 'u' : 'v'};
+        if (line_packed)
+        {
+            for (int i = 0; i < height; i++)
+            {
+                for (int j = 0; j < width; j++)
+                    data.push_back(sample('y', i, j));
+                for (char c : chroma)
+                {
+                    for (int j = 0; j < width; j += 1 << shift_x)
+                        data.push_back(sample(c, i, j));
+                }
+            }
+            return data;
+        }
+        for (int i = 0; i < height; i++)
+        {
+            for (int j = 0; j < width; j++)
+                data.push_back(sample('y', i, j));
+        }
+        for (char c : chroma)
+        {
+            for (int i = 0; i < height; i += 1 << shift_y)
+            {
+                for (int j = 0; j < width; j += 1 << shift_x)
+                    data.push_back(sample(c, i, j));
+            }
+        }
+        return data;
+    };
+
+    write_file("ref_70x4.yuyv", packed_422("yuyv", false));
+    const cv::Mat expected = imcmp::load_image("ref_70x4.yuyv");
+    ASSERT_EQ(expected.type(), CV_8UC4);
+
+    const std::vector<std::pair<std::string, std::vector<uchar>>> layouts = {
+        {"uyvy", packed_422("uyvy", false)},
+        {"yvyu", packed_422("yvyu", false)},
+        {"vyuy", packed_422("vyuy", false)},
+        {"uyvy2", packed_422("uyvy", true)},
+        {"vyuy2", packed_422("vyuy", true)},
+        {"yuyv2", packed_422("yuyv", true)},
+        {"yvyu2", packed_422("yvyu", true)},
+        {"yvu", packed_444("yvu")},
+        {"uvy", packed_444("uvy")},
+        {"vuy", packed_444("vuy")},
+        {"i444", planar(0, 0, false, false)},
+        {"yv24", planar(0, 0, true, false)},
+        {"i422h", planar(1, 0, false, false)},
+        {"yv16h", planar(1, 0, true, false)},
+        {"i422v", planar(0, 1, false, false)},
+        {"yv16v", planar(0, 1, true, false)},
+        {"lpi422h", planar(1, 0, false, true)},
+    };
+    for (const auto& layout : layouts)
+    {
+        const std::string name = "layout_70x4." + layout.first;
+        write_file(name, layout.second);
+        cv::Mat image = imcmp::load_image(name);
+        ASSERT_EQ(image.type(), CV_8UC4) << name;
+        EXPECT_LE(cv::norm(expected, image, cv::NORM_INF), 1) << name;
+    }
+}
+
+TEST(raw_convert, high_bit_depth_native)
+{
+    // 4x1 10-bit samples, as y10 (little endian), y10be and MIPI RAW10 y10p
+    const ushort samples[4] = {0, 1, 513, 1023};
+    std::vector<uchar> le;
+    std::vector<uchar> be;
+    std::vector<uchar> packed(5, 0);
+    for (int j = 0; j < 4; j++)
+    {
+        le.push_back(samples[j] & 0xff);
+        le.push_back(samples[j] >> 8);
+        be.push_back(samples[j] >> 8);
+        be.push_back(samples[j] & 0xff);
+        packed[j] = samples[j] >> 2;
+        packed[4] |= (samples[j] & 3) << (2 * j);
+    }
+    write_file("a_4x1.y10", le);
+    write_file("b_4x1.y10be", be);
+    write_file("c_4x1.y10p", packed);
+
+    for (const char* name : {"a_4x1.y10", "b_4x1.y10be", "c_4x1.y10p"})
+    {
+        imcmp::FileInfo file_info = imcmp::get_meta_info(name);
+        ASSERT_TRUE(file_info.valid) << name;
+        EXPECT_EQ(file_info.bit_depth, 10);
+        cv::Mat native = imcmp::load_native_frame(file_info);
+        ASSERT_EQ(native.type(), CV_16UC1);
+        for (int j = 0; j < 4; j++)
+        {
+            EXPECT_EQ(native.at<ushort>(0, j), samples[j]) << name;
+        }
+        // displayed scaled down to 8 bits
+        EXPECT_EQ(imcmp::load_image(name).at<cv::Vec4b>(0, 3)[0], 255);
+    }
+}
+
+TEST(raw_convert, msb_aligned_native)
+{
+    // 2x2 p010 and p012 frames, little and big endian: a Y plane, then one interleaved UV pair
+    for (const int bit_depth : {10, 12})
+    {
+        const int max = (1 << bit_depth) - 1;
+        const ushort samples[6] = {0, 1, static_cast<ushort>(max / 2 + 1), static_cast<ushort>(max), 300, 700};
+        std::vector<uchar> le;
+        std::vector<uchar> be;
+        for (int k = 0; k < 6; k++)
+        {
+            const ushort v = samples[k] << (16 - bit_depth);
+            le.push_back(v & 0xff);
+            le.push_back(v >> 8);
+            be.push_back(v >> 8);
+            be.push_back(v & 0xff);
+        }
+        const std::string ext = cv::format("p0%d", bit_depth);
+        write_file("a_2x2." + ext, le);
+        write_file("b_2x2." + ext + "be", be);
+
+        for (const std::string& name : {"a_2x2." + ext, "b_2x2." + ext + "be"})
+        {
+            imcmp::FileInfo file_info = imcmp::get_meta_info(name);
+            ASSERT_TRUE(file_info.valid) << name;
+            EXPECT_EQ(file_info.bit_depth, bit_depth);
+            cv::Mat native = imcmp::load_native_frame(file_info);
+            ASSERT_EQ(native.type(), CV_16UC3);
+            for (int k = 0; k < 4; k++)
+            {
+                const cv::Vec3w yuv = native.at<cv::Vec3w>(k / 2, k % 2);
+                EXPECT_EQ(yuv[0], samples[k]) << name;
+                EXPECT_EQ(yuv[1], 300) << name;
+                EXPECT_EQ(yuv[2], 700) << name;
+            }
+        }
+    }
+}
+
+TEST(raw_convert, bayer_mosaic)
+{
+    std::vector<uchar> data(4 * 2 * 2, 0);
+    write_file("a_4x2.grbg12", data);
+    imcmp::FileInfo file_info = imcmp::get_meta_info("a_4x2.grbg12");
+    ASSERT_TRUE(file_info.valid);
+    EXPECT_EQ(file_info.cfa_pattern, "grbg");
+    EXPECT_EQ(file_info.bit_depth, 12);
+
+    // the mosaic is loaded as is, and only demosaiced for display
+    cv::Mat native = imcmp::load_native_frame(file_info);
+    EXPECT_EQ(native.type(), CV_16UC1);
+    EXPECT_EQ(imcmp::load_image("a_4x2.grbg12").type(), CV_8UC4);
+
+    write_file("b_4x2.rggb", std::vector<uchar>(4 * 2));
+    EXPECT_EQ(imcmp::load_native_frame(imcmp::get_meta_info("b_4x2.rggb")).type(), CV_8UC1);
+}
+
+TEST(image_format, extension_lookup)
+{
+    const imcmp::FormatDesc* i420 = imcmp::find_format("i420");
+    ASSERT_TRUE(i420 != NULL);
+    EXPECT_EQ(imcmp::find_format("yuv"), i420);
+    EXPECT_EQ(imcmp::find_format("iyuv"), i420);
+    EXPECT_EQ(imcmp::find_format("jpeg")->kind, imcmp::FormatKind::Encoded);
+    EXPECT_TRUE(imcmp::find_format("i42") == NULL);
+    EXPECT_TRUE(imcmp::find_format("") == NULL);
+
+    // every listed extension resolves
+    for (const std::string& ext : imcmp::supported_format_exts())
+    {
+        EXPECT_TRUE(imcmp::find_format(ext) != NULL) << ext;
+    }
+}
+
+TEST(raw_convert, row_sampled_preview)
+{
+    std::vector<uchar> data(8 * 8);
+    for (int i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<uchar>(i * 3);
+    }
+    write_file("a_8x8.gray", data);
+    cv::Mat preview = imcmp::load_image_preview("a_8x8.gray", 2);
+    ASSERT_EQ(preview.size(), cv::Size(4, 4));
+    EXPECT_EQ(preview.at<cv::Vec4b>(3, 1)[0], data[6 * 8 + 2]);
+
+    // 4:2:0 rows are sampled in pairs, so every kept pixel converts as in the full image
+    data.resize(8 * 8 * 3 / 2);
+    for (int i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<uchar>(i * 7);
+    }
+    write_file("b_8x8.nv12", data);
+    cv::Mat full = imcmp::load_image("b_8x8.nv12");
+    preview = imcmp::load_image_preview("b_8x8.nv12", 2);
+    ASSERT_EQ(preview.size(), cv::Size(4, 4));
+    const int src_rows[4] = {0, 1, 4, 5};
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            EXPECT_EQ(preview.at<cv::Vec4b>(i, j), full.at<cv::Vec4b>(src_rows[i], j * 2));
+        }
+    }
+}
+
+#if IMCMP_WITH_LIBJPEG
+TEST(jpeg_compare, dct_coefficients)
+{
+    cv::Mat image(70, 100, CV_8UC3);
+    cv::randu(image, 0, 256);
+    cv::imwrite("a.jpg", image);
+    cv::imwrite("b.jpg", image);
+    cv::Mat block_map;
+    EXPECT_TRUE(imcmp::is_jpeg_file("a.jpg"));
+    EXPECT_EQ(imcmp::compare_jpeg_coefficients("a.jpg", "b.jpg", block_map), imcmp::JpegCompare::Identical);
+
+    // only the blocks of the changed MCU are marked, widened by one 16x16 MCU for 4:2:0 chroma upsampling
+    image(cv::Rect(50, 40, 4, 4)) = cv::Scalar(0, 0, 0);
+    cv::imwrite("c.jpg", image);
+    ASSERT_EQ(imcmp::compare_jpeg_coefficients("a.jpg", "c.jpg", block_map), imcmp::JpegCompare::Different);
+    EXPECT_EQ(block_map.size(), cv::Size(13, 9));
+    EXPECT_EQ(block_map.at<uchar>(5, 6), 255);
+    EXPECT_LE(cv::countNonZero(block_map), 6 * 6);
+    EXPECT_EQ(block_map.at<uchar>(0, 0), 0);
+
+    write_file("a_8x8.gray", std::vector<uchar>(64));
+    EXPECT_EQ(imcmp::compare_jpeg_coefficients("a.jpg", "a_8x8.gray", block_map), imcmp::JpegCompare::Undecided);
+}
+#endif
+
+#if IMCMP_WITH_LIBJPEG
+TEST(parallel_decode, jpeg_restart_slices)
+{
+    cv::Mat image(157, 256, CV_8UC3);
+    cv::randu(image, 0, 256);
+    cv::GaussianBlur(image, image, cv::Size(5, 5), 0);
+    // a restart marker at every MCU row of 16 MCUs (4:2:0)
+    cv::imwrite("rst.jpg", image, {cv::IMWRITE_JPEG_RST_INTERVAL, 16});
+    cv::Mat expected = cv::imread("rst.jpg", cv::IMREAD_UNCHANGED);
+    for (int slices = 1; slices <= 4; slices++)
+    {
+        cv::Mat decoded;
+        ASSERT_TRUE(imcmp::decode_jpeg_parallel("rst.jpg", decoded, slices));
+        EXPECT_EQ(cv::norm(decoded, expected, cv::NORM_INF), 0) << slices;
+    }
+
+    // without restart markers the scan can't be sliced
+    cv::imwrite("norst.jpg", image);
+    cv::Mat decoded;
+    EXPECT_FALSE(imcmp::decode_jpeg_parallel("norst.jpg", decoded));
+}
+#endif
+
+#if IMCMP_WITH_ZLIB
+TEST(parallel_decode, png_pipeline)
+{
+    // tall enough for several bands in flight
+    cv::Mat image(2400, 173, CV_8UC4);
+    cv::randu(image, 0, 256);
+    for (int channels : {1, 3, 4})
+    {
+        cv::Mat src;
+        cv::extractChannel(image, src, 0);
+        if (channels == 3)
+            cv::cvtColor(image, src, cv::COLOR_BGRA2BGR);
+        else if (channels == 4)
+            src = image;
+        cv::imwrite("pipe.png", src);
+        cv::Mat decoded;
+        ASSERT_TRUE(imcmp::decode_png_pipelined("pipe.png", decoded)) << channels;
+        EXPECT_EQ(decoded.type(), src.type());
+        EXPECT_EQ(cv::norm(decoded, src, cv::NORM_INF), 0) << channels;
+    }
+}
+#endif
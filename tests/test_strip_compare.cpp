@@ -0,0 +1,47 @@
+#include "gtest/gtest.h"
+
+#define STR_IMPLEMENTATION
+#include "strip_compare.hpp"
+#include "image_compare.hpp"
+#include "test_util.hpp"
+
+TEST(strip_compare, matches_whole_image_metrics)
+{
+    // odd strip height on 4:2:0, so strips are rounded to whole chroma rows
+    std::vector<uchar> data(10 * 10 * 3 / 2);
+    for (int i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<uchar>(i * 5);
+    }
+    write_file("a_10x10.nv12", data);
+    data[3 * 10 + 9] += 40;
+    data[7 * 10 + 2] += 40;
+    write_file("b_10x10.nv12", data);
+
+    imcmp::StripCompareResult result;
+    ASSERT_TRUE(imcmp::compare_in_strips("a_10x10.nv12", "b_10x10.nv12", 1, 3, "mask.pbm", result));
+    imcmp::DiffStats stats;
+    imcmp::compute_diff_stats(imcmp::load_image("a_10x10.nv12"), imcmp::load_image("b_10x10.nv12"), 1, stats);
+    EXPECT_EQ(result.stats.diff_pixels, stats.diff_pixels);
+    EXPECT_EQ(result.stats.max_delta, stats.max_delta);
+    EXPECT_NEAR(result.stats.psnr(), stats.psnr(), 1e-6);
+    for (int d = 0; d < 256; d++)
+    {
+        EXPECT_EQ(result.stats.histogram[d], stats.histogram[d]);
+    }
+
+    FILE* fin = fopen("mask.pbm", "rb");
+    ASSERT_TRUE(fin != NULL);
+    int width = 0;
+    int height = 0;
+    ASSERT_EQ(fscanf(fin, "P4 %d %d", &width, &height), 2);
+    fgetc(fin);
+    std::vector<uchar> bits(2 * 10);
+    EXPECT_EQ(fread(bits.data(), 1, bits.size(), fin), bits.size());
+    fclose(fin);
+    EXPECT_EQ(width, 10);
+    EXPECT_EQ(height, 10);
+    EXPECT_TRUE(bits[3 * 2 + 1] & 0x40);
+    EXPECT_TRUE(bits[7 * 2] & 0x20);
+    EXPECT_FALSE(bits[0] & 0x80);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "gtest/gtest.h"
+#include <opencv2/core.hpp>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+inline void write_file(const std::string& filename, const std::vector<uchar>& data)
+{
+    FILE* fout = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(fout != NULL);
+    fwrite(data.data(), 1, data.size(), fout);
+    fclose(fout);
+}